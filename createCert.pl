@@ -4,7 +4,7 @@
 # Chat keys generator.
 # (c) 2013-2023 GBonacini
 # All Rights Reserved.
-my $VERSION="0.3.2";
+my $VERSION="0.4.0";
 #########################################################
 
 use strict;
@@ -19,9 +19,17 @@ my %options;
 my @keyFiles=qw/ca.pem privkey.pem server.key server.pem server.req/;
 my $opensslCnf="[ req ]\ndefault_bits = 4096\ndefault_keyfile = privkey.pem\ndistinguished_name = req_distinguished_name\nprompt = no\n[ req_distinguished_name ]\nC = IT\nST = Sometplace\nL = Somewhere\nO = Dynamiclib\nOU = Dynamiclib\nCN = Common\nemailAddress = thistest\@thistest.com\n";
 
-my $ERR_MSG=" [-h]\n";
-getopts("h",\%options);
+my %keyTypes=(
+	"rsa"     => "openssl genrsa -out %s 4096",
+	"ec"      => "openssl genpkey -algorithm EC -pkeyopt ec_paramgen_curve:P-256 -out %s",
+	"ed25519" => "openssl genpkey -algorithm ED25519 -out %s"
+);
+
+my $ERR_MSG=" [-t rsa|ec|ed25519] [-h]\n";
+getopts("ht:",\%options);
 die ("$0 ${ERR_MSG}version=$VERSION\n") if(defined $options{h});
+my $keyType=defined $options{t} ? lc($options{t}) : "rsa";
+die ("$0 ${ERR_MSG}Invalid key type: $keyType\n") unless(exists $keyTypes{$keyType});
 
 mkdir("$secureDir") unless -d $secureDir;
 
@@ -52,12 +60,22 @@ if(-d "$secureDir"){
 	chdir("$secureDir") or die "Can change directory to $secureDir: $!";
 }
 
-print STDERR "--- CA creation:\n";
-system("openssl req -config $configFile -out ca.pem -new -x509") == 0
-        or die "CA creation error: $?";
+if($keyType eq "rsa"){
+	print STDERR "--- CA creation:\n";
+	system("openssl req -config $configFile -out ca.pem -new -x509") == 0
+	        or die "CA creation error: $?";
+}else{
+	print STDERR "--- CA private key creation ($keyType):\n";
+	system(sprintf($keyTypes{$keyType}, "privkey.pem")) == 0
+	        or die "CA private key creation error: $?";
+
+	print STDERR "--- CA creation:\n";
+	system("openssl req -config $configFile -key privkey.pem -out ca.pem -new -x509") == 0
+	        or die "CA creation error: $?";
+}
 
-print STDERR "--- Private key creation:\n";
-system("openssl genrsa -out server.key 4096") == 0
+print STDERR "--- Private key creation ($keyType):\n";
+system(sprintf($keyTypes{$keyType}, "server.key")) == 0
         or die "Private key creation error: $?";
 
 print STDERR "--- Certificate request creation:\n";
@@ -14,8 +14,9 @@ port = 8181
 
 --[[ Flag:           tunaddress
      Type:           String representing TUN IP address
-     Synopsis:       Set IP address assigned TUN interface
-     Valid values:   A valid IPv4 address
+     Synopsis:       Set IP address assigned TUN interface. A client with "auto" gets its address and netmask from 
+                     the server addresspool after the handshake, tunmask is then ignored
+     Valid values:   A valid IPv4 address, or "auto" (client only)
 --]]
 tunaddress = "10.0.0.1"
 
@@ -59,3 +60,354 @@ psize = 1500
 --]]
 log = "/home/test/vpn/nnvpn.log.txt"
 
+--[[ Flag:           keepalive
+     Type:           Number representing keepalive interval in milliseconds (optional, default 10000)
+     Synopsis:       Interval between PING frames sent to the peer, used also to measure RTT and jitter
+     Valid values:   A positive number, 0 disables keepalive frames
+--]]
+keepalive = 10000
+
+--[[ Flag:           deadpeer
+     Type:           Number representing dead peer detection interval in milliseconds (optional, default 30000)
+     Synopsis:       The connection is closed if nothing is received from the peer within this interval
+                     or if the peer doesn't read the data queued for it within this interval
+     Valid values:   A number greater than keepalive, 0 disables dead peer detection
+--]]
+deadpeer = 30000
+
+--[[ Flag:           statsinterval
+     Type:           Number representing statistics log interval in milliseconds (optional, default 0)
+     Synopsis:       Traffic, keepalive and RTT statistics are written in the log file with this period. 
+                     Statistics are also written on SIGUSR1 reception.
+     Valid values:   A positive number, 0 disables periodic statistics
+--]]
+statsinterval = 0
+
+--[[ Flag:           handshaketimeout
+     Type:           Number representing TLS handshake timeout in milliseconds (optional, default 10000)
+     Synopsis:       Server only: clients not completing the TLS handshake within this interval are dropped.
+                     Handshakes run in the event loop without stopping established sessions.
+     Valid values:   A positive number
+--]]
+handshaketimeout = 10000
+
+--[[ Flag:           eventloop
+     Type:           String representing the event loop backend (optional, default "epoll")
+     Synopsis:       "uring" uses io_uring (Linux 5.11 or later): poll registrations and the wait share one syscall;
+                     on Linux 6.7 or later the TUN device is read by a multishot read into registered buffers
+     Valid values:   "epoll", "select" or "uring"
+--]]
+eventloop = "epoll"
+
+--[[ Flag:           maxhandshakes
+     Type:           Number representing the max number of concurrent TLS handshakes (optional, default 64)
+     Synopsis:       Server only: connections exceeding this limit are reset before any cryptographic work
+     Valid values:   A positive number, 0 disables the limit
+--]]
+maxhandshakes = 64
+
+--[[ Flag:           admissionrate
+     Type:           Number representing accepted connections per second for each source address (optional, default 5.0)
+     Synopsis:       Server only: token bucket refill rate, connections exceeding it are reset before any cryptographic work
+     Valid values:   A positive number, 0 disables per source admission control
+--]]
+admissionrate = 5.0
+
+--[[ Flag:           admissionburst
+     Type:           Number representing the token bucket size for each source address (optional, default 10.0)
+     Valid values:   A number greater or equal to 1
+--]]
+admissionburst = 10.0
+
+--[[ Flag:           tlsgroups
+     Type:           String representing the TLS key exchange groups, colon separated, in preference order (optional, default "X25519:P-256:P-384")
+     Synopsis:       The certificate can use an RSA, ECDSA or Ed25519 key (see createCert.pl -t)
+     Valid values:   Group names known to OpenSSL, e.g. "X25519", "P-256", "P-384"
+--]]
+tlsgroups = "X25519:P-256:P-384"
+
+--[[ Flag:           ciphersuites
+     Type:           String representing the TLS 1.3 cipher suites, colon separated, in preference order (optional, default "auto")
+     Synopsis:       "auto" measures AES-GCM and ChaCha20-Poly1305 throughput at startup and prefers the fastest on this CPU
+     Valid values:   "auto" or suite names known to OpenSSL, e.g. "TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256"
+--]]
+ciphersuites = "auto"
+
+--[[ Flag:           ciphercache
+     Type:           String representing the file caching the "auto" cipher suites measurement (optional, default "": no cache)
+     Synopsis:       The cached result is discarded when the CPU model or the OpenSSL version change
+     Valid values:   A writable file path
+--]]
+ciphercache = ""
+
+--[[ Flag:           readahead
+     Type:           Number representing the TLS read-ahead buffer length in bytes (optional, default 65536)
+     Synopsis:       A single read() fetches all the records available, instead of two reads for each record
+     Valid values:   0 disables read-ahead, otherwise a number up to 16777216
+--]]
+readahead = 65536
+
+--[[ Flag:           idlerelease
+     Type:           Number representing the milliseconds without traffic before a session frees its TLS buffers (optional, default 30000)
+     Synopsis:       Server only: idle sessions use SSL_MODE_RELEASE_BUFFERS, busy ones keep their buffers
+     Valid values:   A positive number, 0 disables it
+--]]
+idlerelease = 30000
+
+--[[ Flag:           transport
+     Type:           String representing how TLS records reach the socket (optional, default "socket")
+     Synopsis:       "socket" binds OpenSSL to the socket, one write() per record; "membio" runs OpenSSL over memory 
+                     buffers: records queued in a pass leave with a single sendmsg() and inbound data is read in large chunks
+     Valid values:   "socket" or "membio"
+--]]
+transport = "socket"
+
+--[[ Flag:           tunbatch
+     Type:           Number representing the max packets read from the TUN device for each wakeup (optional, default 32)
+     Synopsis:       The whole batch is encrypted before going back to the event loop; 1 reads a single packet as before.
+                     Batch statistics are logged with SIGUSR1
+     Valid values:   A number from 1 to 1024
+--]]
+tunbatch = 32
+
+--[[ Flag:           tunbudget
+     Type:           Number representing the max bytes read from the TUN device for each wakeup (optional, default 262144)
+     Valid values:   A number greater or equal to psize
+--]]
+tunbudget = 262144
+
+--[[ Flag:           flushdeadline
+     Type:           Number representing the max microseconds a TLS record waits for more packets (optional, default 100)
+     Synopsis:       Packets are coalesced in a record while the measured rate would fill at least two of them 
+                     within the deadline; with light traffic every record leaves at the end of the loop pass.
+                     0 coalesces only the packets read in the same pass
+     Valid values:   A number from 0 to 10000
+--]]
+flushdeadline = 100
+
+--[[ Flag:           flushpackets
+     Type:           Number representing the max packets coalesced in a TLS record (optional, default 32)
+     Valid values:   A positive number
+--]]
+flushpackets = 32
+
+--[[ Flag:           recordidle
+     Type:           Number representing the milliseconds without writes after which TLS records restart small (optional, default 1000)
+     Synopsis:       After idle, records are cut to one MSS so the first bytes are decrypted early; they grow to 16KB
+                     when the unsent socket backlog reaches TCP_NOTSENT_LOWAT (16KB if unset) or after 256KB of bulk transfer.
+                     0 disables it: records are always full size
+     Valid values:   A number greater or equal to 0
+--]]
+recordidle = 1000
+
+--[[ Flag:           sockprofile
+     Type:           String representing the tuning profile of the tunnel TCP sockets (optional, default "default")
+     Synopsis:       "default" keeps the kernel settings; "latency" sets TCP_NODELAY and a 16KB TCP_NOTSENT_LOWAT;
+                     "throughput" adds 4MB SO_SNDBUF/SO_RCVBUF, 128KB TCP_NOTSENT_LOWAT and BBR; "lossy" is as 
+                     throughput with 8MB buffers. The options below override single profile values, -1 or "" keep
+                     the profile value. The effective values are written in the statistics
+     Valid values:   "default", "latency", "throughput", "lossy"
+--]]
+sockprofile = "default"
+
+--[[ Flag:           sndbuf, rcvbuf
+     Type:           Numbers representing SO_SNDBUF and SO_RCVBUF in bytes (optional, default -1: profile value)
+     Synopsis:       A fixed size disables the kernel buffer autotuning
+--]]
+sndbuf = -1
+rcvbuf = -1
+
+--[[ Flag:           nodelay
+     Type:           Number representing TCP_NODELAY (optional, default -1: profile value)
+     Valid values:   -1, 0, 1
+--]]
+nodelay = -1
+
+--[[ Flag:           notsentlowat
+     Type:           Number representing TCP_NOTSENT_LOWAT in bytes (optional, default -1: profile value)
+--]]
+notsentlowat = -1
+
+--[[ Flag:           busypoll
+     Type:           Number representing SO_BUSY_POLL in microseconds (optional, default -1: profile value)
+     Synopsis:       Values above the net.core.busy_poll sysctl require CAP_NET_ADMIN
+--]]
+busypoll = -1
+
+--[[ Flag:           tcpcongestion
+     Type:           String representing the TCP congestion control algorithm (optional, default "": profile value)
+     Synopsis:       The algorithm must be listed in net.ipv4.tcp_available_congestion_control, or nnvpn doesn't start
+     Valid values:   e.g. "cubic", "bbr"
+--]]
+tcpcongestion = ""
+
+--[[ Flag:           bdpinterval
+     Type:           Number representing the milliseconds between TCP_INFO samples of the BDP controller (optional, default 0)
+     Synopsis:       SO_SNDBUF is grown to bdpfactor times the estimated bandwidth-delay product, delivery rate x min RTT,
+                     up to 64MB, when that's over the buffer the kernel has; it's never shrunk. Growth is held while the
+                     RTT is over twice the minimum. Setting SO_SNDBUF ends the kernel autotuning, so it's only done when
+                     autotuning falls short. The membio egress queue follows the buffer, at least 128KB. Skipped when
+                     sndbuf or the socket profile set the buffer; decisions are logged at debug level 1. 0 disables it
+     Valid values:   A number greater or equal to 0
+--]]
+bdpinterval = 0
+
+--[[ Flag:           bdpfactor
+     Type:           Float representing the buffer size as multiple of the bandwidth-delay product (optional, default 1.5)
+     Valid values:   A number from 1.0 to 4.0
+--]]
+bdpfactor = 1.5
+
+--[[ Flag:           zerocopy
+     Type:           Number representing the minimum bytes of a membio flush sent with MSG_ZEROCOPY (optional, default 0)
+     Synopsis:       Only with transport = "membio". Large flushes skip the copy into the socket buffer, the ciphertext 
+                     buffers return to the pool when the kernel reports their completion. Smaller flushes are copied; 
+                     if the kernel copies anyway (e.g. loopback) zerocopy is turned off. 0 disables it. 
+                     See "nnvpn -b zerocopy" for the break even point on the target machine
+     Valid values:   A number greater or equal to 0, e.g. 32768
+--]]
+zerocopy = 0
+
+--[[ Flag:           busyspin
+     Type:           Number representing the microseconds the event loop keeps polling after traffic (optional, default 0)
+     Synopsis:       For latency sensitive deployments: after each wakeup with traffic the loop polls without sleeping
+                     for this time, then blocks again; a window that catches no traffic halves the next one, down to 
+                     1/8. It sets SO_BUSY_POLL to 50us when busypoll isn't given. Spinning costs a core: use it with datacpu.
+                     0 disables it
+     Valid values:   A number from 0 to 1000000
+--]]
+busyspin = 0
+
+--[[ Flag:           datacpu
+     Type:           Number representing the CPU the data plane thread is pinned to (optional, default -1: no pinning)
+     Valid values:   -1 or a CPU number allowed to the process
+--]]
+datacpu = -1
+
+--[[ Flag:           numalocal
+     Type:           Boolean, prefer the NUMA node of datacpu for the data plane memory (optional, default false)
+     Synopsis:       The thread is pinned before the buffers are allocated, so they are first touched there as well. 
+                     It requires datacpu
+--]]
+numalocal = false
+
+--[[ Flag:           rtpriority
+     Type:           Number representing the SCHED_FIFO priority of the data plane thread (optional, default 0: normal scheduling)
+     Synopsis:       It requires cap_sys_nice (setcap cap_net_admin,cap_sys_nice=ep). A real time thread that busy spins
+                     can starve its core: pin it with datacpu
+     Valid values:   A number from 0 to 99
+--]]
+rtpriority = 0
+
+--[[ Flag:           lockmemory
+     Type:           Boolean, lock the process memory with mlockall and prefault the data plane stack (optional, default false)
+     Synopsis:       No page faults on the data path. It requires cap_ipc_lock (setcap cap_net_admin,cap_ipc_lock=ep)
+--]]
+lockmemory = false
+
+--[[ Flag:           hugepages
+     Type:           String representing the backing of the packet buffer arena (optional, default "off")
+     Synopsis:       TUN batches, record and frame buffers of all sessions are carved from one arena of 2MB pages.
+                     "thp" uses transparent huge pages, "hugetlb" the vm.nr_hugepages pool and falls back to "thp" when it's empty
+     Valid values:   "off", "thp" or "hugetlb"
+--]]
+hugepages = "off"
+
+--[[ Flag:           packetarena
+     Type:           Integer, size of the packet buffer arena in KB, rounded up to 2MB (optional, default 8192)
+     Synopsis:       Buffers that don't fit fall back to the heap, SIGUSR1 reports peak usage and fallbacks
+--]]
+packetarena = 8192
+
+--[[ Flag:           sslpool
+     Type:           Boolean, route OpenSSL allocations through size class pools with per thread caches (optional, default true)
+     Synopsis:       Reconnecting peers reuse the SSL objects, record buffers and handshake state blocks of the previous ones.
+                     SIGUSR1 reports allocations, pool hits and live bytes
+--]]
+sslpool = true
+
+--[[ Flag:           routes
+     Type:           String, comma separated list of "prefix via address" routes (server only, optional, default "": none)
+     Synopsis:       The prefix is reached through the client whose tunnel address is the via address, as soon as that client
+                     sends its first packet. Longest prefix match; clients are otherwise reached by their tunnel address
+     Valid values:   e.g. "192.168.10.0/24 via 10.0.0.2, 172.16.0.0/16 via 10.0.0.3"
+--]]
+routes = ""
+
+--[[ Flag:           acceptroutes
+     Type:           Boolean, accept the prefixes announced by the clients (server only, optional, default false)
+     Synopsis:       Announced prefixes never replace a configured route or one announced by another client, and
+                     are removed when the announcing client disconnects
+--]]
+acceptroutes = false
+
+--[[ Flag:           announce
+     Type:           String, comma separated list of prefixes reachable behind this client (client only, optional, default "": none)
+     Synopsis:       Sent to the server after the handshake; the server must have acceptroutes enabled. At most 1024 prefixes
+     Valid values:   e.g. "192.168.1.0/24, 192.168.2.0/24"
+--]]
+announce = ""
+
+--[[ Flag:           addresspool
+     Type:           String, the prefix tunnel addresses are leased from (server only, optional, default "": no pool)
+     Synopsis:       Clients configured with tunaddress = "auto" request a free address from the pool after the handshake; the
+                     network, broadcast and server tunaddress are excluded. Leased addresses are routed to their client.
+                     A client configured with an address inside the pool holds it while connected, if it's free
+     Valid values:   A prefix from /16 to /30, e.g. "10.0.0.0/24"
+--]]
+addresspool = ""
+
+--[[ Flag:           leasetime
+     Type:           Number representing the milliseconds a disconnected client keeps its address (server only, optional, default 600000)
+     Synopsis:       A client reconnecting from the same host and tun device within the lease time gets the same tunnel address,
+                     whatever its source address: it's identified by a digest of /etc/machine-id and the device name, bound
+                     to the public key of its certificate (the server requests the client certificate when the pool is set).
+                     When the pool is full, the oldest held lease is reused. 0 frees the address at disconnection
+     Valid values:   A number greater or equal to 0
+--]]
+leasetime = 600000
+
+--[[ Flag:           hairpin
+     Type:           Boolean, forward client to client traffic inside the server (server only, optional, default false)
+     Synopsis:       Packets for the tunnel address, or a routed prefix, of another connected client are passed from one
+                     session to the other without going through the TUN device: the kernel forwarding and firewall rules
+                     are not applied to them. The TTL is decremented; other packets still go to the TUN device
+--]]
+hairpin = false
+
+--[[ Flag:           egressqueue
+     Type:           Number of packets each client can have waiting to be encrypted (server only, optional, default 128)
+     Synopsis:       Packets read from the TUN device are queued per client and sent in deficit round-robin order, so a
+                     busy client can't starve the others. A client over its queue drops its own packets; when all the
+                     queues together hold egressqueue * 8 packets, the longest one drops. 0 sends packets as they are read
+     Valid values:   A number from 0 to 4096
+--]]
+egressqueue = 128
+
+--[[ Flag:           weights
+     Type:           String, comma separated list of "prefix weight" pairs (server only, optional, default "": all weights 1)
+     Synopsis:       Clients whose source address matches the prefix, longest match first, get weight shares of the egress
+                     bandwidth instead of one. Used with egressqueue greater than 0
+     Valid values:   Weights from 1 to 64, e.g. "203.0.113.0/24 4, 198.51.100.7 2"
+--]]
+weights = ""
+
+--[[ Flag:           shapegroups
+     Type:           String, comma separated list of "name ingress_kbit ingress_burst_kb egress_kbit egress_burst_kb" groups
+                     (server only, optional, default "": none)
+     Synopsis:       Rate limits shared by all the clients of the group, see shaping. Ingress is the traffic from the
+                     clients, egress the traffic to them; rates are in kbit/s, bursts in KB, a 0 rate doesn't limit
+     Valid values:   Rates up to 100000000, bursts from 1 to 1048576, e.g. "gold 100000 512 200000 1024, bronze 10000 64 20000 128"
+--]]
+shapegroups = ""
+
+--[[ Flag:           shaping
+     Type:           String, comma separated list of "prefix ingress_kbit ingress_burst_kb egress_kbit egress_burst_kb [group]"
+                     rules (server only, optional, default "": no shaping)
+     Synopsis:       Every client whose source address matches the prefix, longest match first, gets its own rate limits
+                     and is also limited by the group ones, if any. Egress over the rate waits in the client queue, or is
+                     dropped with egressqueue = 0; ingress over the rate stops reading the client until the rate allows it,
+                     without deadpeer taking it for dead meanwhile
+     Valid values:   As in shapegroups, e.g. "203.0.113.0/24 5000 64 20000 256 gold, 198.51.100.7 0 0 2000 32"
+--]]
+shaping = ""
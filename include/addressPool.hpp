@@ -0,0 +1,90 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+#include <anyexcept.hpp>
+#include <routeTable.hpp>
+
+namespace inetlib {
+
+    // Assignment payload: | address (BE32) | prefix length |, the PREFIX_WIRE_LEN layout.
+    // Request payload: | client identity (BE64) |.
+    constexpr size_t  ADDRESS_WIRE_LEN    { PREFIX_WIRE_LEN },
+                      LEASE_WIRE_LEN      { 8 };
+    constexpr uint8_t POOL_MIN_PREFIX     { 16 },
+                      POOL_MAX_PREFIX     { 30 };
+
+    // Tunnel addresses handed out by the server. Free addresses are bits of a two level 
+    // bitmap: a summary word tells which words still have a free bit, so acquire and release 
+    // are a couple of ctz whatever the pool size (up to a /16). A client leaving keeps its 
+    // address for the lease time, keyed by the identity it sent with its request, and gets 
+    // it back when it reconnects; a full pool takes the oldest held lease before refusing 
+    // a client. Addresses configured on clients are claimed while they are connected.
+    class AddressPool{
+        public:
+            AddressPool(Prefix range, uint64_t leaseUs)                    anyexcept;
+
+            bool          enabled(void)                              const noexcept;
+            bool          contains(uint32_t addr)                    const noexcept;
+            uint8_t       prefixLen(void)                            const noexcept;
+            void          reserve(uint32_t addr)                           noexcept;
+            bool          claim(uint32_t addr)                             noexcept;
+            void          unclaim(uint32_t addr)                           noexcept;
+            uint32_t      acquire(uint64_t owner, uint64_t now)            noexcept;
+            void          release(uint32_t addr, uint64_t owner, 
+                                  uint64_t now)                            noexcept;
+            std::string   report(void)                               const anyexcept;
+
+        private:
+            struct Lease{
+                uint32_t   addr;
+                uint64_t   expires;
+            };
+
+            struct Expiry{
+                uint64_t   expires;
+                uint64_t   owner;
+            };
+
+            Prefix                                  range;
+            uint64_t                                leaseTime;
+            std::vector<uint64_t>                   bits,
+                                                    summary;
+            std::unordered_map<uint64_t, Lease>     held;
+            std::deque<Expiry>                      expiries;
+            size_t                                  available    { 0 },
+                                                    inUse        { 0 };
+            uint64_t                                assigned     { 0 },
+                                                    reused       { 0 },
+                                                    preempted    { 0 },
+                                                    exhausted    { 0 },
+                                                    claimed      { 0 };
+
+            void          take(size_t index)                               noexcept;
+            void          give(size_t index)                               noexcept;
+            bool          expire(uint64_t now, bool oldest)                noexcept;
+    };
+
+} // End namespace
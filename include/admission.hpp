@@ -0,0 +1,67 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    enum ADMISSION_RESULT : uint8_t { ADMIT_OK, ADMIT_RATE_LIMITED, ADMIT_TOO_MANY_HANDSHAKES };
+
+    // Per source address token buckets kept in a fixed size open addressing table: 
+    // memory doesn't grow with the number of sources, a full probe window evicts 
+    // its least recently seen entry.
+    class AdmissionControl{
+        public:
+            AdmissionControl(double ratePerSec, double burst, 
+                             size_t maxHandshakes, size_t slots=4096)      anyexcept;
+
+            ADMISSION_RESULT  admit(uint32_t srcAddr, uint64_t now,
+                                    size_t pendingHandshakes)              noexcept;
+            std::string       report(void)                           const anyexcept;
+
+        private:
+            static constexpr size_t PROBE_WINDOW { 8 };
+
+            struct Bucket{
+                uint32_t   addr;
+                float      tokens;
+                uint64_t   last;
+            };
+
+            std::vector<Bucket>  table;
+            size_t               mask;
+            uint32_t             seed;
+            double               rate,
+                                 burst;
+            size_t               maxPending;
+            uint64_t             admitted        { 0 },
+                                 rejectedRate    { 0 },
+                                 rejectedCap     { 0 },
+                                 evictions       { 0 },
+                                 maxPendingSeen  { 0 };
+
+            Bucket&           lookup(uint32_t srcAddr, uint64_t now)       noexcept;
+    };
+
+} // End namespace
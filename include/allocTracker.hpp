@@ -0,0 +1,37 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace inetlib {
+
+    // Heap allocations made by the calling thread between arm() and disarm(). Counting needs
+    // a build configured with --enable-alloc-check (NNVPN_ALLOC_CHECK), which interposes
+    // malloc and its siblings, operator new included; otherwise enabled() is false and
+    // nothing is counted.
+    class AllocTracker{
+        public:
+            static bool      enabled(void)                                 noexcept;
+            static void      arm(void)                                     noexcept;
+            static uint64_t  disarm(void)                                  noexcept;
+            static size_t    lastSize(void)                                noexcept;
+    };
+
+} // End namespace
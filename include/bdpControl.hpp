@@ -0,0 +1,58 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    // Periodically samples TCP_INFO and grows SO_SNDBUF to a multiple of the estimated 
+    // bandwidth-delay product (delivery rate x min RTT) when that's over the buffer the 
+    // kernel has: enough to fill long links. It never shrinks it, and leaves it to kernel
+    // autotuning as long as that keeps up, since setting SO_SNDBUF turns autotuning off.
+    // Growth is held while the RTT is inflated over the minimum, a queue already building;
+    // retransmits alone don't hold it, they are routine on lossy long links.
+    class BdpControl{
+        public:
+            BdpControl(int fd, uint64_t intervalUs, double factor)         noexcept;
+
+            size_t          sample(uint64_t now, const std::string& label) noexcept;
+            std::string     report(void)                             const anyexcept;
+
+        private:
+            static constexpr size_t   MIN_BUFFER    { 131072 },
+                                      MAX_BUFFER    { 64UL * 1024 * 1024 };
+            static constexpr uint32_t RTT_INFLATION { 2 };
+
+            int             sockFd;
+            uint64_t        interval,
+                            nextSample    { 0 };
+            double          gain;
+            bool            enabled;
+            size_t          current       { 0 },
+                            bdp           { 0 };
+            uint32_t        retrans       { 0 };
+            uint64_t        resizes       { 0 },
+                            holds         { 0 };
+    };
+
+} // End namespace
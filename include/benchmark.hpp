@@ -0,0 +1,42 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    // Built-in micro benchmarks, run from the command line (-b) on the target machine.
+    class Benchmark{
+        public:
+            static void  run(const std::string& name)                      anyexcept;
+            static void  printList(void)                                   noexcept;
+
+        private:
+            static void  handshakes(void)                                  anyexcept;
+            static void  ciphers(void)                                     anyexcept;
+            static void  syscalls(void)                                    anyexcept;
+            static void  eventLoops(void)                                  anyexcept;
+            static void  zerocopy(void)                                    anyexcept;
+            static void  forwarding(void)                                  anyexcept;
+            static void  routeLookups(void)                                anyexcept;
+    };
+
+} // End namespace
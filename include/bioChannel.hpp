@@ -0,0 +1,153 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <sys/uio.h>
+#include <openssl/ssl.h>
+#include <openssl/bio.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <array>
+#include <vector>
+#include <memory>
+
+#include <anyexcept.hpp>
+#include <timeUtils.hpp>
+#include <ioStatus.hpp>
+
+namespace inetlib {
+
+    enum TLS_TRANSPORT : uint8_t { TRANSPORT_SOCKET, TRANSPORT_MEMBIO };
+
+    // Runs an SSL session over a custom BIO instead of the socket: ciphertext produced
+    // by many SSL_write calls queues in a chain of segments and leaves with one writev,
+    // inbound data is read in large chunks and served to OpenSSL from memory.
+    // The socket I/O is then scheduled by the caller, independently from the crypto.
+    // What a non-blocking socket doesn't take stays in the chain; a chain full up to its
+    // limit makes SSL_write return WANT_WRITE until the socket is writable again.
+    // Flushes of at least zerocopyMin bytes use MSG_ZEROCOPY: the segments sent stay
+    // pinned until the kernel reports their completion on the socket error queue, also
+    // after the channel is gone: reapClosed() frees them then.
+    class BioChannel{
+        public:
+            BioChannel(SSL* ssl, int fd, size_t readChunk,
+                       size_t zerocopyMin = 0)                             anyexcept;
+            ~BioChannel(void)                                              noexcept;
+            BioChannel(const BioChannel&)                                  = delete;
+            BioChannel& operator=(const BioChannel&)                       = delete;
+
+            IO_STATUS             fill(void)                               noexcept;
+            void                  flush(void)                              anyexcept;
+            bool                  flushQuiet(void)                         noexcept;
+            void                  setQueueLimit(size_t bytes)              noexcept;
+            bool                  pendingOutput(void)                const noexcept;
+            bool                  pendingInput(void)                 const noexcept;
+            uint64_t              getSocketReads(void)               const noexcept;
+            uint64_t              getSocketWrites(void)              const noexcept;
+            uint64_t              getZerocopySends(void)             const noexcept;
+            uint64_t              getZerocopyCopied(void)            const noexcept;
+            std::string           report(void)                       const anyexcept;
+
+            static TLS_TRANSPORT  transportFromName(const std::string& name) anyexcept;
+            static uint64_t       reapClosed(uint64_t now)                 noexcept;
+
+        private:
+            static constexpr size_t SEGMENT_LEN  { 65536 },
+                                    MAX_SEGMENTS { 16 },
+                                    MAX_PINNED   { 64 };
+            static constexpr uint64_t ZC_PROBE        { 64 },
+                                      GRAVE_WAIT_US   { 10 * timeutils::USEC_PER_SEC },
+                                      GRAVE_GRACE_US  { timeutils::USEC_PER_SEC },
+                                      GRAVE_POLL_US   { 100 * timeutils::USEC_PER_MSEC };
+
+            struct Segment{
+                std::vector<uint8_t>  data;
+                size_t                len  { 0 };
+                bool                  zc   { false };
+                uint32_t              zcId { 0 };
+            };
+
+            struct Pinned{
+                uint32_t              id;
+                std::vector<uint8_t>  data;
+            };
+
+            // Buffers of a closed channel still referenced by zerocopy sends, with a duplicate
+            // of its socket to read the completions from.
+            struct Grave{
+                int                                fd        { -1 };
+                uint32_t                           lastId    { 0 },
+                                                   done      { 0 };
+                uint64_t                           deadline  { 0 };
+                std::vector<std::vector<uint8_t>>  buffers;
+                std::unique_ptr<Grave>             next;
+            };
+
+            BIO                                *bio;
+            int                                sockFd;
+            std::array<Segment, MAX_SEGMENTS>  chain;
+            size_t                             used        { 0 },
+                                               headOff     { 0 },
+                                               segLimit    { MAX_SEGMENTS };
+            std::array<iovec, MAX_SEGMENTS>    iov         {};
+            std::vector<uint8_t>               inbound;
+            size_t                             inHead      { 0 },
+                                               inTail      { 0 };
+            size_t                             zcMin;
+            uint32_t                           zcNext      { 0 },
+                                               zcDone      { 0 };
+            std::array<Pinned, MAX_PINNED>     pinned;
+            size_t                             pinHead     { 0 },
+                                               pinCount    { 0 };
+            std::vector<std::vector<uint8_t>>  spare;
+            std::unique_ptr<Grave>             grave;
+            uint64_t                           sockReads   { 0 },
+                                               sockWrites  { 0 },
+                                               flushedSegs { 0 },
+                                               zcSends     { 0 },
+                                               zcCompleted { 0 },
+                                               zcCopied    { 0 },
+                                               zcFallbacks { 0 };
+
+            bool                  queue(const char* data, size_t len,
+                                        size_t& copied)                    noexcept;
+            bool                  drain(void)                              noexcept;
+            void                  reap(void)                               noexcept;
+            void                  bury(void)                               noexcept;
+            void                  retire(size_t count)                     noexcept;
+            size_t                queuedBytes(void)                  const noexcept;
+
+            static inline std::unique_ptr<Grave> graveyard;
+
+            static void           readCompletions(int fd, uint32_t& done,
+                                                  uint64_t& completed, 
+                                                  uint64_t& copied)        noexcept;
+            static void           abort(int fd)                            noexcept;
+            static BIO_METHOD*    method(void)                             anyexcept;
+            static int            bioWrite(BIO* b, const char* data, 
+                                           size_t len, size_t* written);
+            static int            bioRead(BIO* b, char* data, 
+                                          size_t len, size_t* readBytes);
+            static long           bioCtrl(BIO* b, int cmd, long num, void* ptr);
+            static int            bioCreate(BIO* b);
+            static int            bioDestroy(BIO* b);
+    };
+
+} // End namespace
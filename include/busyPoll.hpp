@@ -0,0 +1,54 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    // Hybrid wait: after traffic the event loop is polled without sleeping for a spin 
+    // window, so the next packet skips the wakeup and scheduling latency; then it blocks 
+    // again. A window that catches nothing halves the next one (down to 1/8 of the 
+    // budget), a productive one restores the whole budget.
+    class BusyPoll{
+        public:
+            explicit BusyPoll(uint64_t budgetUs)                           noexcept;
+
+            uint64_t        timeout(uint64_t now, uint64_t blockUs)        noexcept;
+            void            onWake(size_t ready)                           noexcept;
+            std::string     report(void)                             const anyexcept;
+
+        private:
+            static constexpr uint64_t MIN_SHIFT { 3 };
+
+            uint64_t        budget,
+                            window,
+                            spinUntil     { 0 },
+                            windowHits    { 0 },
+                            polls         { 0 },
+                            hits          { 0 },
+                            blocks        { 0 },
+                            shrinks       { 0 };
+            bool            spinning      { false };
+    };
+
+} // End namespace
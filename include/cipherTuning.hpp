@@ -0,0 +1,54 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    struct AeadResult{
+        const char*  suite;
+        const char*  cipher;
+        double       mbPerSec;
+    };
+
+    // Orders the TLS 1.3 AEAD suites by the crypto throughput measured on this CPU:
+    // AES-GCM wins with AES instructions, ChaCha20-Poly1305 without them.
+    class CipherTuning{
+        public:
+            static constexpr const char* AUTO { "auto" };
+
+            static std::vector<AeadResult>
+                               measure(size_t packetLen, uint64_t budgetUs)       anyexcept;
+            static std::string suitesFrom(const std::vector<AeadResult>& res)     anyexcept;
+            static std::string resolve(const std::string& suites, 
+                                       const std::string& cacheFile)              anyexcept;
+
+        private:
+            static std::string cacheKey(void)                                     anyexcept;
+            static bool        readCache(const std::string& cacheFile, 
+                                         std::string& suites)                     anyexcept;
+            static void        writeCache(const std::string& cacheFile, 
+                                          const std::string& suites)              anyexcept;
+    };
+
+} // End namespace
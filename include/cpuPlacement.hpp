@@ -0,0 +1,46 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    // Placement of the data plane thread: pinned to a core, its memory preferred on that 
+    // core's NUMA node, optionally SCHED_FIFO with locked and prefaulted memory so that
+    // neither migrations nor page faults show up in the tail latency.
+    class CpuPlacement{
+        public:
+            static void     pinThread(int cpu)                             anyexcept;
+            static int      nodeOfCpu(int cpu)                             noexcept;
+            static void     preferNode(int node)                           anyexcept;
+            static void     realtime(int priority)                         anyexcept;
+            static void     lockMemory(void)                               anyexcept;
+            static std::string
+                            describe(void)                                 anyexcept;
+
+        private:
+            static constexpr size_t STACK_PREFAULT { 512UL * 1024 };
+
+            static void     prefaultStack(void)                            noexcept;
+    };
+
+} // End namespace
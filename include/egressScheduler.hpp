@@ -0,0 +1,130 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <anyexcept.hpp>
+#include <packetArena.hpp>
+#include <routeTable.hpp>
+#include <shaper.hpp>
+
+namespace inetlib {
+
+    constexpr uint32_t EGRESS_NO_QUEUE     { UINT32_MAX },
+                       EGRESS_MAX_WEIGHT   { 64 };
+    constexpr size_t   EGRESS_POOL_QUEUES  { 8 };
+
+    // Clients whose source address matches the prefix get 'weight' shares of the egress.
+    struct ClientWeight{
+        Prefix     source;
+        uint32_t   weight;
+    };
+
+    // Valid until the next dequeue: the frame has FRAME_HEADER_LEN bytes of headroom.
+    struct EgressPacket{
+        int        owner;
+        uint8_t    *frame;
+        size_t     len;
+    };
+
+    // Server egress: packets read from the TUN device wait in per-session queues and leave 
+    // in deficit round-robin order, every backlogged session getting quantum * weight bytes 
+    // per round, so a heavy download can't take the encryption path from the other sessions. 
+    // Slots come from one shared pool: a session over its depth drops its own packets, a full 
+    // pool drops the head of the longest queue. Nothing is allocated per packet. A session 
+    // over its egress rate keeps its place and deficit, and is skipped until it conforms.
+    class EgressScheduler{
+        public:
+            EgressScheduler(size_t queueDepth, size_t poolSlots, 
+                            size_t payloadSize)                            anyexcept;
+
+            bool          enabled(void)                              const noexcept;
+            bool          backlog(void)                              const noexcept;
+            uint64_t      blockedUs(void)                            const noexcept;
+            void          setShaper(Shaper* limits)                        noexcept;
+            uint32_t      open(int owner, uint32_t weight, 
+                               uint32_t shape=SHAPE_NONE)                  anyexcept;
+            void          close(uint32_t queue)                            noexcept;
+            void          enqueue(uint32_t queue, const uint8_t* pkt, 
+                                  size_t len)                              noexcept;
+            bool          dequeue(EgressPacket& packet, uint64_t now)      noexcept;
+            std::string   report(void)                               const anyexcept;
+            std::string   report(uint32_t queue)                     const anyexcept;
+
+            static std::vector<ClientWeight>  
+                          parseWeights(const std::string& text)            anyexcept;
+            static uint32_t
+                          weightFor(const std::vector<ClientWeight>& weights, 
+                                    uint32_t source)                       noexcept;
+
+        private:
+            static constexpr uint32_t NO_SLOT { UINT32_MAX };
+
+            struct Queue{
+                int        owner       { -1 };
+                uint32_t   weight      { 1 },
+                           head        { NO_SLOT },
+                           tail        { NO_SLOT },
+                           nextActive  { EGRESS_NO_QUEUE },
+                           depth       { 0 },
+                           peak        { 0 },
+                           shape       { SHAPE_NONE };
+                size_t     deficit     { 0 };
+                bool       active      { false },
+                           credited    { false };
+                uint64_t   sent        { 0 },
+                           bytes       { 0 },
+                           drops       { 0 },
+                           pushedOut   { 0 };
+            };
+
+            size_t                  depthLimit,
+                                    quantum,
+                                    stride;
+            PacketBuffer            slots;
+            Shaper                  *shaper      { nullptr };
+            std::vector<uint32_t>   slotNext,
+                                    slotLen,
+                                    freeSlots,
+                                    freeQueues;
+            std::vector<Queue>      queues;
+            uint32_t                activeHead   { EGRESS_NO_QUEUE },
+                                    activeTail   { EGRESS_NO_QUEUE },
+                                    longest      { EGRESS_NO_QUEUE },
+                                    handed       { NO_SLOT };
+            size_t                  openQueues   { 0 },
+                                    activeQueues { 0 };
+            uint64_t                blocked      { 0 };
+            uint64_t                enqueued     { 0 },
+                                    sent         { 0 },
+                                    drops        { 0 },
+                                    pushedOut    { 0 },
+                                    rounds       { 0 };
+
+            uint32_t      popHead(Queue& queue)                            noexcept;
+            void          activate(uint32_t queue)                         noexcept;
+            void          rotate(void)                                     noexcept;
+            void          deactivate(uint32_t queue)                       noexcept;
+            bool          pushOut(uint32_t from)                           noexcept;
+    };
+
+} // End namespace
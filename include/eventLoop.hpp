@@ -0,0 +1,204 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <sys/select.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <anyexcept.hpp>
+#include <packetArena.hpp>
+
+namespace inetlib {
+
+    enum EVENT_FLAGS   : uint32_t { EV_READ=0x01, EV_WRITE=0x02, EV_ERROR=0x04 };
+    enum EVENT_BACKEND : uint8_t  { BACKEND_EPOLL, BACKEND_SELECT, BACKEND_URING };
+
+    struct IoEvent{
+        int        fd;
+        uint32_t   events;
+    };
+
+    // A packet read by the loop itself: len bytes at frame plus the headroom given to addReader().
+    struct ReadBuffer{
+        uint8_t    *frame;
+        size_t     len;
+    };
+
+    class EventLoop{
+        public:
+            virtual         ~EventLoop(void)                                   noexcept;
+
+            virtual void    add(int fd, uint32_t events)                       anyexcept = 0;
+            virtual void    modify(int fd, uint32_t events)                    anyexcept = 0;
+            virtual void    remove(int fd)                                     noexcept  = 0;
+            virtual size_t  wait(IoEvent* events, size_t maxEvents,
+                                 uint64_t timeoutUs)                           anyexcept = 0;
+            virtual const char*
+                            name(void)                                   const noexcept  = 0;
+
+            // Backends that read a descriptor themselves keep count buffers of headroom + len bytes
+            // and report it as readable while takeReads() has packets. The default is readiness only:
+            // addReader() returns false and the caller adds the descriptor and reads it as usual.
+            virtual bool    addReader(int fd, size_t headroom, size_t len,
+                                      size_t count)                            anyexcept;
+            virtual size_t  takeReads(int fd, ReadBuffer* reads, size_t maxReads)  anyexcept;
+            virtual void    releaseReads(int fd)                               noexcept;
+
+            static std::unique_ptr<EventLoop> 
+                            create(EVENT_BACKEND backend)                      anyexcept;
+            static EVENT_BACKEND 
+                            backendFromName(const std::string& name)           anyexcept;
+    };
+
+    class EpollLoop final : public EventLoop{
+        public:
+                            EpollLoop(void)                                    anyexcept;
+                            ~EpollLoop(void)                                   noexcept override;
+
+            void            add(int fd, uint32_t events)                       anyexcept override;
+            void            modify(int fd, uint32_t events)                    anyexcept override;
+            void            remove(int fd)                                     noexcept  override;
+            size_t          wait(IoEvent* events, size_t maxEvents,
+                                 uint64_t timeoutUs)                           anyexcept override;
+            const char*     name(void)                                   const noexcept  override;
+
+        private:
+            // Below this timeout a timerfd gives epoll microsecond resolution, for the flush deadlines.
+            static constexpr uint64_t PRECISE_BELOW_US { 2000 };
+
+            int             epollFd      { -1 },
+                            timerFd      { -1 };
+    };
+
+    class SelectLoop final : public EventLoop{
+        public:
+            void            add(int fd, uint32_t events)                       anyexcept override;
+            void            modify(int fd, uint32_t events)                    anyexcept override;
+            void            remove(int fd)                                     noexcept  override;
+            size_t          wait(IoEvent* events, size_t maxEvents,
+                                 uint64_t timeoutUs)                           anyexcept override;
+            const char*     name(void)                                   const noexcept  override;
+
+        private:
+            std::vector<IoEvent>  watched;
+    };
+
+    // io_uring backend: registrations, re-arms and removals queue as SQEs and go to the
+    // kernel together with the wait, in a single io_uring_enter per loop pass.
+    // Polls are one-shot and re-armed after each completion: the loops expect level 
+    // triggered readiness, a multishot poll only reports new wakeups.
+    // Readers (Linux 6.7 or later) have one multishot read in flight that fills buffers
+    // from a registered provided buffer ring: the packets are already in memory when the
+    // wait returns, and a buffer goes back to the ring when releaseReads() is called.
+    class UringLoop final : public EventLoop{
+        public:
+                            UringLoop(void)                                    anyexcept;
+                            ~UringLoop(void)                                   noexcept override;
+
+            void            add(int fd, uint32_t events)                       anyexcept override;
+            void            modify(int fd, uint32_t events)                    anyexcept override;
+            void            remove(int fd)                                     noexcept  override;
+            size_t          wait(IoEvent* events, size_t maxEvents,
+                                 uint64_t timeoutUs)                           anyexcept override;
+            const char*     name(void)                                   const noexcept  override;
+            bool            addReader(int fd, size_t headroom, size_t len,
+                                      size_t count)                            anyexcept override;
+            size_t          takeReads(int fd, ReadBuffer* reads, size_t maxReads)  anyexcept override;
+            void            releaseReads(int fd)                               noexcept  override;
+
+            static bool     available(void)                                    noexcept;
+
+        private:
+            static constexpr uint32_t SQ_ENTRIES      { 256 },
+                                      CQ_ENTRIES      { 8192 },
+                                      READER_RING_MAX { 32768 };
+
+            struct Registration{
+                uint32_t   events;
+                uint32_t   generation;
+                bool       armed;
+            };
+
+            struct Ring{
+                void       *ptr      { nullptr };
+                size_t     len       { 0 };
+            };
+
+            struct Filled{
+                uint16_t   bid;
+                uint32_t   len;
+            };
+
+            struct Reader{
+                int                           fd        { -1 },
+                                              error     { 0 };
+                uint16_t                      group     { 0 },
+                                              tail      { 0 };
+                bool                          armed     { false },
+                                              closed    { false };
+                size_t                        headroom  { 0 },
+                                              len       { 0 },
+                                              stride    { 0 },
+                                              next      { 0 };
+                uint32_t                      entries   { 0 },
+                                              inRing    { 0 };
+                Ring                          ring;
+                std::unique_ptr<PacketBuffer> buffers;
+                std::vector<Filled>           filled;
+                std::vector<uint16_t>         handed;
+            };
+
+            int             ringFd       { -1 };
+            Ring            ringMap,
+                            sqeMap;
+            uint32_t        *sqHead      { nullptr },
+                            *sqTail      { nullptr },
+                            *sqMask      { nullptr },
+                            *sqArray     { nullptr },
+                            *cqHead      { nullptr },
+                            *cqTail      { nullptr },
+                            *cqMask      { nullptr };
+            void            *sqes        { nullptr },
+                            *cqes        { nullptr };
+            uint32_t        localTail    { 0 },
+                            toSubmit     { 0 },
+                            nextGen      { 1 };
+            bool            multishotReads { false };
+            std::unordered_map<int, Registration>  registered;
+            std::vector<int>                       rearm;
+            std::vector<Reader>                    readers;
+
+            void            release(void)                                      noexcept;
+            bool            queuePoll(int fd, const Registration& reg)         noexcept;
+            bool            queueRemove(int fd, const Registration& reg)       noexcept;
+            bool            queueRead(const Reader& reader)                    noexcept;
+            bool            queueCancel(const Reader& reader)                  noexcept;
+            Reader*         findReader(int fd)                                 noexcept;
+            void            recycle(Reader& reader, uint16_t bid)              noexcept;
+            void            completeRead(int fd, int32_t res, uint32_t flags)  noexcept;
+            void           *nextSqe(void)                                      noexcept;
+            int             enter(uint32_t minComplete, uint64_t timeoutUs)    noexcept;
+    };
+
+} // End namespace
@@ -0,0 +1,64 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    enum FLUSH_REASON : uint8_t { FLUSH_BYTES, FLUSH_PACKETS, FLUSH_DEADLINE, FLUSH_PASS, FLUSH_CONTROL, FLUSH_REASONS };
+
+    // Decides when the frames coalesced in a TLS record leave. Light traffic is flushed
+    // at the end of each loop pass; when the measured arrival rate would fill at least
+    // two packets within the deadline, records are held until the byte threshold (sized
+    // on the rate), the packet cap or the deadline is reached, whichever comes first.
+    class FlushPolicy{
+        public:
+            FlushPolicy(uint64_t maxHoldUs, size_t maxPackets,
+                        size_t maxBytes)                                   noexcept;
+
+            FLUSH_REASON trigger(size_t bytes, size_t packets)       const noexcept;
+            uint64_t     deadline(uint64_t firstQueued)              const noexcept;
+            void         onFlush(uint64_t now, size_t bytes, 
+                                 size_t packets, FLUSH_REASON reason)      noexcept;
+            std::string  report(void)                                const anyexcept;
+
+        private:
+            static constexpr size_t   HOLD_MIN_PACKETS { 2 };
+            static constexpr uint64_t IDLE_HOLDS       { 8 };
+            static constexpr double   RATE_GAIN        { 0.125 };
+
+            uint64_t     maxHold,
+                         hold             { 0 },
+                         lastFlush        { 0 };
+            size_t       packetCap,
+                         byteCap,
+                         threshold;
+            double       rateBytesPerUs   { 0.0 },
+                         avgPacket        { 0.0 };
+            uint64_t     arrived          { 0 },
+                         records          { 0 },
+                         frames           { 0 },
+                         reasons[FLUSH_REASONS] {};
+    };
+
+} // End namespace
@@ -0,0 +1,67 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include <anyexcept.hpp>
+#include <packetArena.hpp>
+
+namespace inetlib {
+
+    // Every TLS record carries one or more frames: | type | flags | length (BE16) | payload |
+    enum FRAME_TYPE   : uint8_t { FRAME_DATA=0x00, FRAME_PING=0x01, FRAME_PONG=0x02, 
+                                  FRAME_ROUTE=0x03, FRAME_ADDRESS=0x04, FRAME_LEASE=0x05 };
+    enum FRAME_STATUS : uint8_t { FRAME_READY, FRAME_INCOMPLETE, FRAME_INVALID };
+
+    constexpr uint8_t FRAME_MAX_TYPE      { FRAME_LEASE };
+    constexpr size_t  FRAME_HEADER_LEN    { 4 };
+    constexpr size_t  FRAME_MAX_PAYLOAD   { 65535 };
+    constexpr size_t  TLS_MAX_RECORD      { 16384 };
+
+    struct Frame{
+        FRAME_TYPE     type;
+        uint8_t        flags;
+        const uint8_t  *payload;
+        size_t         len;
+    };
+
+    void   putFrameHeader(uint8_t* dst, FRAME_TYPE type, 
+                          size_t len, uint8_t flags=0)                     noexcept;
+
+    class FrameReader{
+        public:
+            explicit       FrameReader(size_t maxPayload)                  anyexcept;
+
+            uint8_t*       writePtr(void)                                  noexcept;
+            size_t         writeSpace(void)                         const  noexcept;
+            void           commit(size_t len)                              noexcept;
+            FRAME_STATUS   next(Frame& frame)                              noexcept;
+
+        private:
+            size_t                maxPayload;
+            PacketBuffer          buffer;
+            size_t                head         { 0 },
+                                  tail         { 0 };
+
+            void           compact(void)                                   noexcept;
+    };
+
+} // End namespace
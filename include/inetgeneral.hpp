@@ -33,6 +33,10 @@
 #include <linux/if_tun.h>
 
 #include <vector> 
+#include <array> 
+#include <map> 
+#include <memory> 
+#include <unordered_map> 
 #include <string>
 #include <cstddef>
 #include <cerrno>
@@ -40,6 +44,26 @@
 #include <anyexcept.hpp>
 #include <ConceptsLib.hpp>
 #include <debug.hpp>
+#include <frames.hpp>
+#include <keepalive.hpp>
+#include <stats.hpp>
+#include <eventLoop.hpp>
+#include <admission.hpp>
+#include <bioChannel.hpp>
+#include <tunBatch.hpp>
+#include <flushPolicy.hpp>
+#include <recordSizer.hpp>
+#include <socketTuning.hpp>
+#include <bdpControl.hpp>
+#include <busyPoll.hpp>
+#include <ioStatus.hpp>
+#include <cpuPlacement.hpp>
+#include <packetArena.hpp>
+#include <sslAllocator.hpp>
+#include <routeTable.hpp>
+#include <addressPool.hpp>
+#include <egressScheduler.hpp>
+#include <shaper.hpp>
 
 namespace inetlib {
 
@@ -52,6 +76,8 @@ namespace inetlib {
     using Ifreq=struct  ifreq;
 
     enum ERR_CODES { ACCEPT_ERROR=255, INVALID_ALLOCATION=999 };
+    enum HANDSHAKE_STATUS : uint8_t { HANDSHAKE_DONE, HANDSHAKE_WANT_READ, 
+                                      HANDSHAKE_WANT_WRITE, HANDSHAKE_FAILED };
 
     class InetException final : public std::exception {
       public:
@@ -91,6 +117,8 @@ namespace inetlib {
          int      readLineTimeoutNoErr(Handler* hdlr=nullptr,
                                        bool noEagain=false)                 anyexcept;
          void     setBlocking(bool onOff=true)                              anyexcept;
+         static
+         void     setFdBlocking(int fd, bool blocking)                      anyexcept;
    
          void     writeBuffer(const uint8_t* msg, size_t size, 
                               Handler* hdlr=nullptr)                  const anyexcept;
@@ -137,6 +165,7 @@ namespace inetlib {
          void     setWriteFunc(writeFunc wFx )                              noexcept;
          void     setSeparator(char sp='\n')                                noexcept;
          void     setSizeMax(size_t sz=0)                                   noexcept;
+         void     setTuning(const SocketTuning& tun)                        anyexcept;
 
       protected:
          static   inline int socketFd       { -1 };
@@ -153,6 +182,7 @@ namespace inetlib {
          writeFunc             wFunc;
          char                  separator    {'\n'};
          size_t                sizeMax      { 0 } ;
+         SocketTuning          tuning;
 
       private:
          Timeval               tvMin        { 3,0 },
@@ -189,6 +219,7 @@ namespace inetlib {
             void           disconnect(void)                                    anyexcept;
             void           setTimeoutReadVal(long int sec, long int msec=0)    anyexcept;
             void           setTimeoutWriteVal(long int sec, long int msec=0)   anyexcept;
+            std::string    getPeerName(void)                             const anyexcept;
 
         protected:
             int                      acceptFd      { -1 };
@@ -206,13 +237,24 @@ namespace inetlib {
             InetSSL(std::string cert, std::string key);
             ~InetSSL(void)                                                   noexcept;
 
+            void           setGroups(const std::string& groups)              anyexcept;
+            void           setCipherSuites(const std::string& suites)        anyexcept;
+            void           setReadAhead(size_t bytes)                        anyexcept;
+            static std::string 
+                           lastError(void)                                   anyexcept;
+
         protected:
 
             static ssize_t writeSSL(Handler* sslFd, void* buffer, size_t bufferLen);
             static ssize_t readSSL(Handler* sslFd, void* buffer, size_t bufferLen);
 
+            void           configureContext(void)                            anyexcept;
+
             std::string    SSLcertificate,
-                           SSLkey;
+                           SSLkey,
+                           groupList      { "X25519:P-256:P-384" },
+                           cipherSuites;
+            size_t         readAhead      { 0 };
             static inline  SSL_CTX* sslctx { nullptr };
     };
 
@@ -239,10 +281,25 @@ namespace inetlib {
 
     class InetServerSSL : public InetServer, public InetSSL {
         public:
+            // acceptNb result for transient resource errors, errno is left set.
+            static constexpr int ACCEPT_EXHAUSTED { -2 };
+
             InetServerSSL(std::string cert, std::string key)               anyexcept;
             virtual      ~InetServerSSL(void)                              noexcept;
             virtual void accept(void)                                      anyexcept  override;
             void         disconnect(void)                                  anyexcept;
+
+            int          acceptNb(SockaddrIn& peer)                        anyexcept;
+            void         prepareSocket(int fd)                       const anyexcept;
+            static void  reject(int fd)                                    noexcept;
+            static std::string
+                         addressToString(const SockaddrIn& peer)           anyexcept;
+            SSL*         newSession(int fd)                          const anyexcept;
+            static HANDSHAKE_STATUS
+                         doHandshake(SSL* ssl)                             noexcept;
+            void         requestPeerCert(void)                             anyexcept;
+            static uint64_t
+                         bindIdentity(SSL* ssl, uint64_t identity)         anyexcept;
  
             int writeSSLBuffer(const char* buffer, int bufferLen)          noexcept;
             int writeSSLBuffer(std::string buffer)                         noexcept;
@@ -261,6 +318,161 @@ namespace inetlib {
             void cleanResurces(void)                                       noexcept;
     };
 
+    struct TunnelOptions{
+        long                    keepAliveMs      { 10000 },
+                                deadPeerMs       { 30000 },
+                                statsIntervalMs  { 0 },
+                                handshakeTimeoutMs { 10000 },
+                                maxHandshakes    { 64 },
+                                readAheadBytes   { 65536 },
+                                idleReleaseMs    { 30000 },
+                                tunBatch         { 32 },
+                                tunBudget        { 262144 },
+                                flushDeadlineUs  { 100 },
+                                flushPackets     { 32 },
+                                recordIdleMs     { 1000 },
+                                bdpIntervalMs    { 0 },
+                                zerocopyMin      { 0 },
+                                busySpinUs       { 0 },
+                                dataCpu          { -1 },
+                                rtPriority       { 0 },
+                                packetArenaKb    { 8192 },
+                                leaseMs          { 600000 },
+                                egressQueue      { 128 };
+        double                  admissionRate    { 5.0 },
+                                admissionBurst   { 10.0 },
+                                bdpFactor        { 1.5 };
+        bool                    numaLocal        { false },
+                                lockMemory       { false },
+                                sslPool          { true },
+                                hairpin          { false },
+                                acceptRoutes     { false },
+                                autoAddress      { false };
+        std::string             tlsGroups        { "X25519:P-256:P-384" },
+                                cipherSuites     { "auto" },
+                                cipherCache;
+        EVENT_BACKEND           eventBackend     { BACKEND_EPOLL };
+        TLS_TRANSPORT           transport        { TRANSPORT_SOCKET };
+        HUGEPAGE_MODE           hugePages        { HUGEPAGE_OFF };
+        SocketTuning            tuning;
+        std::vector<StaticRoute>
+                                staticRoutes;
+        std::vector<Prefix>     announceRoutes;
+        Prefix                  addressPool      { 0, 0 };
+        std::vector<ClientWeight>
+                                weights;
+        ShapingConfig           shaping;
+    };
+
+    // Packets from a session to another session of the same server, forwarded without 
+    // going through the TUN device.
+    class Hairpin{
+        public:
+            virtual ~Hairpin(void)                                         = default;
+            // False: not for another session, the packet goes to the TUN device.
+            virtual bool           forward(uint8_t* frame, size_t len, 
+                                           int fromFd)                     noexcept = 0;
+    };
+
+    class VpnSession{
+        public:
+            VpnSession(SSL* ssl, int fd, size_t payloadSize, 
+                       const TunnelOptions& opts, std::string name)        anyexcept;
+
+            void                   start(uint64_t now)                     noexcept;
+            IO_STATUS              sendPacket(uint8_t* frame, size_t len)  noexcept;
+            IO_STATUS              receive(int tunFd, 
+                                           size_t budget=SIZE_MAX)         noexcept;
+            bool                   pendingInput(void)                const noexcept;
+            IO_STATUS              flush(uint64_t now)                     noexcept;
+            bool                   wantWrite(void)                   const noexcept;
+            IO_STATUS              onWritable(int tunFd)                   noexcept;
+            void                   shutdown(void)                          noexcept;
+            IO_STATUS              timers(uint64_t now)                    noexcept;
+            void                   holdAlive(uint64_t now)                 noexcept;
+            void                   setIdleRelease(uint64_t idleUs)         noexcept;
+            void                   setHairpin(Hairpin* hp)                 noexcept;
+            uint64_t               nextTimeoutUs(uint64_t now)       const noexcept;
+            uint32_t               getInnerAddr(void)                const noexcept;
+            const TunnelStats&     getStats(void)                    const noexcept;
+            IO_STATUS              announce(const std::vector<Prefix>& 
+                                            prefixes)                      noexcept;
+            bool                   hasAnnounced(void)                const noexcept;
+            std::vector<Prefix>    takeAnnounced(void)                     noexcept;
+            IO_STATUS              assign(uint32_t addr, uint8_t len)      noexcept;
+            bool                   takeAssigned(uint32_t& addr, 
+                                                uint8_t& len)              noexcept;
+            IO_STATUS              requestAddress(uint64_t identity)       noexcept;
+            bool                   takeRequest(uint64_t& identity)         noexcept;
+            std::string            errorText(IO_STATUS status)       const anyexcept;
+            std::string            report(void)                      const anyexcept;
+
+        private:
+            static constexpr size_t BACKLOG_MAX  { 16 * TLS_MAX_RECORD };
+
+            SSL                     *cSSL;
+            int                     sockFd;
+            uint32_t                innerAddr    { 0 };
+            std::string             label,
+                                    sockProfile;
+            size_t                  payloadLimit;
+            FrameReader             reader;
+            std::unique_ptr<BioChannel>
+                                    channel;
+            Keepalive               keepalive;
+            TunnelStats             stats;
+            uint64_t                statsInterval,
+                                    nextStats    { 0 },
+                                    idleRelease  { 0 },
+                                    lastActive   { 0 },
+                                    lastPackets  { 0 };
+            bool                    released     { false };
+            std::array<uint8_t, PING_FRAME_LEN>   
+                                    ctrlBuff     {};
+            FlushPolicy             policy;
+            RecordSizer             sizer;
+            BdpControl              bdp;
+            PacketBuffer            pending;
+            size_t                  pendingLen   { 0 },
+                                    pendingPkts  { 0 };
+            uint64_t                pendingSince { 0 };
+            std::vector<uint8_t>    backlog;
+            size_t                  backHead     { 0 },
+                                    backRetry    { 0 };
+            uint64_t                backProgress { 0 },
+                                    stallLimit;
+            bool                    readBlocked  { false };
+            int                     sysError     { 0 },
+                                    sslError     { 0 };
+            std::vector<Prefix>     announced;
+            Hairpin                 *hairpin     { nullptr };
+            uint32_t                assignedAddr { 0 };
+            uint8_t                 assignedLen  { 0 };
+            uint64_t                requestedBy  { 0 };
+            bool                    requested    { false };
+            debugmode::DEBUG_MODE   debugMode    { debugmode::ERR_DEBUG };
+
+            IO_STATUS              fail(IO_STATUS status, int sslErr=0)    noexcept;
+            IO_STATUS              writeSsl(const uint8_t* buf, 
+                                            size_t len)                    noexcept;
+            IO_STATUS              writeRecord(const uint8_t* buf, 
+                                               size_t len)                 noexcept;
+            IO_STATUS              queueRecord(const uint8_t* buf, 
+                                               size_t len)                 noexcept;
+            IO_STATUS              writeBacklog(void)                      noexcept;
+            void                   onWritten(size_t len)                   noexcept;
+            IO_STATUS              writePending(uint64_t now, 
+                                                FLUSH_REASON reason)       noexcept;
+            IO_STATUS              writeTun(int tunFd, const uint8_t* buf,
+                                            size_t len)                    noexcept;
+            IO_STATUS              readRecord(void)                        noexcept;
+            IO_STATUS              dispatchFrames(int tunFd, uint64_t now) noexcept;
+            IO_STATUS              readAnnounce(const Frame& frame)        noexcept;
+            IO_STATUS              readAssign(const Frame& frame)          noexcept;
+            IO_STATUS              readRequest(const Frame& frame)         noexcept;
+            void                   checkIdle(uint64_t now)                 noexcept;
+    };
+
     class Tun{
         private:
             static const inline std::string cloneDev   {"/dev/net/tun"};
@@ -275,20 +487,30 @@ namespace inetlib {
                                         std::string tunMaskString)         anyexcept;
             const std::string&     getDeviceName(void)     const           noexcept;
             int                    getTunFd(void)          const           noexcept;
+
+        protected:
+            void                   openDevice(void)                        anyexcept;
+            void                   setAddress(std::string tunIpString, 
+                                              std::string tunMaskString)   anyexcept;
     };
     
     class NnVpnClient : public Tun{
         private:
             InetClientSSL           sslClient;
             size_t                  bufferSize;
-            int                     nfdsTun      { -1 };    
-            std::vector<char>       buff;
+            TunnelOptions           options;
+            TunBatch                batch;
+            BusyPoll                busy;
             debugmode::DEBUG_MODE   debugMode  { debugmode::ERR_DEBUG };
+
+            void                   applyAddress(VpnSession& session)       anyexcept;
+            uint64_t               identity(void)                    const anyexcept;
     
         public:
             NnVpnClient(std::string pem,   std::string key, 
                        std::string paddr, std::string pport, 
-                       std::string dev,   size_t buffSize=1500)            anyexcept;
+                       std::string dev,   size_t buffSize=1500,
+                       const TunnelOptions& opts=TunnelOptions{})          anyexcept;
             ~NnVpnClient(void)                                             noexcept;
     
             void                   init(std::string tunIpString, 
@@ -296,20 +518,90 @@ namespace inetlib {
             void                   start(void)                             anyexcept;
     };
 
-    class NnVpnServer : public Tun{
+    enum PEER_STATE : uint8_t { PEER_HANDSHAKE, PEER_ESTABLISHED };
+
+    struct ServerPeer{
+        int                           fd         { -1 };
+        SSL                           *cSSL      { nullptr };
+        PEER_STATE                    state      { PEER_HANDSHAKE };
+        uint64_t                      deadline   { 0 };
+        uint32_t                      source     { 0 },
+                                      leased     { 0 },
+                                      queue      { EGRESS_NO_QUEUE },
+                                      shape      { SHAPE_NONE };
+        uint64_t                      resume     { 0 };
+        uint32_t                      watched    { EV_READ },
+                                      claimed    { 0 };
+        uint64_t                      identity   { 0 };
+        size_t                        learned    { 0 };
+        std::string                   name;
+        std::unique_ptr<VpnSession>   session;
+
+        ~ServerPeer(void)                                                  noexcept;
+    };
+
+    class NnVpnServer : public Tun, private Hairpin{
         private:
+            static constexpr uint64_t ACCEPT_BACKOFF_US { 100 * timeutils::USEC_PER_MSEC };
+
             InetServerSSL           sslServer;
             std::string             srvAddr      { "" },
                                     srvPort      { "" };
             size_t                  bufferSize;
-            int                     nfdsTun      { -1 };    
-            std::vector<char>       buff;
+            TunnelOptions           options;
+            TunBatch                batch;
+            BusyPoll                busy;
             debugmode::DEBUG_MODE   debugMode  { debugmode::ERR_DEBUG };
+
+            std::unique_ptr<EventLoop>                    loop;
+            std::map<int, std::unique_ptr<ServerPeer>>    peers;
+            RouteTable                                    routes;
+            std::vector<int>                              expired,
+                                                          resumed;
+            size_t                                        established  { 0 };
+            int                                           listenFd     { -1 };
+            uint64_t                                      acceptResume { 0 };
+            bool                                          tunReader    { false };
+            std::vector<ReadBuffer>                       tunReads;
+            ServerStats                                   srvStats;
+            AdmissionControl                              admission;
+            AddressPool                                   pool;
+            Shaper                                        shaper;
+            EgressScheduler                               egress;
+
+            void                   acceptPeers(uint64_t now)               anyexcept;
+            bool                   handshake(ServerPeer& peer, 
+                                             uint64_t now)                 anyexcept;
+            void                   closePeer(int fd, const char* reason)   noexcept;
+            void                   forwardFromTun(int tunFd)               anyexcept;
+            void                   forwardFromReader(int tunFd)            anyexcept;
+            void                   routePacket(uint8_t* frame, size_t len) anyexcept;
+            void                   deliver(ServerPeer& peer, uint8_t* frame, 
+                                           size_t len)                     noexcept;
+            void                   serveEgress(void)                       noexcept;
+            void                   servePeer(ServerPeer& peer, uint32_t events, 
+                                             int tunFd, uint64_t now)      anyexcept;
+            void                   throttleIngress(ServerPeer& peer, uint64_t bytes, 
+                                                   uint64_t now)           anyexcept;
+            bool                   forward(uint8_t* frame, size_t len, 
+                                           int fromFd)                     noexcept override;
+            void                   learnRoute(ServerPeer& peer)            anyexcept;
+            void                   acceptRoutes(const ServerPeer& peer)    anyexcept;
+            void                   assignAddress(ServerPeer& peer, uint64_t identity,
+                                                 uint64_t now)             anyexcept;
+            void                   watchPeer(ServerPeer& peer)             anyexcept;
+            uint64_t               serviceTimers(uint64_t now)             anyexcept;
+            void                   dumpStats(void)                   const anyexcept;
+
+            // The check programs drive the forwarding path with socketpairs in place of the 
+            // TUN device and the listener.
+            friend class NnVpnServerTest;
     
         public:
             NnVpnServer(std::string pem,   std::string key, 
                        std::string saddr, std::string sport, 
-                       std::string dev,   size_t buffSize=1500)            anyexcept;
+                       std::string dev,   size_t buffSize=1500,
+                       const TunnelOptions& opts=TunnelOptions{})          anyexcept;
             ~NnVpnServer(void)                                             noexcept;
 
             void                   init(std::string tunIpString, 
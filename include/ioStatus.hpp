@@ -0,0 +1,45 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+namespace inetlib {
+
+    // Outcome of a data path operation. Sessions report failures with these instead of
+    // throwing: the loops tear the connection down on anything but IO_OK, errno and the
+    // SSL error are kept for the log message, built only then.
+    enum IO_STATUS : uint8_t { IO_OK, IO_AGAIN, IO_CLOSED, IO_DEAD_PEER, IO_STALLED, IO_BAD_FRAME,
+                               IO_SSL_ERROR, IO_SOCKET_ERROR, IO_TUN_ERROR };
+
+    constexpr const char* ioStatusText(IO_STATUS status) noexcept{
+        switch(status){
+            case IO_OK:            return "ok";
+            case IO_AGAIN:         return "would block";
+            case IO_CLOSED:        return "connection closed by peer";
+            case IO_DEAD_PEER:     return "dead peer detected, nothing received within deadpeer interval";
+            case IO_STALLED:       return "stalled peer, queued data not read within deadpeer interval";
+            case IO_BAD_FRAME:     return "invalid frame from peer";
+            case IO_SSL_ERROR:     return "TLS error";
+            case IO_SOCKET_ERROR:  return "socket error";
+            case IO_TUN_ERROR:     return "TUN device error";
+        }
+        return "unknown";
+    }
+
+} // End namespace
@@ -0,0 +1,71 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include <frames.hpp>
+
+namespace inetlib {
+
+    // PING payload: | sequence (BE32) | sender monotonic timestamp in usec (BE64) |
+    // PONG echoes the PING payload unchanged.
+    constexpr size_t  PING_PAYLOAD_LEN    { 12 };
+    constexpr size_t  PING_FRAME_LEN      { FRAME_HEADER_LEN + PING_PAYLOAD_LEN };
+
+    class Keepalive{
+        public:
+                     Keepalive(uint64_t intervalUs, uint64_t deadPeerUs)   noexcept;
+
+            void     start(uint64_t now)                                   noexcept;
+            void     touch(uint64_t now)                                   noexcept;
+            bool     pingDue(uint64_t now)                           const noexcept;
+            bool     isDead(uint64_t now)                            const noexcept;
+            uint64_t nextEventUs(uint64_t now)                       const noexcept;
+
+            size_t   buildPing(uint8_t* dst, uint64_t now)                 noexcept;
+            static
+            size_t   buildPong(uint8_t* dst, const uint8_t* ping, 
+                               size_t len)                                 noexcept;
+            bool     onPong(const uint8_t* payload, size_t len, 
+                            uint64_t now)                                  noexcept;
+
+            uint64_t getSrttUs(void)                                 const noexcept;
+            uint64_t getJitterUs(void)                               const noexcept;
+            std::string report(void)                                 const anyexcept;
+
+        private:
+            uint64_t  interval,
+                      deadPeer,
+                      lastRecv       { 0 },
+                      nextPing       { 0 },
+                      lastRtt        { 0 },
+                      minRtt         { 0 },
+                      maxRtt         { 0 },
+                      srtt           { 0 },
+                      rttVar         { 0 },
+                      jitter         { 0 },
+                      pingsSent      { 0 },
+                      pongsRecv      { 0 },
+                      pongsLate      { 0 };
+            uint32_t  sequence       { 0 };
+    };
+
+} // End namespace
@@ -0,0 +1,75 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace inetlib {
+
+    // TUN is opened with IFF_VNET_HDR: every packet starts with a virtio_net_hdr 
+    // (10 bytes, linux/virtio_net.h can't be included in C++ code).
+    constexpr size_t  VNET_HDR_LEN      { 10 };
+    constexpr size_t  IPV4_HDR_MIN      { 20 };
+
+    inline uint32_t  loadBe32(const uint8_t* src) noexcept {
+        return (static_cast<uint32_t>(src[0]) << 24) | (static_cast<uint32_t>(src[1]) << 16) |
+               (static_cast<uint32_t>(src[2]) << 8)  |  static_cast<uint32_t>(src[3]);
+    }
+
+    inline void  storeBe32(uint8_t* dst, uint32_t value) noexcept {
+        dst[0] = static_cast<uint8_t>(value >> 24);
+        dst[1] = static_cast<uint8_t>(value >> 16);
+        dst[2] = static_cast<uint8_t>(value >> 8);
+        dst[3] = static_cast<uint8_t>(value);
+    }
+
+    inline bool  isIpv4Packet(const uint8_t* pkt, size_t len) noexcept {
+        return len >= VNET_HDR_LEN + IPV4_HDR_MIN && (pkt[VNET_HDR_LEN] >> 4) == 4;
+    }
+
+    // Addresses are returned in host byte order.
+    inline bool  ipv4Source(const uint8_t* pkt, size_t len, uint32_t& addr) noexcept {
+        if(!isIpv4Packet(pkt, len)) return false;
+        addr = loadBe32(pkt + VNET_HDR_LEN + 12);
+        return true;
+    }
+
+    inline bool  ipv4Destination(const uint8_t* pkt, size_t len, uint32_t& addr) noexcept {
+        if(!isIpv4Packet(pkt, len)) return false;
+        addr = loadBe32(pkt + VNET_HDR_LEN + 16);
+        return true;
+    }
+
+    // Forwarding outside the kernel decrements the TTL as a router would, with the header 
+    // checksum updated incrementally (RFC 1624): the TTL/protocol word drops by 0x0100, 
+    // so ~m + m' is 0xFEFF. False when the TTL is exhausted.
+    inline bool  decrementTtl(uint8_t* pkt, size_t len) noexcept {
+        if(!isIpv4Packet(pkt, len)) return false;
+        uint8_t*  hdr  { pkt + VNET_HDR_LEN };
+        if(hdr[8] <= 1) return false;
+        hdr[8]--;
+        uint32_t  sum  { (~((static_cast<uint32_t>(hdr[10]) << 8) | hdr[11]) & 0xFFFFU) + 0xFEFFU };
+        sum            = (sum & 0xFFFFU) + (sum >> 16);
+        sum            = (sum & 0xFFFFU) + (sum >> 16);
+        hdr[10]        = static_cast<uint8_t>(~sum >> 8);
+        hdr[11]        = static_cast<uint8_t>(~sum);
+        return true;
+    }
+
+} // End namespace
@@ -0,0 +1,79 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    enum HUGEPAGE_MODE : uint8_t { HUGEPAGE_OFF, HUGEPAGE_THP, HUGEPAGE_HUGETLB };
+
+    // Process wide packet memory: a single mapping reserved at startup, backed by 2MB pages
+    // when the kernel provides them, so that TUN batches, record buffers and frame readers
+    // of all sessions share a handful of TLB entries. Blocks released by closed sessions are
+    // kept on per size free lists; when the arena is off or exhausted buffers come from the heap.
+    class PacketArena{
+        public:
+            static void           reserve(size_t bytes, HUGEPAGE_MODE mode)  anyexcept;
+            static uint8_t*       acquire(size_t bytes)                      anyexcept;
+            static void           release(uint8_t* block, size_t bytes)      noexcept;
+            static std::string    report(void)                               anyexcept;
+            static HUGEPAGE_MODE  modeFromName(const std::string& name)      anyexcept;
+
+        private:
+            static constexpr size_t HUGE_PAGE   { 2UL * 1024 * 1024 };
+            static constexpr size_t BLOCK_ALIGN { 64 };
+
+            static inline uint8_t*       base       { nullptr };
+            static inline size_t         capacity   { 0 },
+                                         used       { 0 },
+                                         inUse      { 0 },
+                                         peak       { 0 };
+            static inline uint64_t       fallbacks  { 0 };
+            static inline const char*    backing    { "heap" };
+            static inline std::map<size_t, std::vector<uint8_t*>>
+                                         freeLists;
+
+            static uint8_t*       mapRegion(size_t bytes, HUGEPAGE_MODE mode) noexcept;
+    };
+
+    // A packet buffer taken from the arena, or from the heap when the arena can't serve it.
+    class PacketBuffer{
+        public:
+            explicit              PacketBuffer(size_t bytes)                 anyexcept;
+                                  ~PacketBuffer(void)                        noexcept;
+                                  PacketBuffer(const PacketBuffer&)          = delete;
+            PacketBuffer&         operator=(const PacketBuffer&)             = delete;
+
+            uint8_t*              data(void)                                 noexcept;
+            const uint8_t*        data(void)                           const noexcept;
+            size_t                size(void)                           const noexcept;
+
+        private:
+            uint8_t*              block;
+            size_t                len;
+            std::vector<uint8_t>  heap;
+    };
+
+} // End namespace
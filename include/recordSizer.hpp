@@ -0,0 +1,64 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <openssl/ssl.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    // Dynamic TLS record sizing: after an idle period records are cut to one MSS, so the
+    // peer can decrypt the first bytes as soon as the first segment lands; they grow back
+    // to full size once the kernel's unsent backlog reaches the TCP_NOTSENT_LOWAT cutoff
+    // or a bulk transfer has pushed BOOST_BYTES. Sockets without TCP_INFO keep full records.
+    class RecordSizer{
+        public:
+            RecordSizer(SSL* ssl, int fd, uint64_t idleUs)                 noexcept;
+
+            size_t          update(uint64_t now)                           noexcept;
+            void            onWrite(size_t bytes)                          noexcept;
+            std::string     report(void)                             const anyexcept;
+
+        private:
+            static constexpr size_t  TLS_OVERHEAD  { 22 },
+                                     MIN_FRAGMENT  { 512 },
+                                     BOOST_BYTES   { 262144 };
+
+            SSL             *cSSL;
+            int             sockFd;
+            uint64_t        idle,
+                            lastWrite     { 0 };
+            size_t          current,
+                            smallLen      { 0 },
+                            cutoff        { 0 },
+                            sinceIdle     { 0 };
+            bool            enabled,
+                            small         { false };
+            uint64_t        shrinks       { 0 },
+                            grows         { 0 };
+
+            bool            probe(void)                                    noexcept;
+            void            apply(size_t len)                              noexcept;
+    };
+
+} // End namespace
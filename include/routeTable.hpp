@@ -0,0 +1,164 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    enum ROUTE_ORIGIN : uint8_t { ROUTE_STATIC, ROUTE_LEARNED, ROUTE_ANNOUNCED, ROUTE_LEASED };
+
+    // Addresses in host byte order, host bits cleared.
+    struct Prefix{
+        uint32_t        addr;
+        uint8_t         len;
+    };
+
+    // A configured route: the prefix sits behind the client owning the inner address via.
+    struct StaticRoute{
+        Prefix          prefix;
+        uint32_t        via;
+    };
+
+    // Announcement payload: | address (BE32) | length | per prefix.
+    constexpr size_t  PREFIX_WIRE_LEN     { 5 };
+    constexpr size_t  MAX_ANNOUNCED       { 1024 };
+    // Host routes learned from the source addresses of one session.
+    constexpr size_t  MAX_LEARNED         { 16 };
+
+    inline uint32_t  prefixMask(uint8_t len) noexcept {
+        return len == 0 ? 0 : UINT32_MAX << (32 - len);
+    }
+
+    inline bool  validPrefix(Prefix prefix) noexcept {
+        return prefix.len <= 32 && (prefix.addr & ~prefixMask(prefix.len)) == 0;
+    }
+
+    // IPv4 longest prefix match on a 16-8-8 multibit trie. The first 16 bits index a direct
+    // array, longer prefixes go down to 256 slot chunks compressed as in poptrie: a bitmap
+    // marks where a run of equal slots starts, and the slot value is found by popcount among
+    // one entry per run. A lookup is at most three dependent steps, whatever the number of 
+    // routes, and chunks stay a few tens of bytes: the table keeps to the CPU caches. Entries
+    // hold a next hop, bound to the session currently serving it; hop 0 is "no route".
+    // The table is owned by the data plane thread: updates run between packets, so lookups 
+    // never see a half written entry and take no lock.
+    class RouteTable{
+        public:
+            RouteTable(void)                                               anyexcept;
+
+            bool          insert(Prefix prefix, uint32_t hop, 
+                                 ROUTE_ORIGIN origin)                      anyexcept;
+            bool          remove(Prefix prefix)                            noexcept;
+            uint32_t      hopForAddr(uint32_t inner)                       anyexcept;
+            uint32_t      hopForPeer(int fd)                               anyexcept;
+            int           holder(uint32_t inner)                     const noexcept;
+            int           bind(uint32_t hop, int fd)                       noexcept;
+            void          dropPeer(int fd)                                 noexcept;
+            int           resolve(uint32_t dst)                      const noexcept;
+            size_t        size(void)                                 const noexcept;
+            std::string   report(void)                               const anyexcept;
+
+            static std::vector<std::string>  splitList(const std::string& text)     anyexcept;
+            static Prefix                    parsePrefix(const std::string& text)   anyexcept;
+            static std::vector<Prefix>       parsePrefixes(const std::string& text) anyexcept;
+            static std::vector<StaticRoute>  parseRoutes(const std::string& text)   anyexcept;
+            static std::string               prefixText(Prefix prefix)              anyexcept;
+
+        private:
+            static constexpr uint32_t CHUNK_FLAG  { 0x80000000U };
+            static constexpr size_t   ROOT_SLOTS  { 65536 },
+                                      CHUNK_SLOTS { 256 };
+
+            // A chunk: its entries and prefix lengths, one per run, are stored from base in 
+            // the level pool, in a segment of 2^order slots.
+            struct alignas(64) Node{
+                std::array<uint64_t, 4>    runs         {};
+                std::array<uint16_t, 4>    rank         {};
+                uint32_t                   base         { 0 };
+                uint8_t                    order        { 0 };
+            };
+
+            struct Level{
+                std::vector<Node>                       nodes;
+                std::vector<uint32_t>                   entry;
+                std::vector<uint8_t>                    depth;
+                std::array<std::vector<uint32_t>, 9>    spare;
+                std::vector<uint32_t>                   freeNodes;
+            };
+
+            // A chunk expanded for an update.
+            struct Slots{
+                std::array<uint32_t, CHUNK_SLOTS>  entry;
+                std::array<uint8_t,  CHUNK_SLOTS>  depth;
+            };
+
+            struct Route{
+                uint32_t       hop;
+                ROUTE_ORIGIN   origin;
+            };
+
+            struct Hop{
+                uint32_t       inner;
+                int            fd;
+                uint32_t       refs;
+            };
+
+            std::vector<uint32_t>                     rootEntry;
+            std::vector<uint8_t>                      rootDepth;
+            std::array<Level, 2>                      chunks;
+            std::unordered_map<uint64_t, Route>       routes;
+            std::vector<Hop>                          hops;
+            std::vector<uint32_t>                     freeHops;
+            std::unordered_map<uint32_t, uint32_t>    addrHops;
+            std::unordered_map<int, uint32_t>         peerHops;
+            std::array<size_t, 4>                     byOrigin     {};
+
+            uint32_t      lookup(uint32_t dst)                       const noexcept;
+            uint32_t      at(size_t level, size_t index, 
+                             size_t slot)                            const noexcept;
+            void          expand(size_t level, size_t index, 
+                                 Slots& slots)                       const noexcept;
+            void          compress(const Slots& slots, size_t level, 
+                                   size_t index)                           anyexcept;
+            uint32_t      segment(Level& level, uint8_t order)             anyexcept;
+            size_t        newChunk(size_t level, uint32_t entry, 
+                                   uint8_t depth)                          anyexcept;
+            size_t        rootChild(size_t slot)                           anyexcept;
+            size_t        midChild(size_t mid, size_t slot)                anyexcept;
+            bool          uniform(size_t level, size_t index)        const noexcept;
+            void          prune(uint32_t addr)                             noexcept;
+            void          paint(Prefix prefix, uint32_t hop, 
+                                uint8_t len, uint8_t ceiling)              noexcept;
+            void          fillRoot(size_t first, size_t count, uint32_t hop, 
+                                   uint8_t len, uint8_t ceiling)           noexcept;
+            void          fillChunk(size_t level, size_t index, size_t first, 
+                                    size_t count, uint32_t hop, 
+                                    uint8_t len, uint8_t ceiling)          noexcept;
+            uint32_t      newHop(uint32_t inner, int fd)                   anyexcept;
+
+            static uint64_t  key(Prefix prefix)                            noexcept;
+    };
+
+} // End namespace
@@ -0,0 +1,126 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <string>
+#include <vector>
+
+#include <anyexcept.hpp>
+#include <routeTable.hpp>
+
+namespace inetlib {
+
+    enum SHAPE_DIR : uint8_t { SHAPE_INGRESS, SHAPE_EGRESS, SHAPE_DIRS };
+
+    constexpr uint32_t SHAPE_NONE          { UINT32_MAX };
+    constexpr uint64_t SHAPE_MAX_RATE_KBIT { 100000000 },
+                       SHAPE_MAX_BURST_KB  { 1048576 };
+
+    // Bytes per second and bytes: a zero rate doesn't limit.
+    struct RateLimit{
+        uint64_t   rate   { 0 },
+                   burst  { 0 };
+    };
+
+    using ShapeLimits = std::array<RateLimit, SHAPE_DIRS>;
+
+    struct ShapeGroup{
+        std::string   name;
+        ShapeLimits   limits;
+    };
+
+    // Clients whose source address matches the prefix, longest match first.
+    struct ShapeRule{
+        Prefix        source;
+        ShapeLimits   limits;
+        uint32_t      group;
+    };
+
+    struct ShapingConfig{
+        std::vector<ShapeGroup>   groups;
+        std::vector<ShapeRule>    rules;
+    };
+
+    // Tokens are bytes scaled by USEC_PER_SEC: a refill is rate * elapsed microseconds, 
+    // with no division and no rounding drift. Frames are charged after they pass, so the 
+    // bucket may go into debt: it conforms again once the debt is paid back.
+    class TokenBucket{
+        public:
+                        TokenBucket(void)                                  noexcept;
+            explicit    TokenBucket(RateLimit limit)                       noexcept;
+
+            bool        limited(void)                                const noexcept;
+            bool        conforms(uint64_t now)                             noexcept;
+            void        consume(size_t bytes)                              noexcept;
+            uint64_t    waitUs(void)                                 const noexcept;
+            size_t      available(void)                              const noexcept;
+
+        private:
+            uint64_t    rate,
+                        cap;
+            int64_t     tokens;
+            uint64_t    last     { 0 };
+    };
+
+    // Two level shaping: a session's frames pass when both its own bucket and its group's 
+    // bucket conform and are charged to both, so a group caps the sum of its sessions. 
+    // Buckets refill from monotonic time deltas when they are checked: no timer, no 
+    // thread, and no lock since they are only used by the event loop thread.
+    class Shaper{
+        public:
+            explicit      Shaper(const ShapingConfig& config)              anyexcept;
+
+            bool          enabled(void)                              const noexcept;
+            uint32_t      open(uint32_t source)                            anyexcept;
+            void          close(uint32_t id)                               noexcept;
+            bool          admit(uint32_t id, SHAPE_DIR dir, 
+                                uint64_t now)                              noexcept;
+            void          charge(uint32_t id, SHAPE_DIR dir, 
+                                 size_t bytes)                             noexcept;
+            uint64_t      waitUs(uint32_t id, SHAPE_DIR dir)         const noexcept;
+            size_t        available(uint32_t id, SHAPE_DIR dir, 
+                                    uint64_t now)                          noexcept;
+            std::string   report(void)                               const anyexcept;
+            std::string   report(uint32_t id)                        const anyexcept;
+
+            static ShapingConfig  
+                          parse(const std::string& groups, 
+                                const std::string& rules)                  anyexcept;
+
+        private:
+            struct Limiter{
+                std::array<TokenBucket, SHAPE_DIRS>  buckets;
+                uint32_t                             group      { SHAPE_NONE };
+                bool                                 used       { false };
+                std::array<uint64_t, SHAPE_DIRS>     bytes      {},
+                                                     throttled  {};
+            };
+
+            ShapingConfig               config;
+            std::vector<Limiter>        groups,
+                                        sessions;
+            std::vector<uint32_t>       freeSessions;
+            size_t                      openSessions  { 0 };
+
+            std::string   counters(const Limiter& limiter)           const anyexcept;
+    };
+
+} // End namespace
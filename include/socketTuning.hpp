@@ -0,0 +1,46 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    // Transport socket options, from a named profile plus per-option overrides.
+    // Every field at UNSET leaves the kernel default in place.
+    struct SocketTuning{
+        static constexpr int    UNSET         { -1 };
+
+        std::string             profile       { "default" },
+                                congestion;
+        int                     sndBuf        { UNSET },
+                                rcvBuf        { UNSET },
+                                noDelay       { UNSET },
+                                notSentLowat  { UNSET },
+                                busyPollUs    { UNSET };
+
+        static SocketTuning     fromProfile(const std::string& name)   anyexcept;
+        void                    apply(int fd)                    const anyexcept;
+        void                    validate(void)                   const anyexcept;
+        static std::string      describe(int fd)                       anyexcept;
+    };
+
+} // End namespace
@@ -0,0 +1,54 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    struct SslAllocStats{
+        uint64_t   allocs       { 0 },
+                   frees        { 0 },
+                   cacheHits    { 0 },
+                   large        { 0 },
+                   liveBytes    { 0 },
+                   peakBytes    { 0 };
+    };
+
+    // OpenSSL allocator: power of two size classes from 16 bytes to 32KB, each thread keeping
+    // its own bounded free lists, so the SSL objects, record buffers and handshake state of
+    // reconnecting peers reuse the blocks of the previous ones without going through malloc.
+    // Larger requests go straight to malloc. It must be installed before OpenSSL allocates.
+    class SslAllocator{
+        public:
+            static bool           install(void)                              noexcept;
+            static bool           installed(void)                            noexcept;
+            static SslAllocStats  stats(void)                                noexcept;
+            static std::string    report(void)                               anyexcept;
+
+        private:
+            static void*          allocate(size_t num, const char* file, int line)              noexcept;
+            static void*          reallocate(void* ptr, size_t num, const char* file, int line) noexcept;
+            static void           release(void* ptr, const char* file, int line)                noexcept;
+    };
+
+} // End namespace
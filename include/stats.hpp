@@ -0,0 +1,69 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <csignal>
+#include <cstdint>
+#include <string>
+
+#include <anyexcept.hpp>
+
+namespace inetlib {
+
+    struct TunnelStats{
+        uint64_t   tunRxPackets     { 0 },
+                   tunRxBytes       { 0 },
+                   tunTxPackets     { 0 },
+                   tunTxBytes       { 0 },
+                   hairpinPackets   { 0 },
+                   sslRxRecords     { 0 },
+                   sslRxBytes       { 0 },
+                   sslTxRecords     { 0 },
+                   sslTxBytes       { 0 },
+                   txBacklogged     { 0 },
+                   txBacklogDrops   { 0 },
+                   ctrlRxFrames     { 0 },
+                   ctrlTxFrames     { 0 },
+                   rxWakeups        { 0 },
+                   buffReleases     { 0 };
+
+        std::string report(void)                                 const anyexcept;
+
+        static void installDumpSignal(void)                            noexcept;
+        static bool takeDumpRequest(void)                              noexcept;
+
+        private:
+            static inline volatile sig_atomic_t dumpRequested { 0 };
+            static void onDumpSignal(int sig)                          noexcept;
+    };
+
+    struct ServerStats{
+        uint64_t   handshakesStarted   { 0 },
+                   handshakesDone      { 0 },
+                   handshakesFailed    { 0 },
+                   handshakesTimedOut  { 0 },
+                   peersClosed         { 0 },
+                   noRouteDrops        { 0 },
+                   hairpinPackets      { 0 },
+                   hairpinBytes        { 0 },
+                   acceptBackoffs      { 0 };
+
+        std::string report(size_t peers, size_t pending)         const anyexcept;
+    };
+
+} // End namespace
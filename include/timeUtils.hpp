@@ -0,0 +1,43 @@
+// -----------------------------------------------------------------
+// Timeutils - monotonic clock helpers
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <sys/time.h>
+#include <time.h>
+
+#include <cstdint>
+
+namespace timeutils{
+
+   constexpr uint64_t USEC_PER_SEC  { 1000000ULL };
+   constexpr uint64_t USEC_PER_MSEC { 1000ULL };
+
+   inline uint64_t monotonicUs(void) noexcept {
+      struct timespec ts {};
+      static_cast<void>(clock_gettime(CLOCK_MONOTONIC, &ts));
+      return static_cast<uint64_t>(ts.tv_sec) * USEC_PER_SEC + static_cast<uint64_t>(ts.tv_nsec) / 1000ULL;
+   }
+
+   inline struct timeval toTimeval(uint64_t usec) noexcept {
+      struct timeval tv {};
+      tv.tv_sec  = static_cast<time_t>(usec / USEC_PER_SEC);
+      tv.tv_usec = static_cast<suseconds_t>(usec % USEC_PER_SEC);
+      return tv;
+   }
+
+} // End namespace
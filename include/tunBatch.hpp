@@ -0,0 +1,62 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <anyexcept.hpp>
+#include <packetArena.hpp>
+#include <ioStatus.hpp>
+
+namespace inetlib {
+
+    // Reads up to 'slots' packets from a non blocking TUN fd per wakeup into pooled
+    // buffers, stopping at EAGAIN or when the byte budget is spent. Every slot keeps
+    // FRAME_HEADER_LEN bytes of headroom, so packets are framed in place. A failed read
+    // returns IO_CLOSED or IO_TUN_ERROR with errno set, the packets read before it stay valid.
+    class TunBatch{
+        public:
+            // Batches of buffers the event loop keeps when it reads the device itself.
+            static constexpr size_t RING_BATCHES { 8 };
+
+            TunBatch(size_t slots, size_t payloadSize, size_t byteBudget)  anyexcept;
+
+            IO_STATUS       drain(int tunFd, size_t& count)                noexcept;
+            uint8_t*        frame(size_t index)                            noexcept;
+            size_t          length(size_t index)                     const noexcept;
+            bool            drained(void)                            const noexcept;
+            std::string     report(void)                             const anyexcept;
+
+        private:
+            std::vector<size_t>    lengths;
+            size_t                 stride,
+                                   payload,
+                                   budget;
+            PacketBuffer           arena;
+            uint64_t               batches      { 0 },
+                                   packets      { 0 },
+                                   fullBatches  { 0 },
+                                   budgetHits   { 0 },
+                                   maxBatch     { 0 };
+            bool                   empty        { false };
+    };
+
+} // End namespace
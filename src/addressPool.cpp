@@ -0,0 +1,177 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <addressPool.hpp>
+#include <inetgeneral.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          stringutils::mergeStrings;
+
+    // The network and broadcast addresses are never handed out.
+    AddressPool::AddressPool(Prefix poolRange, uint64_t leaseUs) anyexcept
+       : range { poolRange }, leaseTime { leaseUs }
+    {
+        if(!enabled()) return;
+        if(!validPrefix(range) || range.len < POOL_MIN_PREFIX || range.len > POOL_MAX_PREFIX)
+            throw InetException(mergeStrings({"AddressPool::AddressPool : invalid range : ", RouteTable::prefixText(range)}));
+
+        size_t size { size_t{1} << (32 - range.len) };
+        bits.assign((size + 63) / 64, 0);
+        summary.assign((bits.size() + 63) / 64, 0);
+        for(size_t index{1}; index < size - 1; index++) give(index);
+    }
+
+    bool AddressPool::enabled(void) const noexcept{
+        return range.len != 0;
+    }
+
+    bool AddressPool::contains(uint32_t addr) const noexcept{
+        return enabled() && (addr & prefixMask(range.len)) == range.addr;
+    }
+
+    uint8_t AddressPool::prefixLen(void) const noexcept{
+        return range.len;
+    }
+
+    void AddressPool::take(size_t index) noexcept{
+        uint64_t& word { bits[index >> 6] };
+        word &= ~(1ULL << (index & 63));
+        if(word == 0) summary[index >> 12] &= ~(1ULL << ((index >> 6) & 63));
+        available--;
+    }
+
+    void AddressPool::give(size_t index) noexcept{
+        bits[index >> 6]     |= 1ULL << (index & 63);
+        summary[index >> 12] |= 1ULL << ((index >> 6) & 63);
+        available++;
+    }
+
+    // Addresses configured elsewhere, e.g. the server end of the tunnel.
+    void AddressPool::reserve(uint32_t addr) noexcept{
+        if(!contains(addr)) return;
+        size_t index { addr - range.addr };
+        if(bits[index >> 6] & (1ULL << (index & 63))) take(index);
+    }
+
+    // An address a client was configured with, inside the range: it's routed to that client 
+    // only if free. Held leases aren't taken, their owner may be back.
+    bool AddressPool::claim(uint32_t addr) noexcept{
+        if(!contains(addr)) return false;
+        size_t index { addr - range.addr };
+        if((bits[index >> 6] & (1ULL << (index & 63))) == 0) return false;
+        take(index);
+        inUse++;
+        claimed++;
+        return true;
+    }
+
+    // Claimed addresses aren't leased: they are free again as soon as their client leaves.
+    void AddressPool::unclaim(uint32_t addr) noexcept{
+        if(!contains(addr)) return;
+        inUse--;
+        give(addr - range.addr);
+    }
+
+    // Expiries are queued in lease order: the front is always the next one. A reclaimed 
+    // lease leaves a stale entry behind, skipped here. With oldest, the first live lease 
+    // goes back to the pool even if it hasn't expired.
+    bool AddressPool::expire(uint64_t now, bool oldest) noexcept{
+        bool freed { false };
+        while(!expiries.empty()){
+            Expiry  next  { expiries.front() };
+            auto    lease { held.find(next.owner) };
+            bool    live  { lease != held.end() && lease->second.expires == next.expires };
+            if(live && next.expires > now && !oldest) break;
+            expiries.pop_front();
+            if(!live) continue;
+            give(lease->second.addr - range.addr);
+            held.erase(lease);
+            freed = true;
+            if(oldest) break;
+        }
+        return freed;
+    }
+
+    // 0 when the pool is full.
+    uint32_t AddressPool::acquire(uint64_t owner, uint64_t now) noexcept{
+        if(auto lease { held.find(owner) }; lease != held.end()){
+            uint32_t addr { lease->second.addr };
+            held.erase(lease);
+            inUse++;
+            reused++;
+            return addr;
+        }
+
+        static_cast<void>(expire(now, false));
+        if(available == 0){
+            if(!expire(now, true)){
+                exhausted++;
+                return 0;
+            }
+            preempted++;
+        }
+        for(size_t group{0}; group < summary.size(); group++){
+            if(summary[group] == 0) continue;
+            size_t word  { group * 64 + static_cast<size_t>(__builtin_ctzll(summary[group])) };
+            size_t index { word * 64 + static_cast<size_t>(__builtin_ctzll(bits[word])) };
+            take(index);
+            inUse++;
+            assigned++;
+            return range.addr + static_cast<uint32_t>(index);
+        }
+        return 0;
+    }
+
+    // The address stays held for the owner until the lease expires. A second session with 
+    // the same identity replaces the previous lease; without room to keep it, it's freed at once.
+    void AddressPool::release(uint32_t addr, uint64_t owner, uint64_t now) noexcept{
+        if(!contains(addr)) return;
+        inUse--;
+        if(leaseTime == 0){
+            give(addr - range.addr);
+            return;
+        }
+        try{
+            if(auto lease { held.find(owner) }; lease != held.end()){
+                give(lease->second.addr - range.addr);
+                held.erase(lease);
+            }
+            expiries.push_back(Expiry{ now + leaseTime, owner });
+            held.emplace(owner, Lease{ addr, now + leaseTime });
+        }catch(...){
+            give(addr - range.addr);
+        }
+    }
+
+    string AddressPool::report(void) const anyexcept{
+        if(!enabled()) return "ADDRESS POOL : off";
+        return mergeStrings({ "ADDRESS POOL : range=", RouteTable::prefixText(range),
+                              " in_use=",    to_string(inUse),
+                              " held=",      to_string(held.size()),
+                              " free=",      to_string(available),
+                              " assigned=",  to_string(assigned),
+                              " reused=",    to_string(reused),
+                              " preempted=", to_string(preempted),
+                              " exhausted=", to_string(exhausted),
+                              " claimed=",   to_string(claimed) });
+    }
+
+} // End namespace
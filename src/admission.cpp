@@ -0,0 +1,99 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <algorithm>
+#include <random>
+
+#include <admission.hpp>
+#include <StringUtils.hpp>
+#include <timeUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::min,
+          std::max,
+          std::random_device,
+          stringutils::mergeStrings,
+          timeutils::USEC_PER_SEC;
+
+    AdmissionControl::AdmissionControl(double ratePerSec, double burstSize, size_t maxHandshakes, size_t slots) anyexcept
+       : mask { 0 }, seed { random_device{}() | 1U }, rate { ratePerSec }, burst { burstSize }, maxPending { maxHandshakes }
+    {
+        size_t size { PROBE_WINDOW };
+        while(size < slots) size <<= 1;
+        table.assign(size, Bucket{ 0, 0.0F, 0 });
+        mask = size - 1;
+    }
+
+    AdmissionControl::Bucket& AdmissionControl::lookup(uint32_t srcAddr, uint64_t now) noexcept{
+        // Seeded multiplicative hash: sources can't be chosen to collide on purpose.
+        size_t   base    { static_cast<size_t>((static_cast<uint64_t>(srcAddr ^ seed) * 0x9E3779B97F4A7C15ULL) >> 32) & mask };
+        Bucket*  victim  { nullptr };
+
+        for(size_t i{0}; i < PROBE_WINDOW; i++){
+            Bucket& bucket { table[(base + i) & mask] };
+            if(bucket.last != 0 && bucket.addr == srcAddr) return bucket;
+            if(bucket.last == 0){
+                if(victim == nullptr || victim->last != 0) victim = &bucket;
+            }else if(victim == nullptr || (victim->last != 0 && bucket.last < victim->last)){
+                victim = &bucket;
+            }
+        }
+
+        if(victim->last != 0) evictions++;
+        *victim = Bucket{ srcAddr, static_cast<float>(burst), now };
+        return *victim;
+    }
+
+    ADMISSION_RESULT AdmissionControl::admit(uint32_t srcAddr, uint64_t now, size_t pendingHandshakes) noexcept{
+        maxPendingSeen = max<uint64_t>(maxPendingSeen, pendingHandshakes);
+        if(maxPending != 0 && pendingHandshakes >= maxPending){
+            rejectedCap++;
+            return ADMIT_TOO_MANY_HANDSHAKES;
+        }
+        if(rate <= 0.0){
+            admitted++;
+            return ADMIT_OK;
+        }
+
+        Bucket& bucket { lookup(srcAddr, now) };
+        double  tokens { min(burst, bucket.tokens + static_cast<double>(now - bucket.last) * rate / static_cast<double>(USEC_PER_SEC)) };
+        bucket.last    = now;
+        if(tokens < 1.0){
+            bucket.tokens = static_cast<float>(tokens);
+            rejectedRate++;
+            return ADMIT_RATE_LIMITED;
+        }
+
+        bucket.tokens = static_cast<float>(tokens - 1.0);
+        admitted++;
+        return ADMIT_OK;
+    }
+
+    string AdmissionControl::report(void) const anyexcept{
+        size_t tracked { static_cast<size_t>(std::count_if(table.begin(), table.end(), [](const Bucket& b){ return b.last != 0; })) };
+        return mergeStrings({ "ADMISSION STATS : admitted=", to_string(admitted),
+                              " rejected_rate=",            to_string(rejectedRate),
+                              " rejected_cap=",             to_string(rejectedCap),
+                              " pending_max=",              to_string(maxPendingSeen),
+                              " sources_tracked=",          to_string(tracked),
+                              " evictions=",                to_string(evictions) });
+    }
+
+} // End namespace
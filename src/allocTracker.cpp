@@ -0,0 +1,109 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <cstdlib>
+#include <cerrno>
+#include <malloc.h>
+
+#include <allocTracker.hpp>
+
+namespace inetlib{
+
+    namespace {
+        thread_local bool      armed     { false };
+        thread_local uint64_t  count     { 0 };
+        thread_local size_t    last      { 0 };
+
+        [[maybe_unused]] inline void track(size_t size) noexcept{
+            if(!armed) return;
+            count++;
+            last = size;
+        }
+    }
+
+    bool AllocTracker::enabled(void) noexcept{
+#ifdef NNVPN_ALLOC_CHECK
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void AllocTracker::arm(void) noexcept{
+        count = 0;
+        last  = 0;
+        armed = true;
+    }
+
+    uint64_t AllocTracker::disarm(void) noexcept{
+        armed = false;
+        return count;
+    }
+
+    size_t AllocTracker::lastSize(void) noexcept{
+        return last;
+    }
+
+} // End namespace
+
+#ifdef NNVPN_ALLOC_CHECK
+// glibc's own entry points: the interposers below only count and forward.
+extern "C" {
+    void*  __libc_malloc(size_t size)                    noexcept;
+    void*  __libc_calloc(size_t num, size_t size)        noexcept;
+    void*  __libc_realloc(void* ptr, size_t size)        noexcept;
+    void*  __libc_memalign(size_t align, size_t size)    noexcept;
+    void   __libc_free(void* ptr)                        noexcept;
+
+    void* malloc(size_t size) noexcept{
+        inetlib::track(size);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t num, size_t size) noexcept{
+        inetlib::track(num * size);
+        return __libc_calloc(num, size);
+    }
+
+    void* realloc(void* ptr, size_t size) noexcept{
+        inetlib::track(size);
+        return __libc_realloc(ptr, size);
+    }
+
+    void* memalign(size_t align, size_t size) noexcept{
+        inetlib::track(size);
+        return __libc_memalign(align, size);
+    }
+
+    void* aligned_alloc(size_t align, size_t size) noexcept{
+        inetlib::track(size);
+        return __libc_memalign(align, size);
+    }
+
+    int posix_memalign(void** ptr, size_t align, size_t size) noexcept{
+        inetlib::track(size);
+        void* block { __libc_memalign(align, size) };
+        if(block == nullptr) return ENOMEM;
+        *ptr = block;
+        return 0;
+    }
+
+    void free(void* ptr) noexcept{
+        __libc_free(ptr);
+    }
+}
+#endif
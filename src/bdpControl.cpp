@@ -0,0 +1,107 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+
+#include <algorithm>
+
+#include <bdpControl.hpp>
+#include <debug.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::clamp,
+          std::min,
+          stringutils::mergeStrings,
+          debugmode::Debug,
+          debugmode::DEBUG_MODE;
+
+    BdpControl::BdpControl(int fd, uint64_t intervalUs, double factor) noexcept
+        : sockFd { fd }, interval { intervalUs }, gain { factor }, enabled { intervalUs != 0 }
+    {}
+
+    // Returns the egress budget in bytes: the socket buffer, at least MIN_BUFFER, or 0 
+    // while disabled or before the first estimate. The kernel tcp_info is used for tcpi_delivery_rate and tcpi_min_rtt, 
+    // not yet in the libc one.
+    size_t BdpControl::sample(uint64_t now, const string& label) noexcept{
+        if(!enabled || now < nextSample) return current;
+        nextSample = now + interval;
+
+        struct tcp_info info {};
+        socklen_t       len   { sizeof(info) };
+        if(getsockopt(sockFd, IPPROTO_TCP, TCP_INFO, &info, &len) == -1){
+            enabled = false;
+            return current;
+        }
+
+        uint64_t minRtt  { info.tcpi_min_rtt != 0 ? info.tcpi_min_rtt : info.tcpi_rtt },
+                 rate    { info.tcpi_delivery_rate };
+        if(rate == 0 && info.tcpi_rtt != 0) 
+            rate = static_cast<uint64_t>(info.tcpi_snd_cwnd) * info.tcpi_snd_mss * 1000000ULL / info.tcpi_rtt;
+        if(minRtt == 0 || rate == 0) return current;
+
+        // The kernel reports twice the size set, the extra half being its bookkeeping.
+        int       inKernel { 0 };
+        socklen_t optLen   { sizeof(inKernel) };
+        if(getsockopt(sockFd, SOL_SOCKET, SO_SNDBUF, &inKernel, &optLen) == -1 || inKernel <= 0){
+            enabled = false;
+            return current;
+        }
+        size_t buffer    { static_cast<size_t>(inKernel) / 2 };
+        current          = clamp(buffer, MIN_BUFFER, MAX_BUFFER);
+
+        bdp = static_cast<size_t>(rate * minRtt / 1000000ULL);
+        size_t target    { min(static_cast<size_t>(static_cast<double>(bdp) * gain), MAX_BUFFER) };
+        bool   congested { info.tcpi_rtt > minRtt * RTT_INFLATION };
+        retrans          = info.tcpi_total_retrans;
+
+        // Hysteresis: growth under a quarter of the buffer isn't worth a resize.
+        if(target <= buffer + buffer / 4) return current;
+        if(congested){
+            holds++;
+            // Built only when it's printed: the sampling runs on the data path.
+            if(Debug::getDebugLevel() >= DEBUG_MODE::STD_DEBUG)
+                Debug::printLog(mergeStrings({"BdpControl : ", label, " : hold sndbuf=", to_string(current), " bdp=", to_string(bdp),
+                                              " rtt_us=", to_string(info.tcpi_rtt), " min_rtt_us=", to_string(minRtt),
+                                              " retrans=", to_string(retrans)}), DEBUG_MODE::STD_DEBUG);
+            return current;
+        }
+
+        int value { static_cast<int>(target) };
+        if(setsockopt(sockFd, SOL_SOCKET, SO_SNDBUF, &value, sizeof(value)) == -1) return current;
+        if(Debug::getDebugLevel() >= DEBUG_MODE::STD_DEBUG)
+            Debug::printLog(mergeStrings({"BdpControl : ", label, " : sndbuf ", to_string(buffer), " -> ", to_string(target),
+                                          " bdp=", to_string(bdp), " rate_Bps=", to_string(rate), " min_rtt_us=", to_string(minRtt),
+                                          " cwnd=", to_string(info.tcpi_snd_cwnd), " retrans=", to_string(retrans)}), DEBUG_MODE::STD_DEBUG);
+        current = clamp(target, MIN_BUFFER, MAX_BUFFER);
+        resizes++;
+        return current;
+    }
+
+    string BdpControl::report(void) const anyexcept{
+        return mergeStrings({ "bdp=",      to_string(bdp),
+                              " budget=",  to_string(current),
+                              " resizes=", to_string(resizes),
+                              " holds=",   to_string(holds) });
+    }
+
+} // End namespace
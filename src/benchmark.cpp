@@ -0,0 +1,675 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <iterator>
+#include <random>
+
+#include <benchmark.hpp>
+#include <inetgeneral.hpp>
+#include <cipherTuning.hpp>
+#include <allocTracker.hpp>
+#include <StringUtils.hpp>
+#include <timeUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::cout,
+          std::setw,
+          std::left,
+          std::right,
+          std::fixed,
+          std::setprecision,
+          std::unique_ptr,
+          std::vector,
+          std::mt19937,
+          std::uniform_int_distribution,
+          stringutils::mergeStrings,
+          timeutils::monotonicUs,
+          timeutils::USEC_PER_SEC;
+
+    namespace {
+        constexpr uint64_t BENCH_TIME_US  { USEC_PER_SEC };
+
+        struct KeyType{
+            const char*  label;
+            const char*  algorithm;
+            const char*  param;
+            size_t       bits;
+        };
+
+        using PkeyPtr   = unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)>;
+        using X509Ptr   = unique_ptr<X509,     decltype(&X509_free)>;
+        using CtxPtr    = unique_ptr<SSL_CTX,  decltype(&SSL_CTX_free)>;
+
+        uint64_t threadCpuUs(void) noexcept{
+            struct timespec ts {};
+            static_cast<void>(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts));
+            return static_cast<uint64_t>(ts.tv_sec) * USEC_PER_SEC + static_cast<uint64_t>(ts.tv_nsec) / 1000ULL;
+        }
+
+        PkeyPtr makeKey(const KeyType& type) anyexcept{
+            EVP_PKEY* pkey { type.param != nullptr ? EVP_PKEY_Q_keygen(nullptr, nullptr, type.algorithm, type.param)  :
+                             type.bits  != 0       ? EVP_PKEY_Q_keygen(nullptr, nullptr, type.algorithm, type.bits)   :
+                                                     EVP_PKEY_Q_keygen(nullptr, nullptr, type.algorithm) };
+            if(pkey == nullptr) throw InetException(mergeStrings({"Benchmark : key generation error : ", type.label}));
+            return PkeyPtr{ pkey, EVP_PKEY_free };
+        }
+
+        X509Ptr makeCert(EVP_PKEY* pkey) anyexcept{
+            X509Ptr cert { X509_new(), X509_free };
+            if(!cert) throw InetException("Benchmark : X509_new error.");
+            ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+            X509_gmtime_adj(X509_getm_notBefore(cert.get()), 0);
+            X509_gmtime_adj(X509_getm_notAfter(cert.get()), 3600);
+            X509_set_pubkey(cert.get(), pkey);
+            X509_NAME* name { X509_get_subject_name(cert.get()) };
+            X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("nnvpn-bench"), -1, -1, 0);
+            X509_set_issuer_name(cert.get(), name);
+            // Ed25519 signs without a separate digest.
+            const EVP_MD* md { EVP_PKEY_is_a(pkey, "ED25519") ? nullptr : EVP_sha256() };
+            if(X509_sign(cert.get(), pkey, md) == 0) throw InetException("Benchmark : X509_sign error.");
+            return cert;
+        }
+
+        CtxPtr makeCtx(const SSL_METHOD* method, const char* groups) anyexcept{
+            CtxPtr ctx { SSL_CTX_new(method), SSL_CTX_free };
+            if(!ctx) throw InetException("Benchmark : SSL_CTX_new error.");
+            SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_OFF);
+            SSL_CTX_set_options(ctx.get(), SSL_OP_NO_TICKET);
+            SSL_CTX_set1_groups_list(ctx.get(), groups);
+            SSL_CTX_clear_mode(ctx.get(), SSL_MODE_AUTO_RETRY);
+            return ctx;
+        }
+
+        // Full handshake over an in memory BIO pair: no sockets, crypto cost only.
+        // Returns the server side CPU time in usec.
+        uint64_t handshakeOnce(SSL_CTX* srvCtx, SSL_CTX* cliCtx) anyexcept{
+            BIO* srvBio { nullptr };
+            BIO* cliBio { nullptr };
+            if(BIO_new_bio_pair(&srvBio, 0, &cliBio, 0) != 1) throw InetException("Benchmark : BIO_new_bio_pair error.");
+
+            SSL* srv { SSL_new(srvCtx) };
+            SSL* cli { SSL_new(cliCtx) };
+            SSL_set_bio(srv, srvBio, srvBio);
+            SSL_set_bio(cli, cliBio, cliBio);
+            SSL_set_accept_state(srv);
+            SSL_set_connect_state(cli);
+
+            uint64_t srvCpu  { 0 };
+            bool     srvDone { false },
+                     cliDone { false };
+            for(int round{0}; !(srvDone && cliDone) && round < 32; round++){
+                if(!cliDone) cliDone = SSL_do_handshake(cli) == 1;
+                if(!srvDone){
+                    uint64_t begin { threadCpuUs() };
+                    srvDone        = SSL_do_handshake(srv) == 1;
+                    srvCpu        += threadCpuUs() - begin;
+                }
+            }
+            SSL_free(srv);
+            SSL_free(cli);
+            if(!(srvDone && cliDone)) throw InetException("Benchmark : handshake didn't complete.");
+            return srvCpu;
+        }
+
+
+        long countReads(BIO* bio, int oper, const char*, size_t, int, long, int ret, size_t*){
+            if(oper == (BIO_CB_READ | BIO_CB_RETURN)) (*reinterpret_cast<uint64_t*>(BIO_get_callback_arg(bio)))++;
+            return ret;
+        }
+
+        long countWrites(BIO* bio, int oper, const char*, size_t, int, long, int ret, size_t*){
+            if(oper == (BIO_CB_WRITE | BIO_CB_RETURN)) (*reinterpret_cast<uint64_t*>(BIO_get_callback_arg(bio)))++;
+            return ret;
+        }
+
+        struct SslPipe{
+            int   fds[2]  { -1, -1 };
+            SSL*  srv     { nullptr };
+            SSL*  cli     { nullptr };
+
+            SslPipe(SSL_CTX* srvCtx, SSL_CTX* cliCtx, bool tcp = false) anyexcept{
+                if(tcp) loopbackPair();
+                else if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) throw InetException("Benchmark : socketpair error.");
+                srv = SSL_new(srvCtx);
+                cli = SSL_new(cliCtx);
+                SSL_set_fd(srv, fds[0]);
+                SSL_set_fd(cli, fds[1]);
+                SSL_set_accept_state(srv);
+                SSL_set_connect_state(cli);
+
+                Inet::setFdBlocking(fds[0], false);
+                Inet::setFdBlocking(fds[1], false);
+                bool srvDone { false },
+                     cliDone { false };
+                for(int round{0}; !(srvDone && cliDone) && round < 32; round++){
+                    if(!cliDone) cliDone = SSL_do_handshake(cli) == 1;
+                    if(!srvDone) srvDone = SSL_do_handshake(srv) == 1;
+                }
+                if(!(srvDone && cliDone)) throw InetException("Benchmark : handshake didn't complete.");
+                Inet::setFdBlocking(fds[0], true);
+                Inet::setFdBlocking(fds[1], true);
+            }
+
+            ~SslPipe(void) noexcept{
+                SSL_free(srv);
+                SSL_free(cli);
+                close(fds[0]);
+                close(fds[1]);
+            }
+
+            // MSG_ZEROCOPY needs a TCP socket: a connection over 127.0.0.1.
+            void loopbackPair(void) anyexcept{
+                SockaddrIn addr      {};
+                socklen_t  addrLen   { sizeof(addr) };
+                addr.sin_family      = AF_INET;
+                addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                int        listenFd  { socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+                if(listenFd == -1) throw InetException("Benchmark : socket error.");
+                fds[1] = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if(fds[1] == -1 || ::bind(listenFd, reinterpret_cast<Sockaddr*>(&addr), addrLen) == -1 || ::listen(listenFd, 1) == -1 ||
+                   getsockname(listenFd, reinterpret_cast<Sockaddr*>(&addr), &addrLen) == -1 ||
+                   connect(fds[1], reinterpret_cast<Sockaddr*>(&addr), addrLen) == -1 || (fds[0] = accept(listenFd, nullptr, nullptr)) == -1){
+                    close(listenFd);
+                    throw InetException("Benchmark : loopback connection error.");
+                }
+                close(listenFd);
+            }
+        };
+    }
+
+    void Benchmark::printList(void) noexcept{
+        cout << "Available benchmarks:\n"
+             << "  handshake  full TLS 1.3 handshakes per second for each certificate key type\n"
+             << "  cipher     TLS 1.3 AEAD throughput by packet size and the resulting suite order\n"
+             << "  eventloop  wakeup cost of the epoll, select and io_uring event loop backends\n"
+             << "  syscalls   syscalls per packet with and without TLS read-ahead and with the membio transport\n"
+             << "  zerocopy   membio sender cost with and without MSG_ZEROCOPY by flush size\n"
+             << "  forwarding TUN to TUN packet rate through two sessions, heap allocations in steady state\n"
+             << "  routes     longest prefix match lookup time by routing table size\n";
+    }
+
+    void Benchmark::run(const string& name) anyexcept{
+        if(name == "handshake") handshakes();
+        else if(name == "cipher") ciphers();
+        else if(name == "syscalls") syscalls();
+        else if(name == "eventloop") eventLoops();
+        else if(name == "zerocopy") zerocopy();
+        else if(name == "forwarding") forwarding();
+        else if(name == "routes") routeLookups();
+        else{
+            printList();
+            throw InetException(mergeStrings({"Benchmark::run : unknown benchmark : ", name}));
+        }
+    }
+
+    void Benchmark::handshakes(void) anyexcept{
+        const KeyType types[] { { "RSA-2048",   "RSA",     nullptr,  2048 },
+                                { "RSA-4096",   "RSA",     nullptr,  4096 },
+                                { "ECDSA-P256", "EC",      "P-256",  0    },
+                                { "ECDSA-P384", "EC",      "P-384",  0    },
+                                { "Ed25519",    "ED25519", nullptr,  0    } };
+
+        cout << "TLS 1.3 full handshakes, key exchange X25519, client and server in one thread\n\n"
+             << left  << setw(12) << "key type" 
+             << right << setw(14) << "handshakes/s" << setw(20) << "server cpu us/hs" << setw(22) << "server max hs/s/core"
+             << setw(18) << "ssl allocs/hs" << setw(16) << "pool hits %" << '\n';
+
+        for(const auto& type : types){
+            PkeyPtr  pkey   { makeKey(type) };
+            X509Ptr  cert   { makeCert(pkey.get()) };
+            CtxPtr   srvCtx { makeCtx(TLS_server_method(), "X25519") },
+                     cliCtx { makeCtx(TLS_client_method(), "X25519") };
+
+            if(SSL_CTX_use_certificate(srvCtx.get(), cert.get()) != 1 || SSL_CTX_use_PrivateKey(srvCtx.get(), pkey.get()) != 1)
+                throw InetException(mergeStrings({"Benchmark : can't load key : ", type.label}));
+
+            static_cast<void>(handshakeOnce(srvCtx.get(), cliCtx.get()));
+
+            SslAllocStats before  { SslAllocator::stats() };
+            uint64_t      count   { 0 },
+                          srvCpu  { 0 },
+                          begin   { monotonicUs() },
+                          elapsed { 0 };
+            do{
+                srvCpu  += handshakeOnce(srvCtx.get(), cliCtx.get());
+                count++;
+                elapsed  = monotonicUs() - begin;
+            }while(elapsed < BENCH_TIME_US);
+
+            double perSec  { static_cast<double>(count) * static_cast<double>(USEC_PER_SEC) / static_cast<double>(elapsed) };
+            double cpuPerHs{ static_cast<double>(srvCpu) / static_cast<double>(count) };
+            // Both peers allocate through the same pool: the counters cover client and server.
+            SslAllocStats after   { SslAllocator::stats() };
+            uint64_t      allocs  { after.allocs - before.allocs },
+                          hits    { after.cacheHits - before.cacheHits };
+            cout << left  << setw(12) << type.label << right << fixed << setprecision(1)
+                 << setw(14) << perSec << setw(20) << cpuPerHs 
+                 << setw(22) << (cpuPerHs > 0.0 ? static_cast<double>(USEC_PER_SEC) / cpuPerHs : 0.0)
+                 << setw(18) << static_cast<double>(allocs) / static_cast<double>(count)
+                 << setw(16) << (allocs == 0 ? 0.0 : static_cast<double>(hits) * 100.0 / static_cast<double>(allocs)) << '\n';
+        }
+    }
+
+    void Benchmark::ciphers(void) anyexcept{
+        const size_t sizes[] { 64, 512, 1400, 16384 };
+
+        cout << "TLS 1.3 AEAD seal throughput (MB/s), one record per packet\n\n"
+             << left << setw(20) << "cipher" << right;
+        for(const auto size : sizes) cout << setw(10) << size;
+        cout << '\n';
+
+        vector<vector<AeadResult>> bySize;
+        for(const auto size : sizes) bySize.push_back(CipherTuning::measure(size, BENCH_TIME_US / 4));
+
+        for(const auto& res : bySize.front()){
+            cout << left << setw(20) << res.cipher << right << fixed << setprecision(1);
+            for(const auto& row : bySize){
+                for(const auto& cell : row)
+                    if(string{cell.suite} == res.suite) cout << setw(10) << cell.mbPerSec;
+            }
+            cout << '\n';
+        }
+
+        cout << "\nauto suite order (1400 bytes packets): " << CipherTuning::suitesFrom(bySize[2]) << '\n';
+    }
+
+    // Bursts of 1400 bytes packets through a real socket, received as the data path does.
+    // The first row is the previous behaviour: no read-ahead, one SSL_read per wakeup.
+    void Benchmark::syscalls(void) anyexcept{
+        constexpr size_t   PACKET_LEN   { 1400 },
+                           BURST        { 16 },
+                           PACKETS      { 32000 };
+
+        struct Mode{
+            const char*    label;
+            size_t         readAhead;
+            bool           previous;
+            TLS_TRANSPORT  transport;
+        };
+        const Mode         modes[]      { { "previous (no drain)",     0,      true,  TRANSPORT_SOCKET },
+                                          { "drain, no read-ahead",    0,      false, TRANSPORT_SOCKET },
+                                          { "drain, read-ahead 16KB",  16384,  false, TRANSPORT_SOCKET },
+                                          { "drain, read-ahead 64KB",  65536,  false, TRANSPORT_SOCKET },
+                                          { "drain, read-ahead 256KB", 262144, false, TRANSPORT_SOCKET },
+                                          { "membio, 64KB chunks",     65536,  false, TRANSPORT_MEMBIO } };
+
+        KeyType            type         { "ECDSA-P256", "EC", "P-256", 0 };
+        PkeyPtr            pkey         { makeKey(type) };
+        X509Ptr            cert         { makeCert(pkey.get()) };
+        int                devNull      { open("/dev/null", O_WRONLY | O_CLOEXEC) };
+        if(devNull == -1) throw InetException("Benchmark : can't open /dev/null.");
+
+        vector<uint8_t>    frame(PACKET_LEN + FRAME_HEADER_LEN, 0),
+                           sink(TLS_MAX_RECORD);
+        putFrameHeader(frame.data(), FRAME_DATA, PACKET_LEN);
+
+        cout << "Syscalls per " << PACKET_LEN << " bytes packet, bursts of " << BURST << " packets\n\n"
+             << left  << setw(26) << "mode" << right << setw(12) << "tx writes" << setw(12) << "rx reads" << setw(12) << "wakeups" 
+             << setw(14) << "rx syscalls" << setw(10) << "kpkt/s" << '\n';
+
+        for(const auto& mode : modes){
+            CtxPtr       srvCtx    { makeCtx(TLS_server_method(), "X25519") },
+                         cliCtx    { makeCtx(TLS_client_method(), "X25519") };
+            if(SSL_CTX_use_certificate(srvCtx.get(), cert.get()) != 1 || SSL_CTX_use_PrivateKey(srvCtx.get(), pkey.get()) != 1)
+                throw InetException("Benchmark : can't load key.");
+            if(mode.readAhead != 0 && mode.transport == TRANSPORT_SOCKET){
+                SSL_CTX_set_read_ahead(srvCtx.get(), 1);
+                SSL_CTX_set_default_read_buffer_len(srvCtx.get(), mode.readAhead);
+            }
+
+            TunnelOptions opts     {};
+            opts.keepAliveMs       = 0;
+            opts.deadPeerMs        = 0;
+            opts.readAheadBytes    = static_cast<long>(mode.readAhead);
+            opts.transport         = mode.transport;
+
+            SslPipe     pipe   { srvCtx.get(), cliCtx.get() };
+            uint64_t    reads  { 0 },
+                        writes { 0 },
+                        wakeups{ 0 };
+            BIO_set_callback_arg(SSL_get_rbio(pipe.srv), reinterpret_cast<char*>(&reads));
+            BIO_set_callback_ex(SSL_get_rbio(pipe.srv), countReads);
+            BIO_set_callback_arg(SSL_get_wbio(pipe.cli), reinterpret_cast<char*>(&writes));
+            BIO_set_callback_ex(SSL_get_wbio(pipe.cli), countWrites);
+
+            // The sender mirrors the receiver transport: one sendmsg per burst with membio.
+            VpnSession  rx     { pipe.srv, pipe.fds[0], PACKET_LEN, opts, "bench" };
+            unique_ptr<BioChannel> tx { mode.transport == TRANSPORT_MEMBIO ? std::make_unique<BioChannel>(pipe.cli, pipe.fds[1], 0) : nullptr };
+            pollfd      pfd    { pipe.fds[0], POLLIN, 0 };
+            uint64_t    begin  { monotonicUs() };
+            for(size_t sent{0}; sent < PACKETS; sent += BURST){
+                for(size_t i{0}; i < BURST; i++)
+                    if(SSL_write(pipe.cli, frame.data(), static_cast<int>(frame.size())) <= 0) throw InetException("Benchmark : SSL_write error.");
+                if(tx) tx->flush();
+                while(poll(&pfd, 1, 0) > 0){
+                    wakeups++;
+                    if(mode.previous){
+                        if(SSL_read(pipe.srv, sink.data(), static_cast<int>(sink.size())) <= 0) throw InetException("Benchmark : SSL_read error.");
+                        if(write(devNull, sink.data(), PACKET_LEN) == -1) throw InetException("Benchmark : write error.");
+                    }else{
+                        if(rx.receive(devNull) != IO_OK) throw InetException("Benchmark : receive error.");
+                    }
+                }
+            }
+
+            uint64_t elapsed  { monotonicUs() - begin };
+            double   packets  { static_cast<double>(PACKETS) };
+            if(tx) writes = tx->getSocketWrites();
+            // The channel reads the socket itself, outside the counted BIO.
+            if(mode.transport == TRANSPORT_MEMBIO) reads = wakeups;
+            // Socket reads and poll wakeups, plus the TUN write each packet costs in any mode.
+            double   syscalls { static_cast<double>(reads + wakeups) + packets };
+            cout << left  << setw(26) << mode.label << right << fixed << setprecision(2)
+                 << setw(12) << static_cast<double>(writes) / packets << setw(12) << static_cast<double>(reads) / packets 
+                 << setw(12) << static_cast<double>(wakeups) / packets << setw(14) << syscalls / packets 
+                 << setw(10) << setprecision(1) << packets * 1000.0 / static_cast<double>(elapsed) << '\n';
+        }
+        close(devNull);
+    }
+
+    // Many idle descriptors, few active ones per pass: the VPN server shape.
+    void Benchmark::eventLoops(void) anyexcept{
+        constexpr size_t   PAIRS    { 256 },
+                           ACTIVE   { 8 },
+                           ROUNDS   { 50000 };
+        vector<std::array<int, 2>> pairs(PAIRS);
+        for(auto& pair : pairs){
+            if(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pair.data()) == -1) 
+                throw InetException("Benchmark : socketpair error.");
+        }
+
+        cout << PAIRS << " registered descriptors, " << ACTIVE << " ready per pass\n\n"
+             << left << setw(12) << "backend" << right << setw(14) << "us/pass" << setw(14) << "waits/pass" 
+             << setw(16) << "kevents/s" << '\n';
+
+        vector<EVENT_BACKEND> backends { BACKEND_EPOLL, BACKEND_SELECT };
+        if(UringLoop::available()) backends.push_back(BACKEND_URING);
+        else                       cout << "(io_uring not available)\n";
+
+        // The io_uring readers row: the loop reads the datagrams itself, no read() per descriptor.
+        for(size_t run{0}; run <= backends.size(); run++){
+            bool                        readers { run == backends.size() };
+            if(readers && !UringLoop::available()) break;
+            unique_ptr<EventLoop>       loop    { EventLoop::create(readers ? BACKEND_URING : backends[run]) };
+            std::array<IoEvent, 64>     events;
+            std::array<ReadBuffer, 64>  reads;
+            char                        byte    { 'x' };
+            if(readers && !loop->addReader(pairs[0][0], 0, sizeof(byte), reads.size())){
+                cout << "(io_uring readers not available)\n";
+                break;
+            }
+            for(size_t pair{readers ? 1U : 0U}; pair < PAIRS; pair++){
+                if(!readers || !loop->addReader(pairs[pair][0], 0, sizeof(byte), reads.size())) loop->add(pairs[pair][0], EV_READ);
+            }
+
+            uint64_t  waits { 0 },
+                      begin { monotonicUs() };
+            for(size_t round{0}; round < ROUNDS; round++){
+                for(size_t i{0}; i < ACTIVE; i++)
+                    if(write(pairs[(round * ACTIVE + i * 31) % PAIRS][1], &byte, 1) != 1) throw InetException("Benchmark : write error.");
+                for(size_t gathered{0}; gathered < ACTIVE; ){
+                    size_t ready { loop->wait(events.data(), events.size(), USEC_PER_SEC) };
+                    waits++;
+                    for(size_t i{0}; i < ready; i++){
+                        if(readers){
+                            gathered += loop->takeReads(events[i].fd, reads.data(), reads.size());
+                            loop->releaseReads(events[i].fd);
+                        }else{
+                            while(read(events[i].fd, &byte, 1) == 1) gathered++;
+                        }
+                    }
+                }
+            }
+            double elapsed { static_cast<double>(monotonicUs() - begin) };
+            cout << left << setw(12) << (readers ? "io_uring+rd" : loop->name()) << right << fixed << setprecision(2)
+                 << setw(14) << elapsed / static_cast<double>(ROUNDS) << setw(14) << static_cast<double>(waits) / static_cast<double>(ROUNDS)
+                 << setw(16) << setprecision(1) << static_cast<double>(ROUNDS * ACTIVE) * 1000.0 / elapsed << '\n';
+            for(const auto& pair : pairs) loop->remove(pair[0]);
+        }
+
+        for(const auto& pair : pairs){
+            close(pair[0]);
+            close(pair[1]);
+        }
+    }
+
+    // Full 16KB records flushed in batches of several sizes, to a child process discarding 
+    // the ciphertext. Only the sender CPU is measured: the copy MSG_ZEROCOPY avoids is there.
+    void Benchmark::zerocopy(void) anyexcept{
+        constexpr size_t   RECORD_LEN   { TLS_MAX_RECORD },
+                           TOTAL        { 256UL * 1024 * 1024 };
+        const size_t       flushes[]    { 16384, 65536, 262144, 1048576 };
+
+        KeyType            type         { "ECDSA-P256", "EC", "P-256", 0 };
+        PkeyPtr            pkey         { makeKey(type) };
+        X509Ptr            cert         { makeCert(pkey.get()) };
+        vector<uint8_t>    record(RECORD_LEN, 0);
+
+        cout << "Sender cost of " << TOTAL / (1024 * 1024) << "MB in 16KB TLS records over TCP loopback, membio transport\n\n"
+             << right << setw(12) << "flush bytes" << setw(12) << "copy MB/s" << setw(14) << "copy cpu/MB" 
+             << setw(12) << "zc MB/s" << setw(14) << "zc cpu/MB" << setw(12) << "zc sends" << setw(12) << "copied %" << '\n';
+
+        for(const auto flush : flushes){
+            cout << setw(12) << flush << fixed << setprecision(1);
+            for(const bool zc : { false, true }){
+                CtxPtr       srvCtx    { makeCtx(TLS_server_method(), "X25519") },
+                             cliCtx    { makeCtx(TLS_client_method(), "X25519") };
+                if(SSL_CTX_use_certificate(srvCtx.get(), cert.get()) != 1 || SSL_CTX_use_PrivateKey(srvCtx.get(), pkey.get()) != 1)
+                    throw InetException("Benchmark : can't load key.");
+                SslPipe      pipe      { srvCtx.get(), cliCtx.get(), true };
+
+                pid_t sink { fork() };
+                if(sink == -1) throw InetException("Benchmark : fork error.");
+                if(sink == 0){
+                    close(pipe.fds[1]);
+                    vector<uint8_t> buff(1024 * 1024);
+                    while(recv(pipe.fds[0], buff.data(), buff.size(), 0) > 0){}
+                    _exit(0);
+                }
+
+                BioChannel   tx        { pipe.cli, pipe.fds[1], 0, zc ? size_t{1} : size_t{0} };
+                uint64_t     cpu       { threadCpuUs() },
+                             begin     { monotonicUs() };
+                for(size_t sent{0}; sent < TOTAL; ){
+                    for(size_t batch{0}; batch < flush; batch += RECORD_LEN, sent += RECORD_LEN)
+                        if(SSL_write(pipe.cli, record.data(), static_cast<int>(record.size())) <= 0) throw InetException("Benchmark : SSL_write error.");
+                    tx.flush();
+                }
+                cpu = threadCpuUs() - cpu;
+                shutdown(pipe.fds[1], SHUT_WR);
+                static_cast<void>(waitpid(sink, nullptr, 0));
+
+                double   elapsed { static_cast<double>(monotonicUs() - begin) },
+                         mbytes  { static_cast<double>(TOTAL) / (1024.0 * 1024.0) };
+                cout << setw(12) << mbytes * static_cast<double>(USEC_PER_SEC) / elapsed << setw(14) << static_cast<double>(cpu) / mbytes;
+                if(zc){
+                    double sends { static_cast<double>(tx.getZerocopySends()) };
+                    cout << setw(12) << tx.getZerocopySends() << setw(12) << (sends > 0.0 ? static_cast<double>(tx.getZerocopyCopied()) * 100.0 / sends : 0.0);
+                }
+            }
+            cout << '\n';
+        }
+        cout << "\ncpu in usec. Over loopback the kernel copies zerocopy sends anyway (copied %) and the channel\n"
+             << "falls back to copying: the zc columns then show the bookkeeping cost, the saving needs a NIC path.\n";
+    }
+
+    // The client and server data paths back to back in one thread: TUN batch, coalescing,
+    // TLS, frame parsing and TUN write, with datagram socketpairs standing in for the TUN
+    // devices. The warmup fills the TLS buffers, the pools and the channel queues; after it,
+    // a build with --enable-alloc-check fails on any heap allocation while forwarding.
+    void Benchmark::forwarding(void) anyexcept{
+        constexpr size_t   PACKET_LEN   { 1400 },
+                           BURST        { 16 },
+                           WARMUP       { 4096 },
+                           PACKETS      { 64000 };
+        const TLS_TRANSPORT transports[] { TRANSPORT_SOCKET, TRANSPORT_MEMBIO };
+
+        KeyType            type         { "ECDSA-P256", "EC", "P-256", 0 };
+        PkeyPtr            pkey         { makeKey(type) };
+        X509Ptr            cert         { makeCert(pkey.get()) };
+        vector<uint8_t>    packet(PACKET_LEN, 0),
+                           sink(FRAME_MAX_PAYLOAD);
+        string             failures;
+        // IPv4 header, so the receiving session learns the inner address as it does in service.
+        packet[0]  = 0x45;
+        packet[12] = 10;
+        packet[15] = 2;
+
+        cout << "Forwarding " << PACKETS << " packets of " << PACKET_LEN << " bytes, bursts of " << BURST << ", client and server in one thread\n\n"
+             << left  << setw(12) << "transport" << right << setw(10) << "kpkt/s" << setw(12) << "delivered" 
+             << setw(14) << "heap allocs" << setw(14) << "ssl allocs" << '\n';
+
+        for(const auto transport : transports){
+            CtxPtr       srvCtx    { makeCtx(TLS_server_method(), "X25519") },
+                         cliCtx    { makeCtx(TLS_client_method(), "X25519") };
+            if(SSL_CTX_use_certificate(srvCtx.get(), cert.get()) != 1 || SSL_CTX_use_PrivateKey(srvCtx.get(), pkey.get()) != 1)
+                throw InetException("Benchmark : can't load key.");
+
+            SslPipe      pipe      { srvCtx.get(), cliCtx.get() };
+            int          cliTun[2] { -1, -1 },
+                         srvTun[2] { -1, -1 };
+            if(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, cliTun) == -1 ||
+               socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, srvTun) == -1) 
+                throw InetException("Benchmark : socketpair error.");
+
+            TunnelOptions opts     {};
+            opts.transport         = transport;
+            opts.flushDeadlineUs   = 0;
+
+            TunBatch    batch  { static_cast<size_t>(opts.tunBatch), PACKET_LEN, static_cast<size_t>(opts.tunBudget) };
+            VpnSession  tx     { pipe.cli, pipe.fds[1], PACKET_LEN, opts, "bench-tx" },
+                        rx     { pipe.srv, pipe.fds[0], PACKET_LEN, opts, "bench-rx" };
+            pollfd      pfd    { pipe.fds[0], POLLIN, 0 };
+            tx.start(monotonicUs());
+            rx.start(monotonicUs());
+
+            auto forward { [&](size_t count) -> size_t {
+                size_t delivered { 0 };
+                for(size_t sent{0}; sent < count; sent += BURST){
+                    for(size_t i{0}; i < BURST; i++)
+                        if(write(cliTun[1], packet.data(), packet.size()) == -1) throw InetException("Benchmark : TUN write error.");
+                    uint64_t  now     { monotonicUs() };
+                    size_t    packets { 0 };
+                    IO_STATUS status  { tx.timers(now) };
+                    if(status == IO_OK) status = batch.drain(cliTun[0], packets);
+                    for(size_t pkt{0}; pkt < packets && status == IO_OK; pkt++) status = tx.sendPacket(batch.frame(pkt), batch.length(pkt));
+                    if(status == IO_OK) status = tx.flush(now);
+                    while(status == IO_OK && poll(&pfd, 1, 0) > 0) status = rx.receive(srvTun[0]);
+                    now = monotonicUs();
+                    if(status == IO_OK) status = rx.timers(now);
+                    if(status == IO_OK) status = rx.flush(now);
+                    if(status != IO_OK) throw InetException(mergeStrings({"Benchmark : forwarding error : ", ioStatusText(status)}));
+                    while(read(srvTun[1], sink.data(), sink.size()) > 0) delivered++;
+                }
+                return delivered;
+            } };
+
+            static_cast<void>(forward(WARMUP));
+            SslAllocStats before    { SslAllocator::stats() };
+            uint64_t      begin     { monotonicUs() };
+            AllocTracker::arm();
+            size_t        delivered { forward(PACKETS) };
+            uint64_t      allocs    { AllocTracker::disarm() },
+                          elapsed   { monotonicUs() - begin },
+                          sslAllocs { SslAllocator::stats().allocs - before.allocs };
+            for(int fd : { cliTun[0], cliTun[1], srvTun[0], srvTun[1] }) close(fd);
+
+            const char* label { transport == TRANSPORT_MEMBIO ? "membio" : "socket" };
+            cout << left  << setw(12) << label << right << fixed << setprecision(1)
+                 << setw(10) << static_cast<double>(PACKETS) * 1000.0 / static_cast<double>(elapsed) << setw(12) << delivered
+                 << setw(14) << (AllocTracker::enabled() ? to_string(allocs) : string{"n/a"})
+                 << setw(14) << (SslAllocator::installed() ? to_string(sslAllocs) : string{"n/a"}) << '\n';
+            if(AllocTracker::enabled() && allocs != 0)
+                failures.append(mergeStrings({" ", label, ": ", to_string(allocs), " (last ", to_string(AllocTracker::lastSize()), " bytes)"}));
+        }
+
+        if(!AllocTracker::enabled()) cout << "\nheap allocations are counted by builds configured with --enable-alloc-check.\n";
+        if(!failures.empty()) throw InetException(mergeStrings({"Benchmark::forwarding : allocations in steady state :", failures}));
+    }
+
+    // Random prefixes shaped like an Internet table: mostly /24, then /16 to /23, a few host 
+    // routes. Half the destinations fall in a routed prefix, half are random addresses.
+    void Benchmark::routeLookups(void) anyexcept{
+        constexpr size_t   HOPS     { 256 },
+                           ADDRS    { 1 << 20 },
+                           ROUNDS   { 16 };
+        const size_t       sizes[]  { 1000, 10000, 50000 };
+        mt19937            random   { 42 };
+        uniform_int_distribution<uint32_t> anyAddr;
+        uniform_int_distribution<int>      shape    { 0, 99 };
+
+        cout << left << setw(10) << "routes" << right << setw(14) << "insert ns" << setw(14) << "lookup ns" 
+             << setw(14) << "Mlookups/s" << setw(10) << "hit %" << '\n';
+
+        for(size_t count : sizes){
+            RouteTable     table;
+            vector<Prefix> prefixes;
+            vector<uint32_t> hops;
+            for(size_t hop{0}; hop < HOPS; hop++){
+                hops.push_back(table.hopForAddr(static_cast<uint32_t>(hop + 1)));
+                static_cast<void>(table.bind(hops.back(), static_cast<int>(hop)));
+            }
+            while(prefixes.size() < count){
+                int      pick { shape(random) };
+                uint8_t  len  { static_cast<uint8_t>(pick < 60 ? 24 : pick < 95 ? 16 + pick % 8 : 25 + pick % 8) };
+                prefixes.push_back(Prefix{ anyAddr(random) & prefixMask(len), len });
+            }
+
+            uint64_t begin { monotonicUs() };
+            for(size_t idx{0}; idx < prefixes.size(); idx++)
+                static_cast<void>(table.insert(prefixes[idx], hops[idx % HOPS], ROUTE_STATIC));
+            double   insert { static_cast<double>(monotonicUs() - begin) * 1000.0 / static_cast<double>(count) };
+
+            vector<uint32_t> addrs(ADDRS);
+            for(size_t idx{0}; idx < ADDRS; idx++){
+                const Prefix& prefix { prefixes[anyAddr(random) % count] };
+                addrs[idx] = idx % 2 == 0 ? prefix.addr | (anyAddr(random) & ~prefixMask(prefix.len)) : anyAddr(random);
+            }
+
+            uint64_t hits  { 0 };
+            begin          = monotonicUs();
+            for(size_t round{0}; round < ROUNDS; round++)
+                for(uint32_t addr : addrs) hits += table.resolve(addr) >= 0 ? 1 : 0;
+            double   elapsed { static_cast<double>(monotonicUs() - begin) * 1000.0 };
+            double   lookups { static_cast<double>(ADDRS * ROUNDS) };
+
+            cout << left << setw(10) << table.size() << right << fixed << setprecision(1) << setw(14) << insert 
+                 << setw(14) << setprecision(2) << elapsed / lookups << setw(14) << setprecision(1) << lookups * 1000.0 / elapsed 
+                 << setw(10) << static_cast<double>(hits) * 100.0 / lookups << '\n';
+            cout << "  " << table.report() << '\n';
+        }
+    }
+
+} // End namespace
@@ -0,0 +1,426 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstring>
+#include <algorithm>
+
+#include <bioChannel.hpp>
+#include <inetgeneral.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::min,
+          std::max,
+          std::unique_ptr,
+          stringutils::mergeStrings,
+          timeutils::monotonicUs;
+
+    BioChannel::BioChannel(SSL* ssl, int fd, size_t readChunk, size_t zerocopyMin) anyexcept
+        : bio { BIO_new(method()) }, sockFd { fd }, inbound(max(readChunk, SEGMENT_LEN)), zcMin { zerocopyMin }
+    {
+        if(bio == nullptr) throw InetException("BioChannel::BioChannel : BIO_new error.");
+        // Every segment buffer is either in the chain, pinned or spare: recycling never reallocates.
+        spare.reserve(MAX_SEGMENTS + MAX_PINNED);
+        // Without kernel support (or not TCP) the copy path is used.
+        if(int on { 1 }; zcMin != 0 && setsockopt(sockFd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == -1) zcMin = 0;
+        // Ready beforehand: the destructor hands its pinned buffers over without allocating.
+        if(zcMin != 0){
+            grave = std::make_unique<Grave>();
+            grave->buffers.reserve(MAX_SEGMENTS + MAX_PINNED);
+        }
+        BIO_set_data(bio, this);
+        BIO_set_init(bio, 1);
+        // The SSL object and the channel both hold a reference: whichever goes first, the other stays valid.
+        BIO_up_ref(bio);
+        SSL_set_bio(ssl, bio, bio);
+    }
+
+    // The socket must still be open: segments zerocopy sends still reference go to the graveyard.
+    BioChannel::~BioChannel(void) noexcept{
+        BIO_set_data(bio, nullptr);
+        BIO_free(bio);
+        if(pinCount != 0) reap();
+        bury();
+    }
+
+    // Until its completion the kernel reads the pages of a zerocopy send, closed socket or not: 
+    // freed, they could carry another session's data (or keys) to this peer. They wait with a 
+    // duplicate of the socket, shut down so the peer still sees the connection close, which 
+    // keeps the completions readable. Without a duplicate the owner's close aborts the connection.
+    void BioChannel::bury(void) noexcept{
+        if(!grave) return;
+        for(; pinCount != 0; pinHead = (pinHead + 1) % MAX_PINNED, pinCount--)
+            grave->buffers.push_back(std::move(pinned[pinHead].data));
+        for(size_t i{0}; i < used; i++)
+            if(chain[i].zc) grave->buffers.push_back(std::move(chain[i].data));
+        if(grave->buffers.empty()) return;
+
+        grave->lastId   = zcNext - 1;
+        grave->done     = zcDone;
+        grave->deadline = monotonicUs() + GRAVE_WAIT_US;
+        grave->fd       = fcntl(sockFd, F_DUPFD_CLOEXEC, 0);
+        if(grave->fd == -1){
+            abort(sockFd);
+            grave->deadline = monotonicUs() + GRAVE_GRACE_US;
+        }else{
+            static_cast<void>(shutdown(grave->fd, SHUT_RDWR));
+        }
+        grave->next = std::move(graveyard);
+        graveyard   = std::move(grave);
+    }
+
+    // RST instead of FIN: the kernel drops its queue, and its references, at close.
+    void BioChannel::abort(int fd) noexcept{
+        struct linger lng { 1, 0 };
+        static_cast<void>(setsockopt(fd, SOL_SOCKET, SO_LINGER, &lng, sizeof(lng)));
+    }
+
+    // Buffers are freed once their last send completes. A peer that doesn't acknowledge them
+    // within GRAVE_WAIT_US gets its connection aborted, and the buffers go after a grace time
+    // for the device to release them. The return value is the delay until the next call.
+    uint64_t BioChannel::reapClosed(uint64_t now) noexcept{
+        uint64_t next { UINT64_MAX };
+        for(unique_ptr<Grave>* link { &graveyard }; *link; ){
+            Grave& dead { **link };
+            if(dead.fd != -1){
+                uint64_t completed { 0 },
+                         copied    { 0 };
+                readCompletions(dead.fd, dead.done, completed, copied);
+                bool     complete  { static_cast<int32_t>(dead.done - dead.lastId) > 0 };
+                if(complete || now >= dead.deadline){
+                    if(!complete) abort(dead.fd);
+                    close(dead.fd);
+                    dead.fd       = -1;
+                    dead.deadline = complete ? now : now + GRAVE_GRACE_US;
+                }
+            }
+            if(dead.fd == -1 && now >= dead.deadline){
+                *link = std::move(dead.next);
+                continue;
+            }
+            next = min(next, dead.fd != -1 ? min(GRAVE_POLL_US, dead.deadline - now) : dead.deadline - now);
+            link = &dead.next;
+        }
+        return next;
+    }
+
+    BIO_METHOD* BioChannel::method(void) anyexcept{
+        static BIO_METHOD* chainMethod {
+            [](){
+                BIO_METHOD* meth { BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "nnvpn chain") };
+                if(meth == nullptr) throw InetException("BioChannel::method : BIO_meth_new error.");
+                BIO_meth_set_write_ex(meth, bioWrite);
+                BIO_meth_set_read_ex(meth, bioRead);
+                BIO_meth_set_ctrl(meth, bioCtrl);
+                BIO_meth_set_create(meth, bioCreate);
+                BIO_meth_set_destroy(meth, bioDestroy);
+                return meth;
+            }()
+        };
+        return chainMethod;
+    }
+
+    // False on a socket error. Less than len copied: the chain is full until the socket takes more.
+    bool BioChannel::queue(const char* data, size_t len, size_t& copied) noexcept{
+        copied = 0;
+        while(copied < len){
+            if(used == 0 || chain[used - 1].len == SEGMENT_LEN){
+                // A full chain goes out right away, from inside SSL_write.
+                if(used >= segLimit){
+                    if(!drain()) return false;
+                    if(used >= segLimit) return true;
+                }
+                Segment& seg { chain[used++] };
+                if(seg.data.empty()){
+                    if(spare.empty()){
+                        seg.data.resize(SEGMENT_LEN);
+                    }else{
+                        seg.data = std::move(spare.back());
+                        spare.pop_back();
+                    }
+                }
+                seg.len = 0;
+            }
+            Segment& seg   { chain[used - 1] };
+            size_t   chunk { min(len - copied, SEGMENT_LEN - seg.len) };
+            memcpy(seg.data.data() + seg.len, data + copied, chunk);
+            seg.len += chunk;
+            copied  += chunk;
+        }
+        return true;
+    }
+
+    size_t BioChannel::queuedBytes(void) const noexcept{
+        size_t queued { 0 };
+        for(size_t i{0}; i < used; i++) queued += chain[i].len;
+        return queued - headOff;
+    }
+
+    // False on a socket error only: what a full socket doesn't take waits, in order, for the next call.
+    bool BioChannel::drain(void) noexcept{
+        if(pinCount != 0) reap();
+
+        // Below the threshold, or with too many segments waiting for completions, copying is cheaper.
+        int    flags  { zcMin != 0 && queuedBytes() >= zcMin && pinCount + used <= MAX_PINNED ? MSG_NOSIGNAL | MSG_ZEROCOPY : MSG_NOSIGNAL };
+
+        while(used != 0){
+            for(size_t i{0}; i < used; i++){
+                iov[i].iov_base = chain[i].data.data() + (i == 0 ? headOff : 0);
+                iov[i].iov_len  = chain[i].len - (i == 0 ? headOff : 0);
+            }
+            msghdr  msg   {};
+            msg.msg_iov    = iov.data();
+            msg.msg_iovlen = used;
+            ssize_t sent { sendmsg(sockFd, &msg, flags) };
+            if(sent == -1){
+                if(errno == EINTR) continue;
+                // Out of pinnable memory (optmem): this flush is copied.
+                if(errno == ENOBUFS && (flags & MSG_ZEROCOPY) != 0){
+                    flags &= ~MSG_ZEROCOPY;
+                    zcFallbacks++;
+                    continue;
+                }
+                if(errno == EAGAIN || errno == EWOULDBLOCK) return true;
+                retire(used);
+                return false;
+            }
+            sockWrites++;
+            // Every segment this sendmsg touched, even in part, is referenced by its completion.
+            bool     zc   { (flags & MSG_ZEROCOPY) != 0 };
+            uint32_t id   { zcNext };
+            size_t   done { 0 };
+            if(zc){
+                zcNext++;
+                zcSends++;
+            }
+            for(size_t left { static_cast<size_t>(sent) }; left > 0; ){
+                Segment& seg       { chain[done] };
+                size_t   remaining { seg.len - headOff };
+                if(zc){
+                    seg.zc   = true;
+                    seg.zcId = id;
+                }
+                if(left < remaining){
+                    headOff += left;
+                    break;
+                }
+                left   -= remaining;
+                headOff = 0;
+                done++;
+            }
+            retire(done);
+        }
+        return true;
+    }
+
+    // Sent segments go back to the free end of the chain, unless a zerocopy sendmsg still 
+    // references them: those wait in the pinned ring for its completion. drain() only sends 
+    // zerocopy while everything it could pin fits in the ring.
+    void BioChannel::retire(size_t count) noexcept{
+        for(size_t i{0}; i < count; i++){
+            Segment& seg { chain[i] };
+            if(seg.zc){
+                Pinned& slot { pinned[(pinHead + pinCount++) % MAX_PINNED] };
+                slot.id      = seg.zcId;
+                slot.data    = std::move(seg.data);
+                seg.data     = {};
+            }
+            seg.len = 0;
+            seg.zc  = false;
+        }
+        std::rotate(chain.begin(), chain.begin() + static_cast<std::ptrdiff_t>(count), chain.begin() + static_cast<std::ptrdiff_t>(used));
+        used        -= count;
+        flushedSegs += count;
+        if(used == 0) headOff = 0;
+    }
+
+    // Completions arrive on the error queue as ranges of sendmsg ids, in order for TCP.
+    void BioChannel::readCompletions(int fd, uint32_t& done, uint64_t& completed, uint64_t& copied) noexcept{
+        for(;;){
+            char    control[CMSG_SPACE(sizeof(sock_extended_err)) + 64];
+            msghdr  msg        {};
+            msg.msg_control    = control;
+            msg.msg_controllen = sizeof(control);
+            if(recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) break;
+
+            for(cmsghdr* cm { CMSG_FIRSTHDR(&msg) }; cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)){
+                if(!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) || 
+                     (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) continue;
+                sock_extended_err err {};
+                memcpy(&err, CMSG_DATA(cm), sizeof(err));
+                if(err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+                uint32_t range { err.ee_data - err.ee_info + 1 };
+                completed     += range;
+                if((err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0) copied += range;
+                done           = err.ee_data + 1;
+            }
+        }
+    }
+
+    void BioChannel::reap(void) noexcept{
+        readCompletions(sockFd, zcDone, zcCompleted, zcCopied);
+        while(pinCount != 0 && static_cast<int32_t>(zcDone - pinned[pinHead].id) > 0){
+            spare.push_back(std::move(pinned[pinHead].data));
+            pinHead = (pinHead + 1) % MAX_PINNED;
+            pinCount--;
+        }
+        // The kernel copied anyway (e.g. loopback or a device without scatter-gather):
+        // pinning is pure overhead, so the copy path is used from now on.
+        if(zcCompleted >= ZC_PROBE && zcCopied * 2 > zcCompleted) zcMin = 0;
+    }
+
+    void BioChannel::flush(void) anyexcept{
+        if(used != 0 && !drain())
+            throw InetException(mergeStrings({"BioChannel::flush : sendmsg error : ", strerror(errno)}));
+    }
+
+    bool BioChannel::flushQuiet(void) noexcept{
+        return used == 0 || drain();
+    }
+
+    // Ciphertext queued past the limit leaves from inside SSL_write, without waiting the end of the pass.
+    void BioChannel::setQueueLimit(size_t bytes) noexcept{
+        segLimit = std::clamp<size_t>((bytes + SEGMENT_LEN - 1) / SEGMENT_LEN, 1, MAX_SEGMENTS);
+    }
+
+    // IO_AGAIN: nothing new, or the buffer is full until the records in it are consumed.
+    IO_STATUS BioChannel::fill(void) noexcept{
+        // Completions make the socket report an error condition until they are read.
+        if(pinCount != 0) reap();
+        if(inHead == inTail){
+            inHead = inTail = 0;
+        }else if(inHead != 0){
+            memmove(inbound.data(), inbound.data() + inHead, inTail - inHead);
+            inTail -= inHead;
+            inHead  = 0;
+        }
+        if(inTail == inbound.size()) return IO_AGAIN;
+
+        ssize_t got { recv(sockFd, inbound.data() + inTail, inbound.size() - inTail, MSG_DONTWAIT) };
+        if(got == 0) return IO_CLOSED;
+        if(got == -1) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? IO_AGAIN : IO_SOCKET_ERROR;
+        sockReads++;
+        inTail += static_cast<size_t>(got);
+        return IO_OK;
+    }
+
+    bool BioChannel::pendingOutput(void) const noexcept{
+        return used != 0;
+    }
+
+    bool BioChannel::pendingInput(void) const noexcept{
+        return inHead != inTail;
+    }
+
+    uint64_t BioChannel::getSocketReads(void) const noexcept{
+        return sockReads;
+    }
+
+    uint64_t BioChannel::getSocketWrites(void) const noexcept{
+        return sockWrites;
+    }
+
+    uint64_t BioChannel::getZerocopySends(void) const noexcept{
+        return zcSends;
+    }
+
+    uint64_t BioChannel::getZerocopyCopied(void) const noexcept{
+        return zcCopied;
+    }
+
+    string BioChannel::report(void) const anyexcept{
+        return mergeStrings({ "sock_reads=",      to_string(sockReads),
+                              " sock_writes=",    to_string(sockWrites),
+                              " flushed_segs=",   to_string(flushedSegs),
+                              " zc_sends=",       to_string(zcSends),
+                              " zc_completed=",   to_string(zcCompleted),
+                              " zc_copied=",      to_string(zcCopied),
+                              " zc_fallbacks=",   to_string(zcFallbacks),
+                              " zc_pinned=",      to_string(pinCount) });
+    }
+
+    TLS_TRANSPORT BioChannel::transportFromName(const string& name) anyexcept{
+        if(name == "socket") return TRANSPORT_SOCKET;
+        if(name == "membio") return TRANSPORT_MEMBIO;
+        throw InetException(mergeStrings({"BioChannel::transportFromName : unknown transport : ", name}));
+    }
+
+    int BioChannel::bioWrite(BIO* b, const char* data, size_t len, size_t* written){
+        auto*  channel { static_cast<BioChannel*>(BIO_get_data(b)) };
+        size_t copied  { 0 };
+        BIO_clear_retry_flags(b);
+        if(channel == nullptr || !channel->queue(data, len, copied)) return 0;
+        if(copied == 0){
+            BIO_set_retry_write(b);
+            return 0;
+        }
+        *written = copied;
+        return 1;
+    }
+
+    int BioChannel::bioRead(BIO* b, char* data, size_t len, size_t* readBytes){
+        auto* channel { static_cast<BioChannel*>(BIO_get_data(b)) };
+        BIO_clear_retry_flags(b);
+        if(channel == nullptr) return 0;
+        if(channel->inHead == channel->inTail){
+            BIO_set_retry_read(b);
+            return 0;
+        }
+        size_t chunk { min(len, channel->inTail - channel->inHead) };
+        memcpy(data, channel->inbound.data() + channel->inHead, chunk);
+        channel->inHead += chunk;
+        *readBytes       = chunk;
+        return 1;
+    }
+
+    long BioChannel::bioCtrl(BIO* b, int cmd, long, void*){
+        auto* channel { static_cast<BioChannel*>(BIO_get_data(b)) };
+        switch(cmd){
+            case BIO_CTRL_FLUSH:
+            case BIO_CTRL_PUSH:
+            case BIO_CTRL_POP:
+                return 1;
+            case BIO_CTRL_PENDING:
+                return channel == nullptr ? 0 : static_cast<long>(channel->inTail - channel->inHead);
+            case BIO_CTRL_WPENDING:
+                return channel == nullptr ? 0 : static_cast<long>(channel->queuedBytes());
+            default:
+                return 0;
+        }
+    }
+
+    int BioChannel::bioCreate(BIO* b){
+        BIO_set_init(b, 0);
+        return 1;
+    }
+
+    int BioChannel::bioDestroy(BIO* b){
+        BIO_set_data(b, nullptr);
+        return 1;
+    }
+
+} // End namespace
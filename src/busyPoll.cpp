@@ -0,0 +1,75 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <algorithm>
+
+#include <busyPoll.hpp>
+#include <StringUtils.hpp>
+#include <timeUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::max,
+          stringutils::mergeStrings,
+          timeutils::monotonicUs;
+
+    BusyPoll::BusyPoll(uint64_t budgetUs) noexcept
+        : budget { budgetUs }, window { budgetUs }
+    {}
+
+    // 0 polls, anything else is the usual blocking wait bounded by the timers.
+    uint64_t BusyPoll::timeout(uint64_t now, uint64_t blockUs) noexcept{
+        if(spinning && now < spinUntil){
+            polls++;
+            return 0;
+        }
+        if(spinning){
+            spinning = false;
+            if(windowHits == 0){
+                window = max(budget >> MIN_SHIFT, window / 2);
+                shrinks++;
+            }else{
+                window = budget;
+            }
+        }
+        blocks++;
+        return blockUs;
+    }
+
+    void BusyPoll::onWake(size_t ready) noexcept{
+        if(budget == 0 || ready == 0) return;
+        if(spinning){
+            hits++;
+            windowHits++;
+        }else{
+            spinning   = true;
+            windowHits = 0;
+        }
+        spinUntil = monotonicUs() + window;
+    }
+
+    string BusyPoll::report(void) const anyexcept{
+        return mergeStrings({ "BUSY POLL STATS : window_us=", to_string(window),
+                              " polls=",   to_string(polls),
+                              " hits=",    to_string(hits),
+                              " blocks=",  to_string(blocks),
+                              " shrinks=", to_string(shrinks) });
+    }
+
+} // End namespace
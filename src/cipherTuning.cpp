@@ -0,0 +1,175 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <sys/utsname.h>
+
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+
+#include <cipherTuning.hpp>
+#include <inetgeneral.hpp>
+#include <StringUtils.hpp>
+#include <timeUtils.hpp>
+#include <debug.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::vector,
+          std::ifstream,
+          std::ofstream,
+          std::getline,
+          std::unique_ptr,
+          std::stable_sort,
+          std::to_string,
+          stringutils::mergeStrings,
+          timeutils::monotonicUs,
+          debugmode::Debug,
+          debugmode::DEBUG_MODE;
+
+    namespace {
+        constexpr size_t    TUNING_PACKET_LEN { 1400 };
+        constexpr uint64_t  TUNING_BUDGET_US  { 20000 };
+        constexpr size_t    AEAD_KEY_LEN      { 32 },
+                            AEAD_IV_LEN       { 12 },
+                            AEAD_TAG_LEN      { 16 },
+                            TLS_AAD_LEN       { 5 };
+
+        const AeadResult CANDIDATES[] { { "TLS_AES_128_GCM_SHA256",       "AES-128-GCM",       0.0 },
+                                        { "TLS_AES_256_GCM_SHA384",       "AES-256-GCM",       0.0 },
+                                        { "TLS_CHACHA20_POLY1305_SHA256", "ChaCha20-Poly1305", 0.0 } };
+
+        using CipherPtr    = unique_ptr<EVP_CIPHER,     decltype(&EVP_CIPHER_free)>;
+        using CipherCtxPtr = unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)>;
+
+        // Seals packetLen bytes per iteration like a TLS record: fresh nonce, header as AAD, tag.
+        double sealThroughput(const char* cipherName, size_t packetLen, uint64_t budgetUs) anyexcept{
+            CipherPtr     cipher { EVP_CIPHER_fetch(nullptr, cipherName, nullptr), EVP_CIPHER_free };
+            if(!cipher) return 0.0;
+            CipherCtxPtr  ctx    { EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free };
+            if(!ctx) throw InetException("CipherTuning::measure : EVP_CIPHER_CTX_new error.");
+
+            unsigned char key[AEAD_KEY_LEN] {},
+                          iv[AEAD_IV_LEN]   {},
+                          aad[TLS_AAD_LEN]  { 0x17, 0x03, 0x03, 0x00, 0x00 },
+                          tag[AEAD_TAG_LEN] {};
+            vector<unsigned char> in(packetLen, 0xa5),
+                                  out(packetLen + AEAD_TAG_LEN);
+            if(EVP_EncryptInit_ex2(ctx.get(), cipher.get(), key, iv, nullptr) != 1)
+                throw InetException(mergeStrings({"CipherTuning::measure : init error : ", cipherName}));
+
+            uint64_t  bytes  { 0 },
+                      begin  { monotonicUs() },
+                      elapsed{ 0 };
+            for(uint64_t seq{0}; ; seq++){
+                for(size_t i{0}; i < sizeof(seq); i++) iv[AEAD_IV_LEN - 1 - i] = static_cast<unsigned char>(seq >> (i * 8));
+                int outLen { 0 };
+                if(EVP_EncryptInit_ex2(ctx.get(), nullptr, nullptr, iv, nullptr) != 1                        ||
+                   EVP_EncryptUpdate(ctx.get(), nullptr, &outLen, aad, sizeof(aad)) != 1                     ||
+                   EVP_EncryptUpdate(ctx.get(), out.data(), &outLen, in.data(), static_cast<int>(packetLen)) != 1 ||
+                   EVP_EncryptFinal_ex(ctx.get(), out.data() + outLen, &outLen) != 1                        ||
+                   EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_AEAD_GET_TAG, AEAD_TAG_LEN, tag) != 1)
+                    throw InetException(mergeStrings({"CipherTuning::measure : encryption error : ", cipherName}));
+                bytes += packetLen;
+                if((seq & 0x3f) == 0x3f){
+                    elapsed = monotonicUs() - begin;
+                    if(elapsed >= budgetUs && elapsed > 0) break;
+                }
+            }
+
+            return static_cast<double>(bytes) / static_cast<double>(elapsed);
+        }
+    }
+
+    vector<AeadResult> CipherTuning::measure(size_t packetLen, uint64_t budgetUs) anyexcept{
+        vector<AeadResult> results;
+        for(const auto& candidate : CANDIDATES){
+            AeadResult res { candidate };
+            // Bytes per usec is MB/s.
+            res.mbPerSec = sealThroughput(candidate.cipher, packetLen, budgetUs);
+            if(res.mbPerSec > 0.0) results.push_back(res);
+        }
+        stable_sort(results.begin(), results.end(), [](const AeadResult& a, const AeadResult& b){ return a.mbPerSec > b.mbPerSec; });
+        return results;
+    }
+
+    string CipherTuning::suitesFrom(const vector<AeadResult>& results) anyexcept{
+        string suites;
+        for(const auto& res : results){
+            if(!suites.empty()) suites.append(":");
+            suites.append(res.suite);
+        }
+        return suites;
+    }
+
+    string CipherTuning::resolve(const string& suites, const string& cacheFile) anyexcept{
+        if(suites != AUTO) return suites;
+
+        string cached;
+        if(!cacheFile.empty() && readCache(cacheFile, cached)){
+            Debug::printLog(mergeStrings({"CipherTuning : cached suites : ", cached}), DEBUG_MODE::STD_DEBUG);
+            return cached;
+        }
+
+        vector<AeadResult> results { measure(TUNING_PACKET_LEN, TUNING_BUDGET_US) };
+        if(results.empty()) throw InetException("CipherTuning::resolve : no TLS 1.3 AEAD available.");
+        for(const auto& res : results)
+            Debug::printLog(mergeStrings({"CipherTuning : ", res.cipher, " : ", to_string(static_cast<long>(res.mbPerSec)), " MB/s"}), 
+                            DEBUG_MODE::STD_DEBUG);
+
+        string tuned { suitesFrom(results) };
+        Debug::printLog(mergeStrings({"CipherTuning : selected suites : ", tuned}), DEBUG_MODE::STD_DEBUG);
+        if(!cacheFile.empty()) writeCache(cacheFile, tuned);
+        return tuned;
+    }
+
+    // A cached result is valid only for the same CPU and OpenSSL build.
+    string CipherTuning::cacheKey(void) anyexcept{
+        struct utsname  uts {};
+        string          cpu { "unknown" };
+        static_cast<void>(uname(&uts));
+
+        ifstream cpuinfo("/proc/cpuinfo");
+        for(string line; getline(cpuinfo, line); ){
+            if(line.rfind("model name", 0) == 0 || line.rfind("CPU part", 0) == 0){
+                size_t value { line.find_first_not_of(" \t", line.find(':') + 1) };
+                if(value != string::npos) cpu = line.substr(value);
+                break;
+            }
+        }
+
+        return mergeStrings({uts.machine, ";", cpu, ";", OpenSSL_version(OPENSSL_VERSION)});
+    }
+
+    bool CipherTuning::readCache(const string& cacheFile, string& suites) anyexcept{
+        ifstream  cache(cacheFile);
+        string    key;
+        if(!getline(cache, key) || !getline(cache, suites)) return false;
+        return key == cacheKey() && !suites.empty();
+    }
+
+    void CipherTuning::writeCache(const string& cacheFile, const string& suites) anyexcept{
+        ofstream cache(cacheFile, std::ios::trunc);
+        cache << cacheKey() << '\n' << suites << '\n';
+        if(!cache) Debug::printLog(mergeStrings({"CipherTuning : can't write cache file : ", cacheFile}), DEBUG_MODE::ERR_DEBUG);
+    }
+
+} // End namespace
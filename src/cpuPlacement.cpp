@@ -0,0 +1,105 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+#include <cpuPlacement.hpp>
+#include <inetgeneral.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          stringutils::mergeStrings;
+
+    namespace {
+        // From linux/mempolicy.h, whose header isn't always installed.
+        constexpr int  POLICY_PREFERRED  { 1 };
+    }
+
+    void CpuPlacement::pinThread(int cpu) anyexcept{
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if(sched_setaffinity(0, sizeof(set), &set) == -1)
+            throw InetException(mergeStrings({"CpuPlacement::pinThread : cpu ", to_string(cpu), " : ", strerror(errno)}));
+    }
+
+    // The sysfs cpu directory holds a "nodeN" link on NUMA kernels.
+    int CpuPlacement::nodeOfCpu(int cpu) noexcept{
+        string path { mergeStrings({"/sys/devices/system/cpu/cpu", to_string(cpu)}) };
+        DIR*   dir  { opendir(path.c_str()) };
+        if(dir == nullptr) return -1;
+        int node { -1 };
+        while(dirent* entry { readdir(dir) }){
+            if(strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9'){
+                node = atoi(entry->d_name + 4);
+                break;
+            }
+        }
+        closedir(dir);
+        return node;
+    }
+
+    // Preferred, not bound: when the node runs out the kernel falls back to the others.
+    void CpuPlacement::preferNode(int node) anyexcept{
+        constexpr unsigned long BITS { sizeof(unsigned long) * 8 };
+        unsigned long mask[4] {};
+        if(node < 0 || static_cast<unsigned long>(node) >= BITS * 4) 
+            throw InetException(mergeStrings({"CpuPlacement::preferNode : invalid node : ", to_string(node)}));
+        mask[static_cast<unsigned long>(node) / BITS] = 1UL << (static_cast<unsigned long>(node) % BITS);
+        if(syscall(SYS_set_mempolicy, POLICY_PREFERRED, mask, BITS * 4 + 1) == -1)
+            throw InetException(mergeStrings({"CpuPlacement::preferNode : set_mempolicy : ", strerror(errno)}));
+    }
+
+    void CpuPlacement::realtime(int priority) anyexcept{
+        sched_param param {};
+        param.sched_priority = priority;
+        if(sched_setscheduler(0, SCHED_FIFO, &param) == -1)
+            throw InetException(mergeStrings({"CpuPlacement::realtime : SCHED_FIFO ", to_string(priority), " : ", strerror(errno)}));
+    }
+
+    // Current mappings are faulted in by MCL_CURRENT, future ones on allocation; the stack
+    // grows on demand, so its first part is touched beforehand.
+    void CpuPlacement::lockMemory(void) anyexcept{
+        prefaultStack();
+        if(mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+            throw InetException(mergeStrings({"CpuPlacement::lockMemory : mlockall : ", strerror(errno)}));
+    }
+
+    void CpuPlacement::prefaultStack(void) noexcept{
+        char stack[STACK_PREFAULT];
+        explicit_bzero(stack, sizeof(stack));
+    }
+
+    string CpuPlacement::describe(void) anyexcept{
+        int cpu { sched_getcpu() };
+        return mergeStrings({ "PLACEMENT : cpu=",   to_string(cpu),
+                              " node=",             to_string(nodeOfCpu(cpu)),
+                              " policy=",           sched_getscheduler(0) == SCHED_FIFO ? "fifo" : "other" });
+    }
+
+} // End namespace
@@ -0,0 +1,299 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+
+#include <egressScheduler.hpp>
+#include <frames.hpp>
+#include <inetgeneral.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::vector,
+          std::istringstream,
+          std::max,
+          stringutils::mergeStrings;
+
+    namespace {
+        constexpr size_t SLOT_ALIGN { 64 };
+    }
+
+    // A zero depth disables the scheduler: packets are sent as soon as they are read.
+    EgressScheduler::EgressScheduler(size_t queueDepth, size_t poolSlots, size_t payloadSize) anyexcept
+       : depthLimit { queueDepth }, quantum { payloadSize },
+         stride     { (FRAME_HEADER_LEN + payloadSize + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN },
+         slots      { queueDepth == 0 ? 0 : poolSlots * stride }
+    {
+        if(!enabled()) return;
+        if(poolSlots == 0 || poolSlots >= NO_SLOT || payloadSize == 0) 
+            throw InetException("EgressScheduler::EgressScheduler : invalid pool size.");
+
+        slotNext.assign(poolSlots, NO_SLOT);
+        slotLen.assign(poolSlots, 0);
+        freeSlots.reserve(poolSlots);
+        for(size_t slot{poolSlots}; slot > 0; slot--) freeSlots.push_back(static_cast<uint32_t>(slot - 1));
+    }
+
+    bool EgressScheduler::enabled(void) const noexcept{
+        return depthLimit != 0;
+    }
+
+    bool EgressScheduler::backlog(void) const noexcept{
+        return activeHead != EGRESS_NO_QUEUE;
+    }
+
+    // Set after a dequeue found only sessions over their egress rate: the time before the 
+    // first of them conforms again.
+    uint64_t EgressScheduler::blockedUs(void) const noexcept{
+        return blocked;
+    }
+
+    void EgressScheduler::setShaper(Shaper* limits) noexcept{
+        shaper = limits;
+    }
+
+    // Queues are reused once closed: the vectors only grow with the number of sessions.
+    uint32_t EgressScheduler::open(int owner, uint32_t weight, uint32_t shape) anyexcept{
+        uint32_t id { EGRESS_NO_QUEUE };
+        if(freeQueues.empty()){
+            queues.emplace_back();
+            freeQueues.reserve(queues.size());
+            id = static_cast<uint32_t>(queues.size() - 1);
+        }else{
+            id = freeQueues.back();
+            freeQueues.pop_back();
+            queues[id] = Queue{};
+        }
+        queues[id].owner  = owner;
+        queues[id].weight = std::clamp<uint32_t>(weight, 1, EGRESS_MAX_WEIGHT);
+        queues[id].shape  = shaper == nullptr ? SHAPE_NONE : shape;
+        openQueues++;
+        return id;
+    }
+
+    // Queued packets go back to the pool, the one handed out by the last dequeue stays valid.
+    void EgressScheduler::close(uint32_t id) noexcept{
+        if(id >= queues.size() || queues[id].owner == -1) return;
+        Queue& queue { queues[id] };
+        while(queue.depth != 0) freeSlots.push_back(popHead(queue));
+        if(queue.active) deactivate(id);
+        if(longest == id) longest = EGRESS_NO_QUEUE;
+        queue.owner = -1;
+        freeQueues.push_back(id);
+        openQueues--;
+    }
+
+    uint32_t EgressScheduler::popHead(Queue& queue) noexcept{
+        uint32_t slot { queue.head };
+        queue.head    = slotNext[slot];
+        if(queue.head == NO_SLOT) queue.tail = NO_SLOT;
+        queue.depth--;
+        return slot;
+    }
+
+    void EgressScheduler::activate(uint32_t id) noexcept{
+        queues[id].active     = true;
+        queues[id].nextActive = EGRESS_NO_QUEUE;
+        if(activeTail == EGRESS_NO_QUEUE) activeHead               = id;
+        else                              queues[activeTail].nextActive = id;
+        activeTail = id;
+        activeQueues++;
+    }
+
+    // The head of the active list used its deficit: it waits for the next round at the tail.
+    void EgressScheduler::rotate(void) noexcept{
+        rounds++;
+        if(activeHead == activeTail) return;
+        uint32_t id { activeHead };
+        activeHead                    = queues[id].nextActive;
+        queues[id].nextActive         = EGRESS_NO_QUEUE;
+        queues[activeTail].nextActive = id;
+        activeTail                    = id;
+    }
+
+    // An empty queue leaves the round and loses its deficit, as in DRR. Anywhere but 
+    // at the head only when closed.
+    void EgressScheduler::deactivate(uint32_t id) noexcept{
+        uint32_t prev { EGRESS_NO_QUEUE };
+        for(uint32_t cur{activeHead}; cur != id; cur = queues[cur].nextActive) prev = cur;
+        if(prev == EGRESS_NO_QUEUE) activeHead              = queues[id].nextActive;
+        else                        queues[prev].nextActive = queues[id].nextActive;
+        if(activeTail == id)        activeTail              = prev;
+
+        queues[id].active     = false;
+        queues[id].credited   = false;
+        queues[id].deficit    = 0;
+        queues[id].nextActive = EGRESS_NO_QUEUE;
+        activeQueues--;
+    }
+
+    // Longest queue drop: the pool is full, the session holding most of it pays. The 
+    // longest queue is remembered and searched again only when it no longer looks so.
+    bool EgressScheduler::pushOut(uint32_t from) noexcept{
+        if(longest == EGRESS_NO_QUEUE || queues[longest].depth <= queues[from].depth){
+            longest = from;
+            for(uint32_t cur{activeHead}; cur != EGRESS_NO_QUEUE; cur = queues[cur].nextActive)
+                if(queues[cur].depth > queues[longest].depth) longest = cur;
+        }
+        Queue& victim { queues[longest] };
+        if(longest == from || victim.depth <= queues[from].depth) return false;
+
+        freeSlots.push_back(popHead(victim));
+        victim.pushedOut++;
+        pushedOut++;
+        if(victim.depth == 0) deactivate(longest);
+        return true;
+    }
+
+    void EgressScheduler::enqueue(uint32_t id, const uint8_t* pkt, size_t len) noexcept{
+        Queue& queue { queues[id] };
+        if(queue.depth >= depthLimit || (freeSlots.empty() && !pushOut(id))){
+            queue.drops++;
+            drops++;
+            return;
+        }
+
+        uint32_t slot { freeSlots.back() };
+        freeSlots.pop_back();
+        memcpy(slots.data() + slot * stride + FRAME_HEADER_LEN, pkt, len);
+        slotLen[slot]  = static_cast<uint32_t>(len);
+        slotNext[slot] = NO_SLOT;
+        if(queue.tail == NO_SLOT) queue.head           = slot;
+        else                      slotNext[queue.tail] = slot;
+        queue.tail     = slot;
+        queue.depth++;
+        queue.peak     = max(queue.peak, queue.depth);
+        enqueued++;
+        if(!queue.active){
+            activate(id);
+            blocked = 0;
+        }
+    }
+
+    // Classic DRR: the head of the active list gets quantum * weight bytes of credit per 
+    // visit and sends while its next packet fits; the quantum is a full packet, so every 
+    // visit sends at least one. A whole turn of shaped sessions ends the pass.
+    bool EgressScheduler::dequeue(EgressPacket& packet, uint64_t now) noexcept{
+        if(handed != NO_SLOT){
+            freeSlots.push_back(handed);
+            handed = NO_SLOT;
+        }
+
+        size_t    skipped { 0 };
+        uint64_t  wait    { UINT64_MAX };
+        while(activeHead != EGRESS_NO_QUEUE){
+            if(skipped == activeQueues){
+                blocked = max<uint64_t>(wait, 1);
+                return false;
+            }
+            uint32_t  id    { activeHead };
+            Queue&    queue { queues[id] };
+            if(!queue.credited){
+                queue.deficit  += quantum * queue.weight;
+                queue.credited  = true;
+            }
+
+            size_t len { slotLen[queue.head] };
+            if(len > queue.deficit){
+                queue.credited = false;
+                skipped        = 0;
+                rotate();
+                continue;
+            }
+            if(queue.shape != SHAPE_NONE && !shaper->admit(queue.shape, SHAPE_EGRESS, now)){
+                wait = std::min(wait, shaper->waitUs(queue.shape, SHAPE_EGRESS));
+                skipped++;
+                rotate();
+                continue;
+            }
+            if(queue.shape != SHAPE_NONE) shaper->charge(queue.shape, SHAPE_EGRESS, len + FRAME_HEADER_LEN);
+
+            blocked         = 0;
+            handed          = popHead(queue);
+            queue.deficit  -= len;
+            queue.sent++;
+            queue.bytes    += len;
+            sent++;
+            if(queue.depth == 0) deactivate(id);
+            packet = EgressPacket{ queue.owner, slots.data() + handed * stride, len };
+            return true;
+        }
+        return false;
+    }
+
+    string EgressScheduler::report(void) const anyexcept{
+        return mergeStrings({ "EGRESS SCHEDULER : queues=", to_string(openQueues),
+                              " depth=",       to_string(depthLimit),
+                              " pool=",        to_string(slotLen.size() - freeSlots.size()), "/", to_string(slotLen.size()),
+                              " quantum=",     to_string(quantum),
+                              " enqueued=",    to_string(enqueued),
+                              " sent=",        to_string(sent),
+                              " drops=",       to_string(drops),
+                              " pushed_out=",  to_string(pushedOut),
+                              " rounds=",      to_string(rounds) });
+    }
+
+    string EgressScheduler::report(uint32_t id) const anyexcept{
+        if(id >= queues.size()) return "EGRESS : none";
+        const Queue& queue { queues[id] };
+        return mergeStrings({ "EGRESS : weight=", to_string(queue.weight),
+                              " depth=",      to_string(queue.depth),
+                              " peak=",       to_string(queue.peak),
+                              " sent=",       to_string(queue.sent),
+                              " bytes=",      to_string(queue.bytes),
+                              " drops=",      to_string(queue.drops),
+                              " pushed_out=", to_string(queue.pushedOut) });
+    }
+
+    // "a.b.c.d/len weight, ..."
+    vector<ClientWeight> EgressScheduler::parseWeights(const string& text) anyexcept{
+        vector<ClientWeight> parsed;
+        for(const string& item : RouteTable::splitList(text)){
+            istringstream  words   { item };
+            string         prefix,
+                           weight,
+                           extra;
+            char*          end     { nullptr };
+            words >> prefix >> weight >> extra;
+            long           value   { strtol(weight.c_str(), &end, 10) };
+            if(weight.empty() || *end != '\0' || !extra.empty() || value < 1 || value > EGRESS_MAX_WEIGHT)
+                throw InetException(mergeStrings({"EgressScheduler::parseWeights : invalid weight : ", item}));
+            parsed.push_back(ClientWeight{ RouteTable::parsePrefix(prefix), static_cast<uint32_t>(value) });
+        }
+        return parsed;
+    }
+
+    // Longest match on the client source address, 1 when nothing matches.
+    uint32_t EgressScheduler::weightFor(const vector<ClientWeight>& weights, uint32_t source) noexcept{
+        uint32_t  weight { 1 };
+        int       best   { -1 };
+        for(const auto& entry : weights){
+            if((source & prefixMask(entry.source.len)) == entry.source.addr && entry.source.len > best){
+                best   = entry.source.len;
+                weight = entry.weight;
+            }
+        }
+        return weight;
+    }
+
+} // End namespace
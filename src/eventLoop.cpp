@@ -0,0 +1,637 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+  #include <linux/io_uring.h>
+  #define NNVPN_HAVE_URING 1
+#endif
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <vector>
+
+#include <eventLoop.hpp>
+#include <inetgeneral.hpp>
+#include <StringUtils.hpp>
+#include <Types.hpp>
+#include <timeUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::unique_ptr,
+          std::make_unique,
+          std::vector,
+          std::find_if,
+          std::remove_if,
+          typeutils::safeInt,
+          stringutils::mergeStrings,
+          timeutils::toTimeval,
+          timeutils::USEC_PER_MSEC,
+          timeutils::USEC_PER_SEC;
+
+    EventLoop::~EventLoop(void) noexcept
+    {}
+
+    bool EventLoop::addReader(int, size_t, size_t, size_t) anyexcept{
+        return false;
+    }
+
+    size_t EventLoop::takeReads(int, ReadBuffer*, size_t) anyexcept{
+        return 0;
+    }
+
+    void EventLoop::releaseReads(int) noexcept
+    {}
+
+    unique_ptr<EventLoop> EventLoop::create(EVENT_BACKEND backend) anyexcept{
+        switch(backend){
+            case BACKEND_SELECT:
+                return make_unique<SelectLoop>();
+            case BACKEND_URING:
+                return make_unique<UringLoop>();
+            case BACKEND_EPOLL:
+            default:
+                return make_unique<EpollLoop>();
+        }
+    }
+
+    EVENT_BACKEND EventLoop::backendFromName(const string& name) anyexcept{
+        if(name == "epoll")  return BACKEND_EPOLL;
+        if(name == "select") return BACKEND_SELECT;
+        if(name == "uring")  return BACKEND_URING;
+        throw InetException(mergeStrings({"EventLoop::backendFromName : unknown backend : ", name}));
+    }
+
+    static uint32_t toEpollMask(uint32_t events) noexcept{
+        return ((events & EV_READ)  ? static_cast<uint32_t>(EPOLLIN)  : 0U) |
+               ((events & EV_WRITE) ? static_cast<uint32_t>(EPOLLOUT) : 0U);
+    }
+
+    EpollLoop::EpollLoop(void) anyexcept
+       : epollFd { epoll_create1(EPOLL_CLOEXEC) }
+    {
+        if(epollFd == -1) throw InetException(mergeStrings({"EpollLoop::EpollLoop : epoll_create1 error : ", strerror(errno)}));
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if(timerFd == -1){
+            close(epollFd);
+            throw InetException(mergeStrings({"EpollLoop::EpollLoop : timerfd_create error : ", strerror(errno)}));
+        }
+        try{
+            add(timerFd, EV_READ);
+        }catch(InetException&){
+            close(timerFd);
+            close(epollFd);
+            throw;
+        }
+    }
+
+    EpollLoop::~EpollLoop(void) noexcept{
+        if(timerFd >= 0) close(timerFd);
+        if(epollFd >= 0) close(epollFd);
+    }
+
+    void EpollLoop::add(int fd, uint32_t events) anyexcept{
+        struct epoll_event ev {};
+        ev.events  = toEpollMask(events);
+        ev.data.fd = fd;
+        if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == -1)
+            throw InetException(mergeStrings({"EpollLoop::add : epoll_ctl error : ", strerror(errno)}));
+    }
+
+    void EpollLoop::modify(int fd, uint32_t events) anyexcept{
+        struct epoll_event ev {};
+        ev.events  = toEpollMask(events);
+        ev.data.fd = fd;
+        if(epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) == -1)
+            throw InetException(mergeStrings({"EpollLoop::modify : epoll_ctl error : ", strerror(errno)}));
+    }
+
+    void EpollLoop::remove(int fd) noexcept{
+        static_cast<void>(epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr));
+    }
+
+    size_t EpollLoop::wait(IoEvent* events, size_t maxEvents, uint64_t timeoutUs) anyexcept{
+        constexpr size_t   MAX_BATCH    { 64 };
+        struct epoll_event evs[MAX_BATCH];
+        // Round up: epoll has millisecond resolution and waking early just spins.
+        int                timeoutMs    { timeoutUs == UINT64_MAX ? -1 : 
+                                          safeInt(std::min<uint64_t>((timeoutUs + USEC_PER_MSEC - 1) / USEC_PER_MSEC, INT32_MAX)) };
+        // Short waits not aligned to milliseconds arm the timerfd: the rounded up epoll timeout 
+        // stays as a backstop and re-arming resets an expiration left from a previous pass.
+        if(timeoutUs > 0 && timeoutUs < PRECISE_BELOW_US && timeoutUs % USEC_PER_MSEC != 0){
+            struct itimerspec spec {};
+            spec.it_value.tv_nsec = static_cast<long>(timeoutUs * 1000);
+            if(timerfd_settime(timerFd, 0, &spec, nullptr) == -1)
+                throw InetException(mergeStrings({"EpollLoop::wait : timerfd_settime error : ", strerror(errno)}));
+        }
+
+        int                ret          { epoll_wait(epollFd, evs, safeInt(std::min(maxEvents + 1, MAX_BATCH)), timeoutMs) };
+        if(ret == -1){
+            if(errno == EINTR) return 0;
+            throw InetException(mergeStrings({"EpollLoop::wait : epoll_wait error : ", strerror(errno)}));
+        }
+
+        size_t count { 0 };
+        for(int i{0}; i < ret; i++){
+            if(evs[i].data.fd == timerFd){
+                // Only clears the expiration: EAGAIN means a re-arm already did.
+                uint64_t expirations { 0 };
+                ssize_t  got         { 0 };
+                do got = read(timerFd, &expirations, sizeof(expirations)); while(got == -1 && errno == EINTR);
+                if(got == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+                    throw InetException(mergeStrings({"EpollLoop::wait : timerfd read error : ", strerror(errno)}));
+                continue;
+            }
+            if(count == maxEvents) break;
+            events[count].fd     = evs[i].data.fd;
+            events[count].events = ((evs[i].events & EPOLLIN)  ? EV_READ  : 0U) |
+                                   ((evs[i].events & EPOLLOUT) ? EV_WRITE : 0U) |
+                                   ((evs[i].events & (EPOLLERR | EPOLLHUP)) ? EV_ERROR | EV_READ : 0U);
+            count++;
+        }
+        return count;
+    }
+
+    const char* EpollLoop::name(void) const noexcept{
+        return "epoll";
+    }
+
+    void SelectLoop::add(int fd, uint32_t events) anyexcept{
+        if(fd >= FD_SETSIZE) throw InetException("SelectLoop::add : descriptor exceeds FD_SETSIZE.");
+        watched.push_back({fd, events});
+    }
+
+    void SelectLoop::modify(int fd, uint32_t events) anyexcept{
+        auto it { find_if(watched.begin(), watched.end(), [fd](const IoEvent& ev){ return ev.fd == fd; }) };
+        if(it == watched.end()) throw InetException("SelectLoop::modify : unknown descriptor.");
+        it->events = events;
+    }
+
+    void SelectLoop::remove(int fd) noexcept{
+        watched.erase(remove_if(watched.begin(), watched.end(), [fd](const IoEvent& ev){ return ev.fd == fd; }), watched.end());
+    }
+
+    size_t SelectLoop::wait(IoEvent* events, size_t maxEvents, uint64_t timeoutUs) anyexcept{
+        fd_set   readSet,
+                 writeSet;
+        int      nfds      { -1 };
+        Timeval  tv        { toTimeval(timeoutUs) };
+
+        FD_ZERO(&readSet);
+        FD_ZERO(&writeSet);
+        for(const auto& ev : watched){
+            if(ev.events & EV_READ)  FD_SET(ev.fd, &readSet);
+            if(ev.events & EV_WRITE) FD_SET(ev.fd, &writeSet);
+            nfds = std::max(nfds, ev.fd);
+        }
+
+        int ret { ::select(nfds + 1, &readSet, &writeSet, nullptr, timeoutUs == UINT64_MAX ? nullptr : &tv) };
+        if(ret == -1){
+            if(errno == EINTR) return 0;
+            throw InetException(mergeStrings({"SelectLoop::wait : select error : ", strerror(errno)}));
+        }
+
+        size_t count { 0 };
+        for(const auto& ev : watched){
+            if(count == maxEvents) break;
+            uint32_t ready { (FD_ISSET(ev.fd, &readSet)  ? EV_READ  : 0U) |
+                             (FD_ISSET(ev.fd, &writeSet) ? EV_WRITE : 0U) };
+            if(ready != 0) events[count++] = { ev.fd, ready };
+        }
+        return count;
+    }
+
+    const char* SelectLoop::name(void) const noexcept{
+        return "select";
+    }
+
+#ifdef NNVPN_HAVE_URING
+
+    namespace {
+        // Completions of POLL_REMOVE and ASYNC_CANCEL requests carry this tag and are discarded.
+        constexpr uint64_t  REMOVE_TAG  { UINT64_MAX };
+        constexpr uint32_t  GEN_MASK    { 0x7fffffffU };
+        // Multishot reads: the fd in the low bits, polls never set the top bit.
+        constexpr uint64_t  READ_TAG    { 1ULL << 63 };
+        // IORING_OP_READ_MULTISHOT, Linux 6.7: older kernel headers don't define it.
+        constexpr uint8_t   OP_READ_MULTISHOT { 49 };
+        constexpr size_t    SLOT_ALIGN  { 64 };
+
+        uint64_t userData(int fd, uint32_t generation) noexcept{
+            return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+        }
+
+        long uringSetup(uint32_t entries, io_uring_params* params) noexcept{
+            return syscall(__NR_io_uring_setup, entries, params);
+        }
+
+        long uringRegister(int fd, unsigned int opcode, void* arg, unsigned int nrArgs) noexcept{
+            return syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+        }
+
+        bool supportsOp(int ringFd, uint8_t op) anyexcept{
+            constexpr unsigned int  OPS   { 256 };
+            vector<uint8_t>         buff  ( sizeof(io_uring_probe) + OPS * sizeof(io_uring_probe_op) );
+            auto*                   probe { reinterpret_cast<io_uring_probe*>(buff.data()) };
+
+            if(uringRegister(ringFd, IORING_REGISTER_PROBE, probe, OPS) < 0) return false;
+            return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+        }
+    }
+
+    UringLoop::UringLoop(void) anyexcept{
+        io_uring_params params {};
+        params.flags      = IORING_SETUP_CQSIZE;
+        params.cq_entries = CQ_ENTRIES;
+
+        long fd { uringSetup(SQ_ENTRIES, &params) };
+        if(fd < 0) throw InetException(mergeStrings({"UringLoop::UringLoop : io_uring_setup error : ", strerror(errno)}));
+        ringFd = static_cast<int>(fd);
+        if((params.features & IORING_FEAT_SINGLE_MMAP) == 0 || (params.features & IORING_FEAT_EXT_ARG) == 0){
+            release();
+            throw InetException("UringLoop::UringLoop : kernel too old, io_uring single mmap and timed waits are required.");
+        }
+
+        ringMap.len = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+                                       params.cq_off.cqes  + params.cq_entries * sizeof(io_uring_cqe));
+        ringMap.ptr = mmap(nullptr, ringMap.len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        sqeMap.len  = params.sq_entries * sizeof(io_uring_sqe);
+        sqeMap.ptr  = mmap(nullptr, sqeMap.len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if(ringMap.ptr == MAP_FAILED || sqeMap.ptr == MAP_FAILED){
+            int err { errno };
+            release();
+            throw InetException(mergeStrings({"UringLoop::UringLoop : mmap error : ", strerror(err)}));
+        }
+
+        auto* base { static_cast<uint8_t*>(ringMap.ptr) };
+        sqHead  = reinterpret_cast<uint32_t*>(base + params.sq_off.head);
+        sqTail  = reinterpret_cast<uint32_t*>(base + params.sq_off.tail);
+        sqMask  = reinterpret_cast<uint32_t*>(base + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<uint32_t*>(base + params.sq_off.array);
+        cqHead  = reinterpret_cast<uint32_t*>(base + params.cq_off.head);
+        cqTail  = reinterpret_cast<uint32_t*>(base + params.cq_off.tail);
+        cqMask  = reinterpret_cast<uint32_t*>(base + params.cq_off.ring_mask);
+        cqes    = base + params.cq_off.cqes;
+        sqes    = sqeMap.ptr;
+        localTail = *sqTail;
+        multishotReads = supportsOp(ringFd, OP_READ_MULTISHOT);
+    }
+
+    UringLoop::~UringLoop(void) noexcept{
+        release();
+    }
+
+    void UringLoop::release(void) noexcept{
+        // The buffer rings leave the kernel before the memory does: a read still in flight
+        // finds no buffers once its group is unregistered.
+        for(auto& reader : readers){
+            if(reader.ring.ptr == nullptr) continue;
+            if(ringFd >= 0){
+                io_uring_buf_reg reg {};
+                reg.bgid = reader.group;
+                static_cast<void>(uringRegister(ringFd, IORING_UNREGISTER_PBUF_RING, &reg, 1));
+            }
+            munmap(reader.ring.ptr, reader.ring.len);
+            reader.ring.ptr = nullptr;
+        }
+        if(sqeMap.ptr != nullptr && sqeMap.ptr != MAP_FAILED) munmap(sqeMap.ptr, sqeMap.len);
+        if(ringMap.ptr != nullptr && ringMap.ptr != MAP_FAILED) munmap(ringMap.ptr, ringMap.len);
+        sqeMap.ptr = ringMap.ptr = nullptr;
+        if(ringFd >= 0) close(ringFd);
+        ringFd = -1;
+    }
+
+    bool UringLoop::available(void) noexcept{
+        io_uring_params params {};
+        long fd { uringSetup(1, &params) };
+        if(fd < 0) return false;
+        close(static_cast<int>(fd));
+        return (params.features & IORING_FEAT_SINGLE_MMAP) != 0 && (params.features & IORING_FEAT_EXT_ARG) != 0;
+    }
+
+    int UringLoop::enter(uint32_t minComplete, uint64_t timeoutUs) noexcept{
+        __kernel_timespec       ts    {};
+        io_uring_getevents_arg  arg   {};
+        unsigned int            flags { minComplete != 0 ? IORING_ENTER_GETEVENTS : 0U };
+        void                    *argp { nullptr };
+        size_t                  argSz { 0 };
+
+        if(minComplete != 0 && timeoutUs != UINT64_MAX){
+            ts.tv_sec   = static_cast<long long>(timeoutUs / USEC_PER_SEC);
+            ts.tv_nsec  = static_cast<long long>((timeoutUs % USEC_PER_SEC) * 1000);
+            arg.ts      = reinterpret_cast<uint64_t>(&ts);
+            flags      |= IORING_ENTER_EXT_ARG;
+            argp        = &arg;
+            argSz       = sizeof(arg);
+        }
+
+        if(toSubmit == 0 && minComplete == 0) return 0;
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+        long ret { syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, argp, argSz) };
+        if(ret < 0) return -errno;
+        toSubmit -= std::min(static_cast<uint32_t>(ret), toSubmit);
+        return 0;
+    }
+
+    void* UringLoop::nextSqe(void) noexcept{
+        if(localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) == SQ_ENTRIES){
+            // Full: hand the queued entries to the kernel now, without waiting.
+            static_cast<void>(enter(0, 0));
+            if(localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) == SQ_ENTRIES) return nullptr;
+        }
+        uint32_t      index { localTail & *sqMask };
+        io_uring_sqe* sqe   { static_cast<io_uring_sqe*>(sqes) + index };
+        memset(sqe, 0, sizeof(io_uring_sqe));
+        sqArray[index] = index;
+        localTail++;
+        toSubmit++;
+        return sqe;
+    }
+
+    bool UringLoop::queuePoll(int fd, const Registration& reg) noexcept{
+        auto* sqe { static_cast<io_uring_sqe*>(nextSqe()) };
+        if(sqe == nullptr) return false;
+        sqe->opcode        = IORING_OP_POLL_ADD;
+        sqe->fd            = fd;
+        sqe->poll32_events = ((reg.events & EV_READ)  ? static_cast<uint32_t>(POLLIN)  : 0U) |
+                             ((reg.events & EV_WRITE) ? static_cast<uint32_t>(POLLOUT) : 0U);
+        sqe->user_data     = userData(fd, reg.generation);
+        return true;
+    }
+
+    bool UringLoop::queueRemove(int fd, const Registration& reg) noexcept{
+        auto* sqe { static_cast<io_uring_sqe*>(nextSqe()) };
+        if(sqe == nullptr) return false;
+        sqe->opcode        = IORING_OP_POLL_REMOVE;
+        sqe->fd            = -1;
+        sqe->addr          = userData(fd, reg.generation);
+        sqe->user_data     = REMOVE_TAG;
+        return true;
+    }
+
+    bool UringLoop::queueRead(const Reader& reader) noexcept{
+        auto* sqe { static_cast<io_uring_sqe*>(nextSqe()) };
+        if(sqe == nullptr) return false;
+        sqe->opcode        = OP_READ_MULTISHOT;
+        sqe->fd            = reader.fd;
+        sqe->flags         = IOSQE_BUFFER_SELECT;
+        sqe->buf_group     = reader.group;
+        sqe->user_data     = READ_TAG | static_cast<uint32_t>(reader.fd);
+        return true;
+    }
+
+    bool UringLoop::queueCancel(const Reader& reader) noexcept{
+        auto* sqe { static_cast<io_uring_sqe*>(nextSqe()) };
+        if(sqe == nullptr) return false;
+        sqe->opcode        = IORING_OP_ASYNC_CANCEL;
+        sqe->fd            = -1;
+        sqe->addr          = READ_TAG | static_cast<uint32_t>(reader.fd);
+        sqe->user_data     = REMOVE_TAG;
+        return true;
+    }
+
+    UringLoop::Reader* UringLoop::findReader(int fd) noexcept{
+        auto it { find_if(readers.begin(), readers.end(), [fd](const Reader& reader){ return reader.fd == fd; }) };
+        return it == readers.end() ? nullptr : &*it;
+    }
+
+    // Queues the buffer at the ring tail: the kernel sees it when the tail is published.
+    void UringLoop::recycle(Reader& reader, uint16_t bid) noexcept{
+        io_uring_buf& buf { static_cast<io_uring_buf*>(reader.ring.ptr)[reader.tail & (reader.entries - 1)] };
+        buf.addr = reinterpret_cast<uint64_t>(reader.buffers->data() + bid * reader.stride + reader.headroom);
+        buf.len  = static_cast<uint32_t>(reader.len);
+        buf.bid  = bid;
+        reader.tail++;
+        reader.inRing++;
+    }
+
+    bool UringLoop::addReader(int fd, size_t headroom, size_t len, size_t count) anyexcept{
+        if(!multishotReads) return false;
+        if(findReader(fd) != nullptr || registered.contains(fd)) throw InetException("UringLoop::addReader : descriptor already registered.");
+        if(readers.size() > UINT16_MAX) throw InetException("UringLoop::addReader : too many readers.");
+
+        Reader   reader;
+        uint32_t entries { 1 };
+        while(entries < count && entries < READER_RING_MAX) entries <<= 1;
+        reader.fd       = fd;
+        reader.group    = static_cast<uint16_t>(readers.size());
+        reader.headroom = headroom;
+        reader.len      = len;
+        reader.stride   = (headroom + len + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+        reader.entries  = entries;
+        reader.ring.len = entries * sizeof(io_uring_buf);
+        reader.ring.ptr = mmap(nullptr, reader.ring.len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if(reader.ring.ptr == MAP_FAILED) throw InetException(mergeStrings({"UringLoop::addReader : mmap error : ", strerror(errno)}));
+
+        io_uring_buf_reg reg {};
+        reg.ring_addr    = reinterpret_cast<uint64_t>(reader.ring.ptr);
+        reg.ring_entries = entries;
+        reg.bgid         = reader.group;
+        if(uringRegister(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0){
+            int err { errno };
+            munmap(reader.ring.ptr, reader.ring.len);
+            // No provided buffer rings in this kernel: the caller falls back to readiness.
+            if(err == EINVAL) return false;
+            throw InetException(mergeStrings({"UringLoop::addReader : buffer ring registration error : ", strerror(err)}));
+        }
+        readers.push_back(std::move(reader));
+
+        Reader& added { readers.back() };
+        added.buffers = make_unique<PacketBuffer>(entries * added.stride);
+        added.filled.reserve(entries);
+        added.handed.reserve(entries);
+        for(uint32_t bid{0}; bid < entries; bid++) recycle(added, static_cast<uint16_t>(bid));
+        __atomic_store_n(&static_cast<io_uring_buf_ring*>(added.ring.ptr)->tail, added.tail, __ATOMIC_RELEASE);
+        // Left unarmed on a full queue: the next wait arms it.
+        added.armed = queueRead(added);
+        return true;
+    }
+
+    size_t UringLoop::takeReads(int fd, ReadBuffer* reads, size_t maxReads) anyexcept{
+        Reader* reader { findReader(fd) };
+        if(reader == nullptr) return 0;
+
+        size_t count { std::min(maxReads, reader->filled.size() - reader->next) };
+        for(size_t i{0}; i < count; i++){
+            const Filled& pkt { reader->filled[reader->next++] };
+            reads[i] = { reader->buffers->data() + pkt.bid * reader->stride, pkt.len };
+            reader->handed.push_back(pkt.bid);
+        }
+        if(reader->next == reader->filled.size()){
+            reader->filled.clear();
+            reader->next = 0;
+        }
+        if(count == 0 && reader->closed)
+            throw InetException("UringLoop::takeReads : descriptor closed.");
+        if(count == 0 && reader->error != 0){
+            int err { reader->error };
+            reader->error = 0;
+            throw InetException(mergeStrings({"UringLoop::takeReads : read error : ", strerror(err)}));
+        }
+        return count;
+    }
+
+    void UringLoop::releaseReads(int fd) noexcept{
+        Reader* reader { findReader(fd) };
+        if(reader == nullptr || reader->handed.empty()) return;
+        for(uint16_t bid : reader->handed) recycle(*reader, bid);
+        reader->handed.clear();
+        __atomic_store_n(&static_cast<io_uring_buf_ring*>(reader->ring.ptr)->tail, reader->tail, __ATOMIC_RELEASE);
+    }
+
+    void UringLoop::completeRead(int fd, int32_t res, uint32_t flags) noexcept{
+        Reader* reader { findReader(fd) };
+        if(reader == nullptr) return;
+
+        if((flags & IORING_CQE_F_BUFFER) != 0){
+            auto bid { static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT) };
+            reader->inRing--;
+            if(res > 0){
+                reader->filled.push_back({ bid, static_cast<uint32_t>(res) });
+            }else{
+                recycle(*reader, bid);
+                __atomic_store_n(&static_cast<io_uring_buf_ring*>(reader->ring.ptr)->tail, reader->tail, __ATOMIC_RELEASE);
+            }
+        }
+        // Out of buffers the read stops until releaseReads() refills the ring; the next wait re-arms it.
+        if(res == 0)
+            reader->closed = true;
+        else if(res < 0 && res != -ENOBUFS && res != -EAGAIN && res != -EINTR && res != -ECANCELED)
+            reader->error  = -res;
+        if((flags & IORING_CQE_F_MORE) == 0) reader->armed = false;
+    }
+
+    void UringLoop::add(int fd, uint32_t events) anyexcept{
+        if(registered.contains(fd)) throw InetException("UringLoop::add : descriptor already registered.");
+        Registration reg { events, nextGen++ & GEN_MASK, true };
+        if(!queuePoll(fd, reg)) throw InetException("UringLoop::add : submission queue full.");
+        registered.emplace(fd, reg);
+    }
+
+    void UringLoop::modify(int fd, uint32_t events) anyexcept{
+        auto it { registered.find(fd) };
+        if(it == registered.end()) throw InetException("UringLoop::modify : unknown descriptor.");
+        Registration& reg { it->second };
+        // A new generation makes any completion of the previous poll stale.
+        if(reg.armed) static_cast<void>(queueRemove(fd, reg));
+        reg.events     = events;
+        reg.generation = nextGen++ & GEN_MASK;
+        reg.armed      = queuePoll(fd, reg);
+        if(!reg.armed) throw InetException("UringLoop::modify : submission queue full.");
+    }
+
+    void UringLoop::remove(int fd) noexcept{
+        // The buffers stay mapped until the ring is released: the kernel may still hold one.
+        if(Reader* reader { findReader(fd) }; reader != nullptr){
+            if(reader->armed) static_cast<void>(queueCancel(*reader));
+            reader->fd = -1;
+            return;
+        }
+        auto it { registered.find(fd) };
+        if(it == registered.end()) return;
+        if(it->second.armed) static_cast<void>(queueRemove(fd, it->second));
+        registered.erase(it);
+    }
+
+    size_t UringLoop::wait(IoEvent* events, size_t maxEvents, uint64_t timeoutUs) anyexcept{
+        for(int fd : rearm){
+            auto it { registered.find(fd) };
+            if(it != registered.end() && !it->second.armed) it->second.armed = queuePoll(fd, it->second);
+        }
+        rearm.clear();
+
+        // Packets already read but not taken keep the loop from sleeping.
+        bool  ready { __atomic_load_n(cqTail, __ATOMIC_ACQUIRE) != *cqHead };
+        for(auto& reader : readers){
+            if(reader.fd == -1) continue;
+            if(!reader.armed && !reader.closed && reader.error == 0 && reader.inRing != 0) reader.armed = queueRead(reader);
+            ready = ready || reader.next < reader.filled.size() || reader.closed || reader.error != 0;
+        }
+        int   ret   { enter(ready || timeoutUs == 0 ? 0 : 1, timeoutUs) };
+        if(ret < 0 && ret != -EINTR && ret != -ETIME && ret != -EBUSY)
+            throw InetException(mergeStrings({"UringLoop::wait : io_uring_enter error : ", strerror(-ret)}));
+
+        // Readers report after the polls: they keep their room at the end of events.
+        uint32_t head  { *cqHead },
+                 tail  { __atomic_load_n(cqTail, __ATOMIC_ACQUIRE) };
+        size_t   count { 0 },
+                 room  { maxEvents > readers.size() ? maxEvents - readers.size() : 1 };
+        for(; head != tail; head++){
+            const io_uring_cqe& cqe { static_cast<io_uring_cqe*>(cqes)[head & *cqMask] };
+            if(cqe.user_data == REMOVE_TAG) continue;
+            if((cqe.user_data & READ_TAG) != 0){
+                completeRead(static_cast<int>(cqe.user_data & 0xffffffffU), cqe.res, cqe.flags);
+                continue;
+            }
+            if(count >= room) break;
+
+            int      fd  { static_cast<int>(cqe.user_data & 0xffffffffU) };
+            auto     it  { registered.find(fd) };
+            if(it == registered.end() || it->second.generation != static_cast<uint32_t>(cqe.user_data >> 32)) continue;
+
+            it->second.armed = false;
+            rearm.push_back(fd);
+            uint32_t mask { cqe.res < 0 ? static_cast<uint32_t>(POLLERR) : static_cast<uint32_t>(cqe.res) };
+            events[count++]  = { fd, ((mask & POLLIN)  ? EV_READ  : 0U) |
+                                     ((mask & POLLOUT) ? EV_WRITE : 0U) |
+                                     ((mask & (POLLERR | POLLHUP)) ? EV_ERROR | EV_READ : 0U) };
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+        for(const auto& reader : readers){
+            if(count == maxEvents) break;
+            if(reader.fd == -1) continue;
+            bool failed { reader.closed || reader.error != 0 };
+            if(reader.next < reader.filled.size() || failed) events[count++] = { reader.fd, EV_READ | (failed ? EV_ERROR : 0U) };
+        }
+        return count;
+    }
+
+#else
+
+    UringLoop::UringLoop(void) anyexcept{
+        throw InetException("UringLoop::UringLoop : built without io_uring support.");
+    }
+
+    UringLoop::~UringLoop(void) noexcept
+    {}
+
+    bool   UringLoop::available(void) noexcept                                     { return false; }
+    void   UringLoop::add(int, uint32_t) anyexcept                                 {}
+    void   UringLoop::modify(int, uint32_t) anyexcept                              {}
+    void   UringLoop::remove(int) noexcept                                         {}
+    size_t UringLoop::wait(IoEvent*, size_t, uint64_t) anyexcept                   { return 0; }
+    bool   UringLoop::addReader(int, size_t, size_t, size_t) anyexcept             { return false; }
+    size_t UringLoop::takeReads(int, ReadBuffer*, size_t) anyexcept                { return 0; }
+    void   UringLoop::releaseReads(int) noexcept                                   {}
+
+#endif
+
+    const char* UringLoop::name(void) const noexcept{
+        return "io_uring";
+    }
+
+} // End namespace
@@ -0,0 +1,92 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <algorithm>
+
+#include <flushPolicy.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::min,
+          std::max,
+          stringutils::mergeStrings;
+
+    FlushPolicy::FlushPolicy(uint64_t maxHoldUs, size_t maxPackets, size_t maxBytes) noexcept
+        : maxHold { maxHoldUs }, packetCap { max<size_t>(maxPackets, 1) }, byteCap { maxBytes }, threshold { maxBytes }
+    {}
+
+    // FLUSH_REASONS: the record can still grow.
+    FLUSH_REASON FlushPolicy::trigger(size_t bytes, size_t packets) const noexcept{
+        if(bytes >= threshold)    return FLUSH_BYTES;
+        if(packets >= packetCap)  return FLUSH_PACKETS;
+        return FLUSH_REASONS;
+    }
+
+    uint64_t FlushPolicy::deadline(uint64_t firstQueued) const noexcept{
+        return firstQueued + hold;
+    }
+
+    void FlushPolicy::onFlush(uint64_t now, size_t bytes, size_t packets, FLUSH_REASON reason) noexcept{
+        records++;
+        frames += packets;
+        reasons[reason]++;
+
+        // Arrival rate between flushes, smoothed; after a pause longer than a few deadlines 
+        // the old rate is dropped, so the first packets of a new burst aren't held.
+        // A record pushed out ahead of a control frame says nothing about the arrivals: 
+        // its bytes go to the next sample and the hold stays as it is.
+        arrived += bytes;
+        if(reason == FLUSH_CONTROL) return;
+        if(lastFlush != 0 && now > lastFlush){
+            uint64_t interval { now - lastFlush };
+            double   sample   { static_cast<double>(arrived) / static_cast<double>(interval) };
+            rateBytesPerUs += (interval > maxHold * IDLE_HOLDS ? 1.0 : RATE_GAIN) * (sample - rateBytesPerUs);
+            arrived         = 0;
+            lastFlush       = now;
+        }else if(lastFlush == 0){
+            lastFlush       = now;
+            arrived         = 0;
+        }
+        if(packets != 0) avgPacket += RATE_GAIN * (static_cast<double>(bytes) / static_cast<double>(packets) - avgPacket);
+
+        double expected { rateBytesPerUs * static_cast<double>(maxHold) };
+        if(maxHold == 0 || expected < avgPacket * HOLD_MIN_PACKETS){
+            hold      = 0;
+            threshold = byteCap;
+        }else{
+            hold      = maxHold;
+            threshold = min(byteCap, max(static_cast<size_t>(expected), static_cast<size_t>(avgPacket)));
+        }
+    }
+
+    string FlushPolicy::report(void) const anyexcept{
+        return mergeStrings({ "records=",          to_string(records),
+                              " frames=",          to_string(frames),
+                              " hold_us=",         to_string(hold),
+                              " threshold=",       to_string(threshold),
+                              " rate_kBps=",       to_string(static_cast<uint64_t>(rateBytesPerUs * 1000.0)),
+                              " flush_bytes=",     to_string(reasons[FLUSH_BYTES]),
+                              " flush_pkts=",      to_string(reasons[FLUSH_PACKETS]),
+                              " flush_deadline=",  to_string(reasons[FLUSH_DEADLINE]),
+                              " flush_pass=",      to_string(reasons[FLUSH_PASS]),
+                              " flush_control=",   to_string(reasons[FLUSH_CONTROL]) });
+    }
+
+} // End namespace
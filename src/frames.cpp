@@ -0,0 +1,83 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <cstring>
+
+#include <frames.hpp>
+
+namespace inetlib{
+
+    void putFrameHeader(uint8_t* dst, FRAME_TYPE type, size_t len, uint8_t flags) noexcept{
+        dst[0] = type;
+        dst[1] = flags;
+        dst[2] = static_cast<uint8_t>((len >> 8) & 0xFF);
+        dst[3] = static_cast<uint8_t>(len & 0xFF);
+    }
+
+    FrameReader::FrameReader(size_t maxPl) anyexcept
+       // A whole TLS record must always fit, otherwise SSL_read leaves bytes 
+       // pending inside the SSL object and select() won't report them.
+       : maxPayload { maxPl }, buffer { TLS_MAX_RECORD + FRAME_HEADER_LEN + maxPl }
+    {}
+
+    uint8_t* FrameReader::writePtr(void) noexcept{
+        return buffer.data() + tail;
+    }
+
+    size_t FrameReader::writeSpace(void) const noexcept{
+        return buffer.size() - tail;
+    }
+
+    void FrameReader::commit(size_t len) noexcept{
+        tail += len;
+    }
+
+    void FrameReader::compact(void) noexcept{
+        if(head == tail){
+            head = tail = 0;
+        }else if(head > 0){
+            memmove(buffer.data(), buffer.data() + head, tail - head);
+            tail -= head;
+            head  = 0;
+        }
+    }
+
+    FRAME_STATUS FrameReader::next(Frame& frame) noexcept{
+        size_t avail { tail - head };
+        if(avail < FRAME_HEADER_LEN){
+            compact();
+            return FRAME_INCOMPLETE;
+        }
+
+        const uint8_t* hdr { buffer.data() + head };
+        size_t         len { (static_cast<size_t>(hdr[2]) << 8) | hdr[3] };
+        if(len > maxPayload || hdr[0] > FRAME_MAX_TYPE) return FRAME_INVALID;
+        if(avail < FRAME_HEADER_LEN + len){
+            compact();
+            return FRAME_INCOMPLETE;
+        }
+
+        frame.type     = static_cast<FRAME_TYPE>(hdr[0]);
+        frame.flags    = hdr[1];
+        frame.payload  = hdr + FRAME_HEADER_LEN;
+        frame.len      = len;
+        head          += FRAME_HEADER_LEN + len;
+
+        return FRAME_READY;
+    }
+
+} // End namespace
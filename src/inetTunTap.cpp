@@ -22,25 +22,42 @@
 #include <sys/ioctl.h>
 #include <csignal>
 
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
 #include <algorithm>
 #include <iostream>
+#include <fstream>
 
 #include <inetgeneral.hpp>
 #include <StringUtils.hpp>
 #include <Types.hpp>
+#include <timeUtils.hpp>
+#include <packet.hpp>
+#include <cipherTuning.hpp>
 
 
 namespace inetlib{
 
 using std::copy_n,
       std::string,
+      std::array,
+      std::vector,
+      std::min,
+      std::max,
+      std::unique_ptr,
+      std::make_unique,
       std::cerr,
+      std::ifstream,
+      std::getline,
       std::to_string,
       std::signal,
       inetlib::InetException,
       typeutils::safeSizeRange,
       stringutils::mergeStrings,
       stringutils::trace,
+      timeutils::monotonicUs,
+      timeutils::USEC_PER_MSEC,
       debugmode::Debug,
       debugmode::DEBUG_MODE;
 
@@ -56,13 +73,23 @@ Tun::~Tun(void) noexcept{
 }
 
 void Tun::init(string tunIpString, string tunMaskString)  anyexcept{
+    openDevice();
+    setAddress(tunIpString, tunMaskString);
+}
+
+void Tun::openDevice(void)  anyexcept{
     signal(SIGPIPE, SIG_IGN);
-    tunfd = open(cloneDev.c_str(), O_RDWR);
+    // Non blocking: the loops drain several packets per wakeup, until EAGAIN.
+    tunfd = open(cloneDev.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
     if(tunfd < 0)
         throw( InetException( mergeStrings({ "Tun::init : Error opening TUN cloning device: ", strerror(errno)}) ) );
     if(ioctl(tunfd, TUNSETIFF, reinterpret_cast<void*>(&ifreq)) < 0)
         throw( InetException( mergeStrings({ "Tun::init : Error setting TUNSETIFF on TUN fd: ", strerror(errno)}) ) );
-    
+    deviceName = ifreq.ifr_name;
+}
+
+// Also used later by clients getting their address from the server pool.
+void Tun::setAddress(string tunIpString, string tunMaskString)  anyexcept{
     SockaddrIn   addr {};
     int          sock { socket(AF_INET, SOCK_DGRAM, 0) };
 
@@ -110,99 +137,185 @@ int Tun::getTunFd(void) const noexcept{
      return tunfd;
 }
 
-NnVpnClient::NnVpnClient(string pem, string key, string paddr, string pport, string dev, size_t buffSize) anyexcept
-   : Tun{dev}, sslClient { pem, key, paddr.c_str(), pport.c_str()}, bufferSize { buffSize }, debugMode { Debug::getDebugLevel() }
+// The client has a single session: losing it, or the TUN device, ends the program.
+static void checkSession(const VpnSession& session, IO_STATUS status) anyexcept{
+    if(status != IO_OK) [[unlikely]] throw InetException(session.errorText(status));
+}
+
+static void checkTun(IO_STATUS status, int error) anyexcept{
+    if(status == IO_CLOSED) [[unlikely]] throw InetException("Tun : TUN device closed.");
+    if(status != IO_OK)     [[unlikely]] throw InetException(mergeStrings({"Tun : TUN read error : ", strerror(error)}));
+}
+
+// Pinning and NUMA placement happen before the buffers are allocated (see main); the
+// scheduling class and the memory locking are set here, once everything is in place.
+static void enterDataPlane(const TunnelOptions& options) anyexcept{
+    if(options.rtPriority != 0) CpuPlacement::realtime(static_cast<int>(options.rtPriority));
+    if(options.lockMemory)      CpuPlacement::lockMemory();
+    Debug::printLog(CpuPlacement::describe(), DEBUG_MODE::STD_DEBUG);
+}
+
+NnVpnClient::NnVpnClient(string pem, string key, string paddr, string pport, string dev, size_t buffSize, const TunnelOptions& opts) anyexcept
+   : Tun{dev}, sslClient { pem, key, paddr.c_str(), pport.c_str()}, bufferSize { buffSize }, options { opts }, 
+     batch { static_cast<size_t>(opts.tunBatch), buffSize, static_cast<size_t>(opts.tunBudget) }, 
+     busy { static_cast<uint64_t>(opts.busySpinUs) }, debugMode { Debug::getDebugLevel() }
 { 
-    buff.resize(bufferSize);
+    sslClient.setGroups(options.tlsGroups);
+    sslClient.setCipherSuites(CipherTuning::resolve(options.cipherSuites, options.cipherCache));
+    sslClient.setReadAhead(static_cast<size_t>(options.readAheadBytes));
+    sslClient.setTuning(options.tuning);
 }
 
 NnVpnClient::~NnVpnClient(void) noexcept
 {}
 
+// With an address from the server pool the device stays down until the assignment.
 void  NnVpnClient::init(string tunIpString, string tunMaskString) anyexcept{
-    Tun::init(tunIpString, tunMaskString);
+    if(options.autoAddress) openDevice();
+    else                    Tun::init(tunIpString, tunMaskString);
     sslClient.init();
 }
 
-void  NnVpnClient::start(void) anyexcept{
-        int        tunFd  { getTunFd() },
-                   sslFd  { sslClient.getFdReader() }; 
-        const SSL* cSSL   { sslClient.getHandler().cSSL };
-        fd_set     fdsetTun;
+void  NnVpnClient::applyAddress(VpnSession& session) anyexcept{
+    uint32_t  addr  { 0 };
+    uint8_t   len   { 0 };
+    if(!session.takeAssigned(addr, len)) return;
+
+    array<char, INET_ADDRSTRLEN>  addrText {},
+                                  maskText {};
+    in_addr                       bin      { htonl(addr) },
+                                  mask     { htonl(prefixMask(len)) };
+    inet_ntop(AF_INET, &bin, addrText.data(), addrText.size());
+    inet_ntop(AF_INET, &mask, maskText.data(), maskText.size());
+    setAddress(addrText.data(), maskText.data());
+    Debug::printLog(mergeStrings({"NnVpnClient : tunnel address ", addrText.data(), "/", to_string(len), " assigned by the server"}), DEBUG_MODE::ERR_DEBUG);
+}
 
-        nfdsTun = (tunFd > sslFd) ? tunFd + 1 : sslFd + 1;
+// The key of the address lease on the server: the same host and device get the same address 
+// back when reconnecting within the lease time. Without a machine id it lasts for this run only.
+uint64_t  NnVpnClient::identity(void) const anyexcept{
+    array<uint8_t, EVP_MAX_MD_SIZE> digest {};
+    string                          machine;
+    ifstream                        idFile  { "/etc/machine-id" };
+    if(idFile && getline(idFile, machine) && !machine.empty()){
+        string seed { mergeStrings({machine, "/", getDeviceName()}) };
+        if(EVP_Digest(seed.data(), seed.size(), digest.data(), nullptr, EVP_sha256(), nullptr) != 1)
+            throw InetException("NnVpnClient::identity : digest error.");
+    }else if(RAND_bytes(digest.data(), sizeof(uint64_t)) != 1){
+        throw InetException("NnVpnClient::identity : RAND_bytes error.");
+    }
+    uint64_t id { 0 };
+    for(size_t idx{0}; idx < sizeof(uint64_t); idx++) id = (id << 8) | digest[idx];
+    return id;
+}
+
+void  NnVpnClient::start(void) anyexcept{
+        constexpr size_t           MAX_EVENTS  { 8 };
+        int                        tunFd       { getTunFd() },
+                                   sslFd       { sslClient.getFdReader() }; 
+        VpnSession                 session     { sslClient.getHandler().cSSL, sslFd, bufferSize, options, "client" };
+        unique_ptr<EventLoop>      loop        { EventLoop::create(options.eventBackend) };
+        array<IoEvent, MAX_EVENTS> events;
+        vector<ReadBuffer>         tunReads    ( static_cast<size_t>(options.tunBatch) );
+        bool                       writeArmed  { false },
+                                   tunReader   { false };
+
+        // The data socket never blocks the loop: a full socket leaves the records in the session
+        // backlog and the loop waits for it to be writable, so the timers keep running.
+        Inet::setFdBlocking(sslFd, false);
+        tunReader = loop->addReader(tunFd, FRAME_HEADER_LEN, bufferSize, tunReads.size() * TunBatch::RING_BATCHES);
+        if(!tunReader) loop->add(tunFd, EV_READ);
+        loop->add(sslFd, EV_READ);
+        TunnelStats::installDumpSignal();
+        enterDataPlane(options);
+        session.start(monotonicUs());
+        if(!options.announceRoutes.empty()) checkSession(session, session.announce(options.announceRoutes));
+        if(options.autoAddress){
+            checkSession(session, session.requestAddress(identity()));
+            Debug::printLog("NnVpnClient : waiting for the tunnel address from the server", DEBUG_MODE::STD_DEBUG);
+        }
 
         for(;;){
-           FD_ZERO(&fdsetTun); 
-           FD_SET(tunFd, &fdsetTun);
-           FD_SET(sslFd, &fdsetTun);
-  
-           ssize_t ret {::select(nfdsTun, &fdsetTun, nullptr, nullptr, nullptr)};
-           switch(ret){
-              [[unlikely]]  case -1:
-                 throw InetException("NnVpnClient::start : Select Error.");
-              [[unlikely]]  case  0:
-                 throw InetException("NnVpnClient::start : Select Timeout.");
-              [[likely]]    default:
-                  if(FD_ISSET(tunFd, &fdsetTun)) {
-                      ssize_t readFromTun { read(tunFd, buff.data(), buff.size()) };
-                      switch(readFromTun){
-                         break;
-                         [[unlikely]]  case 0:
-                            throw InetException("NnVpnClient::start : Connection Closed by peer.");
-                         break;
-                         [[unlikely]]  case -1:
-                            throw InetException(mergeStrings({"NnVpnClient::start : TUN Read error: ", strerror(errno)}));
-                         [[likely]]    default:
-                            if(debugMode >= DEBUG_MODE::VERBOSE_DEBUG) trace("READ TUN -> SSL WRITE:", reinterpret_cast<uint8_t*>(buff.data()), buff.size());
-                            ssize_t written { 0 };
-                            while( written < readFromTun){
-                                int nbytes { sslClient.writeSSLBuffer(buff.data() + written, safeSizeRange<int>(readFromTun - written))};
-                                if( nbytes <= 0) {
-                                    int errCode { SSL_get_error(cSSL, nbytes) };
-                                    switch(errCode){
-                                       case SSL_ERROR_WANT_WRITE:
-                                       case SSL_ERROR_WANT_ASYNC_JOB:
-                                               continue;
-                                       default:
-                                               throw InetException(mergeStrings({"NnVpnClient::start : writeSSL error : ", to_string(errCode)}));
-                                    }
-                                }
-                                written += nbytes;
-                            }
-                      }
+           uint64_t now { monotonicUs() };
+           checkSession(session, session.timers(now));
+           // Records queued by the previous pass and by the timers leave before sleeping, unless
+           // the flush policy holds them for more packets until their deadline.
+           checkSession(session, session.flush(now));
+           if(bool want { session.wantWrite() }; want != writeArmed){
+               loop->modify(sslFd, want ? EV_READ | EV_WRITE : EV_READ);
+               writeArmed = want;
+           }
+           if(TunnelStats::takeDumpRequest()){
+               Debug::printLog(session.report(), DEBUG_MODE::ERR_DEBUG);
+               Debug::printLog(batch.report(), DEBUG_MODE::ERR_DEBUG);
+               Debug::printLog(busy.report(), DEBUG_MODE::ERR_DEBUG);
+               Debug::printLog(PacketArena::report(), DEBUG_MODE::ERR_DEBUG);
+               Debug::printLog(SslAllocator::report(), DEBUG_MODE::ERR_DEBUG);
+           }
+
+           size_t ready { loop->wait(events.data(), events.size(), busy.timeout(now, session.nextTimeoutUs(now))) };
+           busy.onWake(ready);
+           for(size_t i{0}; i < ready; i++){
+              if(events[i].fd == tunFd && tunReader) {
+                  // Packets the loop already read: their buffers go back to the ring once encrypted.
+                  size_t    packets { loop->takeReads(tunFd, tunReads.data(), tunReads.size()) };
+                  for(size_t pkt{0}; pkt < packets; pkt++) checkSession(session, session.sendPacket(tunReads[pkt].frame, tunReads[pkt].len));
+                  loop->releaseReads(tunFd);
+              }else if(events[i].fd == tunFd) {
+                  // The whole batch is encrypted before the next wait: with membio it leaves in one sendmsg.
+                  size_t    packets { 0 };
+                  IO_STATUS tunRead { batch.drain(tunFd, packets) };
+                  int       tunErr  { errno };
+                  for(size_t pkt{0}; pkt < packets; pkt++) checkSession(session, session.sendPacket(batch.frame(pkt), batch.length(pkt)));
+                  checkTun(tunRead, tunErr);
+              }else if(events[i].fd == sslFd){
+                  if((events[i].events & EV_WRITE) != 0) checkSession(session, session.onWritable(tunFd));
+                  if((events[i].events & (EV_READ | EV_ERROR)) != 0){
+                      checkSession(session, session.receive(tunFd));
+                      if(options.autoAddress) applyAddress(session);
                   }
-                  if(FD_ISSET(sslFd, &fdsetTun)) {
-                      ssize_t readFromSsl = sslClient.readSSLBuffer(buff.data(), safeSizeRange<int>(buff.size()));
-                      if( readFromSsl <= 0) {
-                           int errCode { SSL_get_error(cSSL, readFromSsl) };
-                           switch(errCode){
-                               case SSL_ERROR_WANT_READ:
-                               case SSL_ERROR_WANT_ASYNC_JOB:
-                                    continue;
-                               default:
-                                    throw InetException(mergeStrings({"NnVpnClient::start : readSSL error : ", to_string(errCode)}));
-                           }
-                      }
-                      if(debugMode >= DEBUG_MODE::VERBOSE_DEBUG) trace("READ SSL -> TUN WRITE:",reinterpret_cast<uint8_t*>(buff.data()), buff.size());
-                      ssize_t written { 0 };
-                      while( written < readFromSsl){
-                          ssize_t nbytes { write(tunFd, buff.data() + written, readFromSsl - written) };
-                          if( nbytes <= 0) {
-                              if (errno == EINTR || errno == EAGAIN) continue;
-                              throw InetException(mergeStrings({"NnVpnClient::start : TUN write error : ", strerror(errno)}));
-                          }
-                          written += nbytes;
-                      }
-                  }
-            }
+              }
+           }
         }
 }
 
-NnVpnServer::NnVpnServer(string pem,   string key, string saddr, string sport, string dev, size_t buffSize) anyexcept
-   : Tun{dev}, sslServer { pem, key}, srvAddr { saddr } , srvPort { sport }, bufferSize { buffSize }, debugMode { Debug::getDebugLevel() }
+ServerPeer::~ServerPeer(void) noexcept{
+    if(cSSL != nullptr){
+        if(state == PEER_ESTABLISHED){
+            if(session) session->shutdown();
+            else        SSL_shutdown(cSSL);
+        }
+        // Before the socket is closed: the channel may still have zerocopy sends to wait for.
+        session.reset();
+        SSL_free(cSSL);
+        cSSL = nullptr;
+    }
+    if(fd >= 0){
+        close(fd);
+        fd = -1;
+    }
+}
+
+NnVpnServer::NnVpnServer(string pem,   string key, string saddr, string sport, string dev, size_t buffSize, const TunnelOptions& opts) anyexcept
+   : Tun{dev}, sslServer { pem, key}, srvAddr { saddr } , srvPort { sport }, bufferSize { buffSize }, options { opts }, 
+     batch { static_cast<size_t>(opts.tunBatch), buffSize, static_cast<size_t>(opts.tunBudget) }, 
+     busy { static_cast<uint64_t>(opts.busySpinUs) }, debugMode { Debug::getDebugLevel() },
+     admission { opts.admissionRate, opts.admissionBurst, static_cast<size_t>(opts.maxHandshakes) },
+     pool { opts.addressPool, static_cast<uint64_t>(opts.leaseMs) * USEC_PER_MSEC },
+     shaper { opts.shaping },
+     egress { static_cast<size_t>(opts.egressQueue), static_cast<size_t>(opts.egressQueue) * EGRESS_POOL_QUEUES, buffSize }
 { 
-    buff.resize(bufferSize);
+    if(shaper.enabled()) egress.setShaper(&shaper);
+    // Leases are keyed by the client certificate key as well: see assignAddress().
+    if(pool.enabled()) sslServer.requestPeerCert();
+    sslServer.setGroups(options.tlsGroups);
+    sslServer.setCipherSuites(CipherTuning::resolve(options.cipherSuites, options.cipherCache));
+    sslServer.setReadAhead(static_cast<size_t>(options.readAheadBytes));
+    sslServer.setTuning(options.tuning);
+
+    for(const auto& route : options.staticRoutes)
+        if(!routes.insert(route.prefix, routes.hopForAddr(route.via), ROUTE_STATIC))
+            throw InetException(mergeStrings({"NnVpnServer::NnVpnServer : duplicated route : ", RouteTable::prefixText(route.prefix)}));
 }
 
 NnVpnServer::~NnVpnServer(void) noexcept
@@ -211,93 +324,426 @@ NnVpnServer::~NnVpnServer(void) noexcept
 void  NnVpnServer::init(string tunIpString, string tunMaskString) anyexcept{
     Tun::init(tunIpString, tunMaskString);
     sslServer.init(srvAddr.c_str(), srvPort.c_str());
+
+    // The server end of the tunnel may sit in the pool range: it's never handed out.
+    if(in_addr own {}; inet_pton(AF_INET, tunIpString.c_str(), &own) == 1) pool.reserve(ntohl(own.s_addr));
+    if(pool.enabled()) Debug::printLog(pool.report(), DEBUG_MODE::STD_DEBUG);
 }
 
-void  NnVpnServer::start(void) anyexcept{
+void  NnVpnServer::acceptPeers(uint64_t now) anyexcept{
+    for(;;){
+        SockaddrIn  peerAddr {};
+        int         fd       { sslServer.acceptNb(peerAddr) };
+        if(fd == InetServerSSL::ACCEPT_EXHAUSTED){
+            // The listener stays readable while the backlog waits: stop watching it for a
+            // while instead of spinning on the same error.
+            srvStats.acceptBackoffs++;
+            Debug::printLog(mergeStrings({"NnVpnServer::acceptPeers : accept paused : ", strerror(errno)}), DEBUG_MODE::ERR_DEBUG);
+            loop->modify(listenFd, 0);
+            acceptResume = now + ACCEPT_BACKOFF_US;
+            return;
+        }
+        if(fd == -1) return;
 
-    sslServer.listen();
+        // Admission runs before any allocation or crypto work for the new connection.
+        if(admission.admit(ntohl(peerAddr.sin_addr.s_addr), now, peers.size() - established) != ADMIT_OK){
+            InetServerSSL::reject(fd);
+            continue;
+        }
+
+        auto    peer     { make_unique<ServerPeer>() };
+        peer->fd         = fd;
+        peer->source     = ntohl(peerAddr.sin_addr.s_addr);
+        peer->deadline   = now + static_cast<uint64_t>(options.handshakeTimeoutMs) * USEC_PER_MSEC;
+        // A connection that can't be set up is dropped alone, its descriptor closed with the 
+        // peer: the server goes on accepting.
+        try{
+            peer->name   = InetServerSSL::addressToString(peerAddr);
+            sslServer.prepareSocket(fd);
+            peer->cSSL   = sslServer.newSession(fd);
+            loop->add(fd, EV_READ);
+        }catch(InetException& ex){
+            Debug::printLog(mergeStrings({"NnVpnServer : connection setup failed : ", ex.what()}), DEBUG_MODE::ERR_DEBUG);
+            continue;
+        }
+        Debug::printLog(mergeStrings({"NnVpnServer : handshake started with ", peer->name}), DEBUG_MODE::STD_DEBUG);
+        peers.emplace(fd, std::move(peer));
+        srvStats.handshakesStarted++;
+    }
+}
 
-    int        tunFd       { getTunFd() };
-    fd_set     fdsetTun;
+// False when the handshake failed: scanners and broken clients are routine, not exceptional.
+bool  NnVpnServer::handshake(ServerPeer& peer, uint64_t now) anyexcept{
+    switch(InetServerSSL::doHandshake(peer.cSSL)){
+        case HANDSHAKE_DONE:
+            // The socket stays non-blocking: what it can't take waits in the session backlog.
+            loop->modify(peer.fd, EV_READ);
+            peer.watched  = EV_READ;
+            peer.session  = make_unique<VpnSession>(peer.cSSL, peer.fd, bufferSize, options, peer.name);
+            peer.session->setIdleRelease(static_cast<uint64_t>(options.idleReleaseMs) * USEC_PER_MSEC);
+            if(options.hairpin) peer.session->setHairpin(this);
+            peer.shape    = shaper.open(peer.source);
+            if(egress.enabled()) peer.queue = egress.open(peer.fd, EgressScheduler::weightFor(options.weights, peer.source), peer.shape);
+            peer.session->start(now);
+            peer.state    = PEER_ESTABLISHED;
+            established++;
+            srvStats.handshakesDone++;
+            Debug::printLog(mergeStrings({"NnVpnServer : session established with ", peer.name}), DEBUG_MODE::STD_DEBUG);
+        break;
+        case HANDSHAKE_WANT_READ:
+            loop->modify(peer.fd, EV_READ);
+        break;
+        case HANDSHAKE_WANT_WRITE:
+            loop->modify(peer.fd, EV_WRITE);
+        break;
+        case HANDSHAKE_FAILED:
+            srvStats.handshakesFailed++;
+            return false;
+    }
+    return true;
+}
 
-    for(;;){
+void  NnVpnServer::closePeer(int fd, const char* reason) noexcept{
+    auto it { peers.find(fd) };
+    if(it == peers.end()) return;
+
+    Debug::printLog(mergeStrings({"NnVpnServer : closing ", it->second->name, " : ", reason}), DEBUG_MODE::ERR_DEBUG);
+    if(it->second->leased != 0) pool.release(it->second->leased, it->second->identity, monotonicUs());
+    if(it->second->claimed != 0) pool.unclaim(it->second->claimed);
+    routes.dropPeer(fd);
+    egress.close(it->second->queue);
+    shaper.close(it->second->shape);
+    if(it->second->state == PEER_ESTABLISHED) established--;
+    loop->remove(fd);
+    peers.erase(it);
+    srvStats.peersClosed++;
+}
+
+// A source address already routed to the peer, by its own host route or by a prefix 
+// behind it, costs a single lookup: hosts behind an announced subnet aren't learned one by one.
+// An address routed to another live session, learned, leased or announced, isn't taken 
+// over: a client coming back waits for its old session to go. 
+void  NnVpnServer::learnRoute(ServerPeer& peer) anyexcept{
+    if(peer.session->hasAnnounced()) acceptRoutes(peer);
+
+    uint32_t inner { peer.session->getInnerAddr() };
+    if(inner == 0 || routes.resolve(inner) != -1 || peer.learned >= MAX_LEARNED) return;
+    if(int holder { routes.holder(inner) }; holder != -1 && holder != peer.fd) return;
+    // Pool addresses belong to the peer they are leased to: others can't take them over.
+    // A client configured with one claims it, if free, as long as it has no other.
+    if(pool.contains(inner) && inner != peer.leased){
+        if(peer.leased != 0 || peer.claimed != 0 || !pool.claim(inner)) return;
+        peer.claimed = inner;
+    }
+
+    uint32_t hop   { routes.hopForAddr(inner) };
+    static_cast<void>(routes.bind(hop, peer.fd));
+    if(!routes.insert(Prefix{ inner, 32 }, hop, ROUTE_LEARNED)) return;
+    if(++peer.learned == MAX_LEARNED)
+        Debug::printLog(mergeStrings({"NnVpnServer : ", peer.name, " : learned routes limit reached"}), DEBUG_MODE::ERR_DEBUG);
+}
+
+// Announced prefixes never replace a configured or previously announced one.
+void  NnVpnServer::acceptRoutes(const ServerPeer& peer) anyexcept{
+    vector<Prefix> prefixes { peer.session->takeAnnounced() };
+    if(!options.acceptRoutes){
+        Debug::printLog(mergeStrings({"NnVpnServer : routes announced by ", peer.name, " ignored: acceptroutes is off"}), DEBUG_MODE::ERR_DEBUG);
+        return;
+    }
+
+    uint32_t hop { routes.hopForPeer(peer.fd) };
+    for(Prefix prefix : prefixes){
+        if(routes.insert(prefix, hop, ROUTE_ANNOUNCED))
+            Debug::printLog(mergeStrings({"NnVpnServer : route ", RouteTable::prefixText(prefix), " via ", peer.name}), DEBUG_MODE::STD_DEBUG);
+        else
+            Debug::printLog(mergeStrings({"NnVpnServer : route ", RouteTable::prefixText(prefix), " announced by ", peer.name, " refused: already routed"}), DEBUG_MODE::ERR_DEBUG);
+    }
+}
+
+// Only on request, from clients configured with tunaddress = "auto". The lease is routed to 
+// the peer before the client even knows its address. The lease owner is the identity sent 
+// by the client bound to its certificate key: the lease held for a client can't be taken 
+// by another one sending the same identity.
+void  NnVpnServer::assignAddress(ServerPeer& peer, uint64_t identity, uint64_t now) anyexcept{
+    if(!pool.enabled()) throw InetException("NnVpnServer : address requested, but no pool is configured");
+    if(peer.leased != 0 || peer.claimed != 0) return;
+    uint64_t owner { InetServerSSL::bindIdentity(peer.cSSL, identity) };
+    uint32_t addr  { pool.acquire(owner, now) };
+    if(addr == 0) throw InetException("NnVpnServer : address pool exhausted");
+
+    peer.leased     = addr;
+    peer.identity   = owner;
+    uint32_t hop    { routes.hopForAddr(addr) };
+    static_cast<void>(routes.bind(hop, peer.fd));
+    static_cast<void>(routes.insert(Prefix{ addr, 32 }, hop, ROUTE_LEASED));
+    if(IO_STATUS status { peer.session->assign(addr, pool.prefixLen()) }; status != IO_OK)
+        throw InetException(peer.session->errorText(status));
+    Debug::printLog(mergeStrings({"NnVpnServer : address ", RouteTable::prefixText(Prefix{ addr, 32 }), " leased to ", peer.name}), DEBUG_MODE::STD_DEBUG);
+}
+
+// With the egress scheduler the device is emptied into the session queues, up to a pool 
+// worth of packets per wakeup: under load, drops are chosen there instead of by the TUN queue.
+void  NnVpnServer::forwardFromTun(int tunFd) anyexcept{
+    size_t passes { egress.enabled() ? max<size_t>(1, static_cast<size_t>(options.egressQueue) * EGRESS_POOL_QUEUES 
+                                                      / static_cast<size_t>(options.tunBatch)) : 1 };
+    for(size_t pass{0}; pass < passes; pass++){
+        size_t    packets { 0 };
+        IO_STATUS status  { batch.drain(tunFd, packets) };
+        int       error   { errno };
+        for(size_t pkt{0}; pkt < packets; pkt++) routePacket(batch.frame(pkt), batch.length(pkt));
+        checkTun(status, error);
+        if(batch.drained()) break;
+    }
+}
+
+// The loop read the packets already: they are routed in place and their buffers go back to 
+// the ring after each batch, with the same per wakeup limit as the batch reads.
+void  NnVpnServer::forwardFromReader(int tunFd) anyexcept{
+    size_t passes { egress.enabled() ? max<size_t>(1, static_cast<size_t>(options.egressQueue) * EGRESS_POOL_QUEUES 
+                                                      / tunReads.size()) : 1 };
+    for(size_t pass{0}; pass < passes; pass++){
+        size_t packets { loop->takeReads(tunFd, tunReads.data(), tunReads.size()) };
+        for(size_t pkt{0}; pkt < packets; pkt++) routePacket(tunReads[pkt].frame, tunReads[pkt].len);
+        loop->releaseReads(tunFd);
+        if(packets < tunReads.size()) break;
+    }
+}
+
+void  NnVpnServer::routePacket(uint8_t* frame, size_t len) anyexcept{
+    const uint8_t* pkt      { frame + FRAME_HEADER_LEN };
+    int            target   { -1 };
+    uint32_t       dst      { 0 };
+
+    if(ipv4Destination(pkt, len, dst)) target = routes.resolve(dst);
+    // Until a peer has announced its inner address, a single client gets everything, as before.
+    if(target == -1 && established == 1){
+        for(const auto& [fd, peer] : peers) if(peer->state == PEER_ESTABLISHED) target = fd;
+    }
+    if(target == -1){
+        srvStats.noRouteDrops++;
+        return;
+    }
+
+    deliver(*(peers.at(target)), frame, len);
+}
+
+// Queued for the egress scheduler when it's enabled, sent right away otherwise: without 
+// queues, frames over the egress rate can only be dropped.
+void  NnVpnServer::deliver(ServerPeer& peer, uint8_t* frame, size_t len) noexcept{
+    if(peer.queue != EGRESS_NO_QUEUE){
+        egress.enqueue(peer.queue, frame + FRAME_HEADER_LEN, len);
+        return;
+    }
+    if(peer.shape != SHAPE_NONE){
+        if(!shaper.admit(peer.shape, SHAPE_EGRESS, monotonicUs())) return;
+        shaper.charge(peer.shape, SHAPE_EGRESS, len + FRAME_HEADER_LEN);
+    }
+    if(IO_STATUS status { peer.session->sendPacket(frame, len) }; status != IO_OK) [[unlikely]]
+        closePeer(peer.fd, peer.session->errorText(status).c_str());
+}
+
+// At most a TUN read budget of queued bytes per loop pass: the loop doesn't wait while 
+// a backlog is left, peer sockets and timers are still served in between.
+void  NnVpnServer::serveEgress(void) noexcept{
+    EgressPacket packet {};
+    uint64_t     now    { monotonicUs() };
+    for(size_t bytes{0}; bytes < static_cast<size_t>(options.tunBudget) && egress.dequeue(packet, now); bytes += packet.len){
+        VpnSession& session { *(peers.find(packet.owner)->second->session) };
+        if(IO_STATUS status { session.sendPacket(packet.frame, packet.len) }; status != IO_OK) [[unlikely]]
+            closePeer(packet.owner, session.errorText(status).c_str());
+    }
+}
+
+// Client to client: decrypted once, encrypted once, the TUN device and the kernel are 
+// skipped, so are its forwarding rules. Destinations without a session, the sender's own 
+// routes and expiring TTLs stay on the kernel path.
+bool  NnVpnServer::forward(uint8_t* frame, size_t len, int fromFd) noexcept{
+    uint8_t*  pkt    { frame + FRAME_HEADER_LEN };
+    uint32_t  dst    { 0 };
+
+    if(!ipv4Destination(pkt, len, dst)) return false;
+    int       target { routes.resolve(dst) };
+    if(target == -1 || target == fromFd) return false;
+    auto      it     { peers.find(target) };
+    if(it == peers.end() || it->second->state != PEER_ESTABLISHED || !decrementTtl(pkt, len)) return false;
+
+    srvStats.hairpinPackets++;
+    srvStats.hairpinBytes += len;
+    deliver(*(it->second), frame, len);
+    return true;
+}
+
+// An established session ready for IO, or resumed after a throttled read. Reads stop at 
+// the tokens its shaper has left. The peer may be closed on return.
+void  NnVpnServer::servePeer(ServerPeer& peer, uint32_t events, int tunFd, uint64_t now) anyexcept{
+    uint64_t  rxBytes { peer.session->getStats().sslRxBytes };
+    IO_STATUS status  { IO_OK };
+    if((events & EV_WRITE) != 0) 
+        status = peer.session->onWritable(tunFd);
+    if(status == IO_OK && (events & (EV_READ | EV_ERROR)) != 0) 
+        status = peer.session->receive(tunFd, peer.shape != SHAPE_NONE ? shaper.available(peer.shape, SHAPE_INGRESS, now) : SIZE_MAX);
+    if(status != IO_OK) [[unlikely]]{
+        closePeer(peer.fd, peer.session->errorText(status).c_str());
+        return;
+    }
+    if(uint64_t identity { 0 }; peer.session->takeRequest(identity)) [[unlikely]]{
         try{
-           sslServer.accept();
-    
-           int        sslFd       { sslServer.getFdReader() }; 
-           const SSL* cSSL        { sslServer.getHandler().cSSL };
-    
-           nfdsTun = (tunFd > sslFd) ? tunFd + 1 : sslFd + 1;
-    
-           for(;;){
-               FD_ZERO(&fdsetTun); 
-               FD_SET(tunFd, &fdsetTun);
-               FD_SET(sslFd, &fdsetTun);
-      
-               ssize_t ret {::select(nfdsTun, &fdsetTun, nullptr, nullptr, nullptr)};
-               switch(ret){
-                  [[unlikely]] case -1:
-                     throw InetException("NnVpnServer::start : Select Error.");
-                  [[unlikely]] case  0:
-                     throw InetException("NnVpnServer::start : Select Timeout.");
-                  [[likely]]   default:
-                      if(FD_ISSET(tunFd, &fdsetTun)) {
-                          ssize_t readFromTun { read(tunFd, buff.data(), buff.size()) };
-                          switch(readFromTun){
-                             [[unlikely]] case 0:
-                                throw InetException("NnVpnServer::start : Connection Closed by peer.");
-                             break;
-                             [[unlikely]] case -1:
-                                throw InetException(mergeStrings({"NnVpnServer::start : TUN Read error: ", strerror(errno)}));
-                             [[likely]]   default:
-                                ssize_t written { 0 };
-                                while( written < readFromTun){
-                                    int nbytes { sslServer.writeSSLBuffer(buff.data() + written, safeSizeRange<int>(readFromTun - written))};
-                                    if( nbytes <= 0) {
-                                        int errCode = SSL_get_error(cSSL, nbytes);
-                                        switch(errCode){
-                                           case SSL_ERROR_WANT_WRITE:
-                                           case SSL_ERROR_WANT_ASYNC_JOB:
-                                                   continue;
-                                           default:
-                                                   throw InetException(mergeStrings({"NnVpnServer::start : writeSSL error : ", to_string(errCode)}));
-                                        }
-                                    }
-                                    written += nbytes;
-                                }
-                          }
-                      }
-                      if(FD_ISSET(sslFd, &fdsetTun)) {
-                          int readFromSsl { sslServer.readSSLBuffer(buff.data(), safeSizeRange<int>(buff.size()))};
-                          if( readFromSsl <= 0) {
-                               int errCode { SSL_get_error(cSSL, readFromSsl) };
-                               switch(errCode){
-                                   case SSL_ERROR_WANT_READ:
-                                   case SSL_ERROR_WANT_ASYNC_JOB:
-                                        continue;
-                                   case SSL_ERROR_SYSCALL:
-                                        throw InetException(mergeStrings({"NnVpnServer::start : readSSL error : ", to_string(errCode), " : suberror : ", strerror(errno)}));
-                                   default:
-                                        throw InetException(mergeStrings({"NnVpnServer::start : readSSL error : ", to_string(errCode)}));
-                               }
-                          }
-                          ssize_t written { 0 };
-                          while( written < readFromSsl){
-                               ssize_t nbytes { write(tunFd, buff.data() + written, safeSizeRange<int>(readFromSsl - written))};
-                               if( nbytes <= 0) {
-                                  if (errno == EINTR || errno == EAGAIN) continue;
-                                  throw InetException(mergeStrings({"NnVpnServer::start : TUN write error : ", strerror(errno)}));
-                               }
-                               written += nbytes;
-                          }
-                      }
+            assignAddress(peer, identity, now);
+        }catch(InetException& ex){
+            closePeer(peer.fd, ex.what());
+            return;
+        }
+    }
+    learnRoute(peer);
+    if(peer.shape != SHAPE_NONE) throttleIngress(peer, peer.session->getStats().sslRxBytes - rxBytes, now);
+}
+
+// Ingress is shaped on the TLS socket: after a read that leaves its buckets in debt the peer 
+// isn't read until the debt is paid back, and TCP slows the client down, with no drops.
+// Reads keep to the tokens left, so the debt stays within a record. Records left in memory
+// by a read that ran out of tokens wait for the resume as well: no event would report them.
+void  NnVpnServer::throttleIngress(ServerPeer& peer, uint64_t bytes, uint64_t now) anyexcept{
+    shaper.charge(peer.shape, SHAPE_INGRESS, bytes);
+    if(shaper.admit(peer.shape, SHAPE_INGRESS, now) && !peer.session->pendingInput()) return;
+    peer.resume = now + max<uint64_t>(shaper.waitUs(peer.shape, SHAPE_INGRESS), 1);
+}
+
+// Reads stop while the peer is throttled, writes are watched while its session has a backlog.
+void  NnVpnServer::watchPeer(ServerPeer& peer) anyexcept{
+    uint32_t events { (peer.resume != 0 ? 0U : EV_READ) | (peer.session->wantWrite() ? EV_WRITE : 0U) };
+    if(events == peer.watched) return;
+    loop->modify(peer.fd, events);
+    peer.watched = events;
+}
+
+uint64_t  NnVpnServer::serviceTimers(uint64_t now) anyexcept{
+    uint64_t next { BioChannel::reapClosed(now) };
+
+    if(acceptResume != 0){
+        if(now < acceptResume){
+            next = min(next, acceptResume - now);
+        }else{
+            acceptResume = 0;
+            loop->modify(listenFd, EV_READ);
+        }
+    }
+
+    expired.clear();
+    resumed.clear();
+    for(auto& [fd, peer] : peers){
+        if(peer->state == PEER_HANDSHAKE){
+            if(now >= peer->deadline){
+                srvStats.handshakesTimedOut++;
+                expired.push_back(fd);
+                continue;
+            }
+            next = min(next, peer->deadline - now);
+        }else{
+            // PINGs and PONGs wait with the data of a throttled peer: it isn't dead for that.
+            if(peer->resume != 0) peer->session->holdAlive(now);
+            IO_STATUS status { peer->session->timers(now) };
+            if(status == IO_OK) status = peer->session->flush(now);
+            if(status != IO_OK) [[unlikely]] {
+                Debug::printLog(peer->session->errorText(status), DEBUG_MODE::ERR_DEBUG);
+                expired.push_back(fd);
+                continue;
+            }
+            next = min(next, peer->session->nextTimeoutUs(now));
+            if(peer->resume != 0){
+                if(now < peer->resume){
+                    next = min(next, peer->resume - now);
+                }else{
+                    peer->resume = 0;
+                    if(peer->session->pendingInput()) resumed.push_back(fd);
                 }
             }
-        } catch(InetException& ex){
-               cerr << mergeStrings({ "NnVpnServer::start() : Caught Exception : ", ex.what(), " -> restart loop\n" });
+            watchPeer(*peer);
         }
+    }
+    for(int fd : expired) closePeer(fd, "timeout");
+    for(int fd : resumed){
+        if(!peers.contains(fd)) continue;
+        servePeer(*peers[fd], EV_READ, getTunFd(), now);
+        // Closed by the read, or throttled again.
+        auto it { peers.find(fd) };
+        if(it == peers.end()) continue;
+        if(it->second->resume != 0) next = min(next, it->second->resume - now);
+        watchPeer(*(it->second));
+    }
 
-        sslServer.disconnect();
+    return next;
+}
+
+void  NnVpnServer::dumpStats(void) const anyexcept{
+    Debug::printLog(srvStats.report(established, peers.size() - established), DEBUG_MODE::ERR_DEBUG);
+    Debug::printLog(admission.report(), DEBUG_MODE::ERR_DEBUG);
+    Debug::printLog(routes.report(), DEBUG_MODE::ERR_DEBUG);
+    if(pool.enabled()) Debug::printLog(pool.report(), DEBUG_MODE::ERR_DEBUG);
+    if(egress.enabled()) Debug::printLog(egress.report(), DEBUG_MODE::ERR_DEBUG);
+    if(shaper.enabled()) Debug::printLog(shaper.report(), DEBUG_MODE::ERR_DEBUG);
+    Debug::printLog(batch.report(), DEBUG_MODE::ERR_DEBUG);
+    Debug::printLog(busy.report(), DEBUG_MODE::ERR_DEBUG);
+    Debug::printLog(PacketArena::report(), DEBUG_MODE::ERR_DEBUG);
+    Debug::printLog(SslAllocator::report(), DEBUG_MODE::ERR_DEBUG);
+    for(const auto& [fd, peer] : peers){
+        if(peer->state != PEER_ESTABLISHED) continue;
+        string line { peer->session->report() };
+        if(egress.enabled())          line.append(" ").append(egress.report(peer->queue));
+        if(peer->shape != SHAPE_NONE) line.append(" ").append(shaper.report(peer->shape));
+        Debug::printLog(line, DEBUG_MODE::ERR_DEBUG);
+    }
+}
+
+void  NnVpnServer::start(void) anyexcept{
+    constexpr size_t            MAX_EVENTS  { 64 };
+    array<IoEvent, MAX_EVENTS>  events;
+    int                         tunFd       { getTunFd() };
+
+    sslServer.listen();
+    listenFd = Inet::getSocketFd();
+    Inet::setFdBlocking(listenFd, false);
+
+    loop = EventLoop::create(options.eventBackend);
+    loop->add(listenFd, EV_READ);
+    tunReads.resize(static_cast<size_t>(options.tunBatch));
+    tunReader = loop->addReader(tunFd, FRAME_HEADER_LEN, bufferSize, tunReads.size() * TunBatch::RING_BATCHES);
+    if(!tunReader) loop->add(tunFd, EV_READ);
+    TunnelStats::installDumpSignal();
+    enterDataPlane(options);
+    Debug::printLog(mergeStrings({"NnVpnServer : event loop backend : ", loop->name(), tunReader ? ", TUN read by the loop" : ""}), DEBUG_MODE::STD_DEBUG);
+
+    for(;;){
+        uint64_t now    { monotonicUs() };
+        uint64_t waitUs { serviceTimers(now) };
+        if(egress.backlog()) waitUs = min(waitUs, egress.blockedUs());
+        if(TunnelStats::takeDumpRequest()) dumpStats();
+
+        // With busyspin the wait right after traffic only polls: no sleep, no wakeup latency.
+        size_t   ready  { loop->wait(events.data(), events.size(), busy.timeout(now, waitUs)) };
+        busy.onWake(ready);
+        now             = monotonicUs();
+        for(size_t i{0}; i < ready; i++){
+            int fd { events[i].fd };
+            if(fd == listenFd){
+                acceptPeers(now);
+            }else if(fd == tunFd){
+                if(tunReader) forwardFromReader(tunFd);
+                else          forwardFromTun(tunFd);
+            }else if(auto it { peers.find(fd) }; it != peers.end()){
+                ServerPeer& peer { *(it->second) };
+                if(peer.state == PEER_ESTABLISHED){
+                    servePeer(peer, events[i].events, tunFd, now);
+                    continue;
+                }
+                // Only the session setup still reports failures by exception.
+                try{
+                    if(!handshake(peer, now)) closePeer(fd, "TLS handshake failed");
+                }catch(InetException& ex){
+                    closePeer(fd, ex.what());
+                }
+            }
+        }
+        if(egress.backlog()) serveEgress();
     }
 }
 
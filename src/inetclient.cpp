@@ -47,6 +47,8 @@ namespace inetlib{
             socketFd=socket(resElement->ai_family, resElement->ai_socktype, resElement->ai_protocol);
             if(socketFd == -1) continue;
 
+            // Buffers must be set before connect: the window scale is negotiated in the SYN.
+            tuning.apply(socketFd);
             if(connect(socketFd,resElement->ai_addr, resElement->ai_addrlen) == 0)
                 break;
         }
@@ -90,9 +92,7 @@ namespace inetlib{
         OpenSSL_add_all_algorithms();
 
         InetSSL::sslctx = SSL_CTX_new( SSLv23_client_method());
-        SSL_CTX_set_options(InetSSL::sslctx, SSL_OP_SINGLE_DH_USE);
-        SSL_CTX_use_certificate_file(InetSSL::sslctx, SSLcertificate.c_str(), SSL_FILETYPE_PEM);
-        SSL_CTX_use_PrivateKey_file(InetSSL::sslctx, SSLkey.c_str(), SSL_FILETYPE_PEM);
+        configureContext();
         handler.cSSL = SSL_new(InetSSL::sslctx);
         
         SSL_set_fd(handler.cSSL, *(handler.peerFd));
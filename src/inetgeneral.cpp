@@ -227,6 +227,15 @@ namespace inetlib{
         } 
     }
 
+    void Inet::setFdBlocking(int fd, bool blocking) anyexcept{
+        int oFlags         { fcntl(fd, F_GETFL) };
+        if(oFlags == -1) 
+           throw InetException("setFdBlocking: Error getting descriptor settings.");
+        int nFlags         { blocking ? oFlags & ~O_NONBLOCK : oFlags | O_NONBLOCK };
+        if(fcntl(fd, F_SETFL, nFlags) == -1)
+           throw InetException("setFdBlocking: Error setting descriptor settings.");
+    }
+
     void Inet::writeBuffer(const uint8_t* msg, size_t size, Handler* hdlr) const anyexcept{
         Handler  *localHandler   { hdlr ? hdlr : &handler };
    
@@ -382,6 +391,10 @@ namespace inetlib{
         sizeMax = sz;
     }
 
+    void Inet::setTuning(const SocketTuning& tun)  anyexcept{
+        tuning = tun;
+    }
+
     bool Inet::checkMultipleHeader(string header, Handler *hdlr ) anyexcept {
          while(readLineTimeoutNoErr(hdlr)) if(currentLine.starts_with(header)) return false;
          
@@ -412,6 +425,58 @@ namespace inetlib{
          EVP_cleanup();
     }
 
+    string InetSSL::lastError(void) anyexcept {
+         char          errBuff[256] {};
+         unsigned long errCode      { ERR_get_error() };
+         if(errCode == 0) return string{"no OpenSSL error"};
+         ERR_error_string_n(errCode, errBuff, sizeof(errBuff));
+         return string{errBuff};
+    }
+
+    void InetSSL::setGroups(const string& groups) anyexcept {
+         groupList = groups;
+         if(sslctx != nullptr && SSL_CTX_set1_groups_list(sslctx, groupList.c_str()) != 1)
+             throw InetException(mergeStrings({"InetSSL::setGroups : invalid key exchange groups : ", groupList, " : ", lastError()}));
+    }
+
+    void InetSSL::setCipherSuites(const string& suites) anyexcept {
+         cipherSuites = suites;
+         if(sslctx != nullptr && !cipherSuites.empty() && SSL_CTX_set_ciphersuites(sslctx, cipherSuites.c_str()) != 1)
+             throw InetException(mergeStrings({"InetSSL::setCipherSuites : invalid TLS 1.3 cipher suites : ", cipherSuites, " : ", lastError()}));
+    }
+
+    void InetSSL::setReadAhead(size_t bytes) anyexcept {
+         readAhead = bytes;
+         if(sslctx == nullptr) return;
+         // One read() fetches several records instead of a header read plus a body read for each one.
+         SSL_CTX_set_read_ahead(sslctx, readAhead != 0 ? 1 : 0);
+         if(readAhead != 0) SSL_CTX_set_default_read_buffer_len(sslctx, readAhead);
+    }
+
+    void InetSSL::configureContext(void) anyexcept {
+         if(sslctx == nullptr) throw InetException(mergeStrings({"InetSSL::configureContext : SSL_CTX_new error : ", lastError()}));
+
+         SSL_CTX_set_options(sslctx, SSL_OP_SINGLE_DH_USE);
+
+         // Any PEM key type is accepted: RSA, EC (ECDSA) or Ed25519.
+         if(SSL_CTX_use_certificate_file(sslctx, SSLcertificate.c_str(), SSL_FILETYPE_PEM) != 1)
+             throw InetException(mergeStrings({"InetSSL::configureContext : invalid certificate : ", SSLcertificate, " : ", lastError()}));
+         if(SSL_CTX_use_PrivateKey_file(sslctx, SSLkey.c_str(), SSL_FILETYPE_PEM) != 1)
+             throw InetException(mergeStrings({"InetSSL::configureContext : invalid key : ", SSLkey, " : ", lastError()}));
+         if(SSL_CTX_check_private_key(sslctx) != 1)
+             throw InetException(mergeStrings({"InetSSL::configureContext : key doesn't match certificate : ", lastError()}));
+         if(SSL_CTX_set1_groups_list(sslctx, groupList.c_str()) != 1)
+             throw InetException(mergeStrings({"InetSSL::configureContext : invalid key exchange groups : ", groupList, " : ", lastError()}));
+         if(!cipherSuites.empty() && SSL_CTX_set_ciphersuites(sslctx, cipherSuites.c_str()) != 1)
+             throw InetException(mergeStrings({"InetSSL::configureContext : invalid TLS 1.3 cipher suites : ", cipherSuites, " : ", lastError()}));
+         setReadAhead(readAhead);
+
+         if(const EVP_PKEY* pkey { X509_get0_pubkey(SSL_CTX_get0_certificate(sslctx)) }; pkey != nullptr)
+             debugmode::Debug::printLog(mergeStrings({"InetSSL : certificate key : ", EVP_PKEY_get0_type_name(pkey), 
+                                           " ", std::to_string(EVP_PKEY_get_bits(pkey)), " bits, groups : ", groupList, ", suites : ", cipherSuites.empty() ? "default" : cipherSuites}),
+                             debugmode::DEBUG_MODE::STD_DEBUG);
+    }
+
     ssize_t InetSSL::writeSSL(Handler* sslFd, void* buffer, size_t bufferLen){
          return( ::SSL_write(sslFd->cSSL, buffer, safeSizeRange<int>(bufferLen))); 
     }
@@ -15,6 +15,12 @@
 // Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
 // -----------------------------------------------------------------
 
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include <array>
+#include <vector>
+
 #include <inetgeneral.hpp>
 #include <StringUtils.hpp>
 #include <Types.hpp>
@@ -23,6 +29,8 @@ namespace inetlib{
 
     using std::string,
           std::to_string,
+          std::array,
+          std::vector,
           typeutils::safeSizeRange,
 	      stringutils::mergeStrings;
 
@@ -56,6 +64,13 @@ namespace inetlib{
                 cleanResurces();
                 throw InetException(mergeStrings({"Setsockopt Error : ", strerror(errno)}));
             }
+            // Accepted sockets inherit the listener buffers, sized before the SYN/ACK.
+            try{
+                tuning.apply(Inet::socketFd);
+            }catch(InetException&){
+                cleanResurces();
+                throw;
+            }
         
             if(::bind(Inet::socketFd, resElement->ai_addr, resElement->ai_addrlen) == 0) break;
         }
@@ -110,6 +125,18 @@ namespace inetlib{
         handler.peerFd = nullptr;
     }
 
+    static string peerToString(const Sockaddr& addr) anyexcept {
+        char  addrBuff[INET_ADDRSTRLEN] {};
+        const SockaddrIn* peer { reinterpret_cast<const SockaddrIn*>(&addr) };
+        if(inet_ntop(AF_INET, &peer->sin_addr, addrBuff, sizeof(addrBuff)) == nullptr)
+            return string{"unknown"};
+        return mergeStrings({ addrBuff, ":", to_string(ntohs(peer->sin_port)) });
+    }
+
+    string InetServer::getPeerName(void) const anyexcept {
+        return peerToString(addressIn);
+    }
+
     InetServerSSL::InetServerSSL(string cert, string key) anyexcept 
       : InetSSL(cert, key)
     {
@@ -121,9 +148,9 @@ namespace inetlib{
 
         OpenSSL_add_all_algorithms();
         InetSSL::sslctx = SSL_CTX_new( SSLv23_server_method());
-        SSL_CTX_set_options(InetSSL::sslctx, SSL_OP_SINGLE_DH_USE);
-        SSL_CTX_use_certificate_file(InetSSL::sslctx, SSLcertificate.c_str(), SSL_FILETYPE_PEM);
-        SSL_CTX_use_PrivateKey_file(InetSSL::sslctx, SSLkey.c_str(), SSL_FILETYPE_PEM);
+        configureContext();
+        // Server suite order wins, unless the client lists ChaCha20 first (no AES instructions there).
+        SSL_CTX_set_options(InetSSL::sslctx, SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_PRIORITIZE_CHACHA);
     }
 
     InetServerSSL::~InetServerSSL() noexcept {
@@ -180,6 +207,112 @@ namespace inetlib{
         }
     }
 
+    int InetServerSSL::acceptNb(SockaddrIn& peer) anyexcept {
+        socklen_t  peerLen { sizeof(peer) };
+        int        fd      { ::accept4(Inet::socketFd, reinterpret_cast<Sockaddr*>(&peer), &peerLen, SOCK_NONBLOCK | SOCK_CLOEXEC) };
+        if(fd == -1){
+            switch(errno){
+                case EAGAIN:
+                case EINTR:
+                case ECONNABORTED:
+                case EPROTO:
+                    return -1;
+                // Out of descriptors or kernel memory: the listener is fine, the caller waits.
+                case EMFILE:
+                case ENFILE:
+                case ENOBUFS:
+                case ENOMEM:
+                    return ACCEPT_EXHAUSTED;
+                default:
+                    throw InetException(mergeStrings({"InetServerSSL::acceptNb : Accept Error : ", strerror(errno)}));
+            }
+        }
+        return fd;
+    }
+
+    namespace {
+        // The client certificate isn't checked against a CA: it only ties the session to 
+        // the key that signed the handshake.
+        int acceptPeerCert(int, X509_STORE_CTX*) noexcept {
+            return 1;
+        }
+    }
+
+    // Clients send their certificate, sessions can be told apart by the key they hold.
+    void InetServerSSL::requestPeerCert(void) anyexcept {
+        if(InetSSL::sslctx == nullptr) throw InetException("InetServerSSL::requestPeerCert : no SSL context.");
+        SSL_CTX_set_verify(InetSSL::sslctx, SSL_VERIFY_PEER, acceptPeerCert);
+    }
+
+    // The identity sent by a client, bound to the public key of its certificate: a client 
+    // sending the identity of another one doesn't get the same value.
+    uint64_t InetServerSSL::bindIdentity(SSL* ssl, uint64_t identity) anyexcept {
+        X509*           cert   { SSL_get0_peer_certificate(ssl) };
+        if(cert == nullptr) throw InetException("InetServerSSL::bindIdentity : no client certificate.");
+        unsigned char*  der    { nullptr };
+        int             derLen { i2d_PUBKEY(X509_get0_pubkey(cert), &der) };
+        if(derLen <= 0) throw InetException(mergeStrings({"InetServerSSL::bindIdentity : public key encoding error : ", lastError()}));
+
+        vector<uint8_t>                  seed(der, der + derLen);
+        array<uint8_t, EVP_MAX_MD_SIZE>  digest {};
+        OPENSSL_free(der);
+        for(size_t idx{0}; idx < sizeof(uint64_t); idx++) seed.push_back(static_cast<uint8_t>(identity >> (8 * (sizeof(uint64_t) - 1 - idx))));
+        if(EVP_Digest(seed.data(), seed.size(), digest.data(), nullptr, EVP_sha256(), nullptr) != 1)
+            throw InetException("InetServerSSL::bindIdentity : digest error.");
+        uint64_t        owner  { 0 };
+        for(size_t idx{0}; idx < sizeof(uint64_t); idx++) owner = (owner << 8) | digest[idx];
+        return owner;
+    }
+
+    void InetServerSSL::prepareSocket(int fd) const anyexcept {
+        tuning.apply(fd);
+        if(timeoutRead.tv_sec != 0 || timeoutRead.tv_usec != 0){
+            if (setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const void*>(&timeoutRead), sizeof(timeoutRead)) < 0)
+                throw InetException(mergeStrings({"Set Timeout Error : ", strerror(errno)}));
+        }
+        if(timeoutWrite.tv_sec != 0 || timeoutWrite.tv_usec != 0){
+            if (setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const void*>(&timeoutWrite), sizeof(timeoutWrite)) < 0)
+                throw InetException(mergeStrings({"Set Timeout Error : ", strerror(errno)}));
+        }
+    }
+
+    void InetServerSSL::reject(int fd) noexcept {
+        // RST instead of FIN: a rejected peer leaves no TIME_WAIT state behind.
+        struct linger lng { 1, 0 };
+        static_cast<void>(setsockopt(fd, SOL_SOCKET, SO_LINGER, &lng, sizeof(lng)));
+        close(fd);
+    }
+
+    string InetServerSSL::addressToString(const SockaddrIn& peer) anyexcept {
+        return peerToString(*reinterpret_cast<const Sockaddr*>(&peer));
+    }
+
+    SSL* InetServerSSL::newSession(int fd) const anyexcept {
+        SSL* ssl { SSL_new(InetSSL::sslctx) };
+        if(ssl == nullptr) throw InetException("InetServerSSL::newSession : SSL_new error.");
+        if(SSL_set_fd(ssl, fd) != 1){
+            SSL_free(ssl);
+            throw InetException("InetServerSSL::newSession : SSL_set_fd error.");
+        }
+        SSL_set_accept_state(ssl);
+        return ssl;
+    }
+
+    HANDSHAKE_STATUS InetServerSSL::doHandshake(SSL* ssl) noexcept {
+        int hRet { SSL_do_handshake(ssl) };
+        if(hRet == 1) return HANDSHAKE_DONE;
+
+        switch(SSL_get_error(ssl, hRet)){
+            case SSL_ERROR_WANT_READ:
+            case SSL_ERROR_WANT_ASYNC_JOB:
+                return HANDSHAKE_WANT_READ;
+            case SSL_ERROR_WANT_WRITE:
+                return HANDSHAKE_WANT_WRITE;
+            default:
+                return HANDSHAKE_FAILED;
+        }
+    }
+
     void InetServerSSL::disconnect(void) anyexcept {
         if(handler.cSSL != nullptr){
                 SSL_shutdown(handler.cSSL);
@@ -0,0 +1,135 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <algorithm>
+
+#include <keepalive.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::min,
+          std::max,
+          stringutils::uint32ToUChars,
+          stringutils::charToUint32,
+          stringutils::mergeStrings;
+
+    Keepalive::Keepalive(uint64_t intervalUs, uint64_t deadPeerUs) noexcept
+       : interval { intervalUs }, deadPeer { deadPeerUs }
+    {}
+
+    void Keepalive::start(uint64_t now) noexcept{
+        lastRecv = now;
+        nextPing = now + interval;
+    }
+
+    void Keepalive::touch(uint64_t now) noexcept{
+        lastRecv = now;
+    }
+
+    bool Keepalive::pingDue(uint64_t now) const noexcept{
+        return interval != 0 && now >= nextPing;
+    }
+
+    bool Keepalive::isDead(uint64_t now) const noexcept{
+        return deadPeer != 0 && now - lastRecv >= deadPeer;
+    }
+
+    uint64_t Keepalive::nextEventUs(uint64_t now) const noexcept{
+        uint64_t next { UINT64_MAX };
+        if(interval != 0) next = nextPing > now ? nextPing - now : 0;
+        if(deadPeer != 0){
+            uint64_t deadline { lastRecv + deadPeer };
+            next = min(next, deadline > now ? deadline - now : 0);
+        }
+        return next;
+    }
+
+    size_t Keepalive::buildPing(uint8_t* dst, uint64_t now) noexcept{
+        putFrameHeader(dst, FRAME_PING, PING_PAYLOAD_LEN);
+        uint32ToUChars(dst + FRAME_HEADER_LEN, ++sequence);
+        uint32ToUChars(dst + FRAME_HEADER_LEN + 4, static_cast<uint32_t>(now >> 32));
+        uint32ToUChars(dst + FRAME_HEADER_LEN + 8, static_cast<uint32_t>(now & 0xFFFFFFFF));
+
+        nextPing = now + interval;
+        pingsSent++;
+
+        return PING_FRAME_LEN;
+    }
+
+    size_t Keepalive::buildPong(uint8_t* dst, const uint8_t* ping, size_t len) noexcept{
+        if(len != PING_PAYLOAD_LEN) return 0;
+
+        putFrameHeader(dst, FRAME_PONG, PING_PAYLOAD_LEN);
+        std::copy(ping, ping + PING_PAYLOAD_LEN, dst + FRAME_HEADER_LEN);
+
+        return PING_FRAME_LEN;
+    }
+
+    bool Keepalive::onPong(const uint8_t* payload, size_t len, uint64_t now) noexcept{
+        if(len != PING_PAYLOAD_LEN) return false;
+
+        uint32_t seq   { charToUint32(payload) };
+        uint64_t sent  { (static_cast<uint64_t>(charToUint32(payload + 4)) << 32) | charToUint32(payload + 8) };
+        if(sent > now) return false;
+        if(seq != sequence) pongsLate++;
+
+        uint64_t rtt   { now - sent };
+        pongsRecv++;
+
+        // RFC 6298 smoothing for srtt/rttvar, RFC 3550 estimator for jitter.
+        if(srtt == 0){
+            srtt    = rtt;
+            rttVar  = rtt / 2;
+            minRtt  = rtt;
+        }else{
+            uint64_t delta  { srtt > rtt ? srtt - rtt : rtt - srtt };
+            rttVar          = (3 * rttVar + delta) / 4;
+            srtt            = (7 * srtt + rtt) / 8;
+            uint64_t diff   { lastRtt > rtt ? lastRtt - rtt : rtt - lastRtt };
+            jitter          = diff > jitter ? jitter + (diff - jitter) / 16 : jitter - (jitter - diff) / 16;
+        }
+        lastRtt = rtt;
+        minRtt  = min(minRtt, rtt);
+        maxRtt  = max(maxRtt, rtt);
+
+        return true;
+    }
+
+    uint64_t Keepalive::getSrttUs(void) const noexcept{
+        return srtt;
+    }
+
+    uint64_t Keepalive::getJitterUs(void) const noexcept{
+        return jitter;
+    }
+
+    string Keepalive::report(void) const anyexcept{
+        return mergeStrings({ "pings_sent=",     to_string(pingsSent),
+                              " pongs_recv=",    to_string(pongsRecv),
+                              " pongs_late=",    to_string(pongsLate),
+                              " rtt_last_us=",   to_string(lastRtt),
+                              " rtt_min_us=",    to_string(minRtt),
+                              " rtt_max_us=",    to_string(maxRtt),
+                              " srtt_us=",       to_string(srtt),
+                              " rttvar_us=",     to_string(rttVar),
+                              " jitter_us=",     to_string(jitter) });
+    }
+
+} // End namespace
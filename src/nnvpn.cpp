@@ -16,6 +16,7 @@
 
 #include <unistd.h>
 #include <stdlib.h>
+#include <sched.h>
 
 #include <string>
 #include <iostream>
@@ -25,6 +26,7 @@
 #include <configFile.hpp>
 #include <capabilities.hpp>
 #include <inetgeneral.hpp>
+#include <benchmark.hpp>
 
 using namespace std;
 using namespace debugmode;
@@ -44,8 +46,15 @@ using configFile::IpAddr;
 #endif
 
 int main(int argc, char** argv){
-    const long       MAX_PAYLOAD  { 1500 };
-    const char       flags[]      { "hd:f:s"};
+    const long       MAX_PAYLOAD        { 1500 },
+                     MAX_READ_AHEAD     { 16L * 1024 * 1024 },
+                     MAX_TUN_BATCH      { 1024 },
+                     MAX_FLUSH_DEADLINE { 10000 },
+                     MAX_BUSY_SPIN      { 1000000 },
+                     DEFAULT_BUSY_POLL  { 50 },
+                     MAX_PACKET_ARENA   { 1024L * 1024 },
+                     MAX_EGRESS_QUEUE   { 4096 };
+    const char       flags[]      { "hd:f:sb:"};
     DEBUG_MODE       debugMode    { DEBUG_MODE::ERR_DEBUG };
     string           configFile   { "./nnvpn.lua"};
     int              ret          { 0 };
@@ -61,6 +70,16 @@ int main(int argc, char** argv){
     if(pcl.isSet('h')) printInfo(argv[0]);
     if(pcl.isSet('s')) isServer = true;
     if(pcl.isSet('f')) configFile = pcl.getValue('f');
+    if(pcl.isSet('b')){
+        try{
+            SslAllocator::install();
+            Benchmark::run(pcl.getValue('b'));
+        }catch(InetException& ex){
+            cerr << "Error: " << ex.what() << "\n";
+            return 3;
+        }
+        return 0;
+    }
 
     if(pcl.isSet('d')){
             unsigned long debug{ stoul(pcl.getValue('d')) };
@@ -89,6 +108,7 @@ int main(int argc, char** argv){
                      key          { "" },
                      device       { "" },
                      logFile      { "" };
+    TunnelOptions    tunnelOpts   {};
     try{
          ConfigFile cfg(configFile);
          try{
@@ -102,6 +122,53 @@ int main(int argc, char** argv){
              cfg.addLoadableVariable("log", "");
              cfg.addLoadableVariable("tunaddress", "");
              cfg.addLoadableVariable("tunmask", "");
+             cfg.addLoadableVariable("keepalive", tunnelOpts.keepAliveMs, true);
+             cfg.addLoadableVariable("deadpeer", tunnelOpts.deadPeerMs, true);
+             cfg.addLoadableVariable("statsinterval", tunnelOpts.statsIntervalMs, true);
+             cfg.addLoadableVariable("handshaketimeout", tunnelOpts.handshakeTimeoutMs, true);
+             cfg.addLoadableVariable("eventloop", "epoll", true);
+             cfg.addLoadableVariable("maxhandshakes", tunnelOpts.maxHandshakes, true);
+             cfg.addLoadableVariable("admissionrate", tunnelOpts.admissionRate, true);
+             cfg.addLoadableVariable("admissionburst", tunnelOpts.admissionBurst, true);
+             cfg.addLoadableVariable("tlsgroups", tunnelOpts.tlsGroups, true);
+             cfg.addLoadableVariable("ciphersuites", tunnelOpts.cipherSuites, true);
+             cfg.addLoadableVariable("ciphercache", tunnelOpts.cipherCache, true);
+             cfg.addLoadableVariable("readahead", tunnelOpts.readAheadBytes, true);
+             cfg.addLoadableVariable("idlerelease", tunnelOpts.idleReleaseMs, true);
+             cfg.addLoadableVariable("transport", "socket", true);
+             cfg.addLoadableVariable("tunbatch", tunnelOpts.tunBatch, true);
+             cfg.addLoadableVariable("tunbudget", tunnelOpts.tunBudget, true);
+             cfg.addLoadableVariable("flushdeadline", tunnelOpts.flushDeadlineUs, true);
+             cfg.addLoadableVariable("flushpackets", tunnelOpts.flushPackets, true);
+             cfg.addLoadableVariable("recordidle", tunnelOpts.recordIdleMs, true);
+             cfg.addLoadableVariable("sockprofile", "default", true);
+             cfg.addLoadableVariable("bdpinterval", tunnelOpts.bdpIntervalMs, true);
+             cfg.addLoadableVariable("bdpfactor", tunnelOpts.bdpFactor, true);
+             cfg.addLoadableVariable("zerocopy", tunnelOpts.zerocopyMin, true);
+             cfg.addLoadableVariable("busyspin", tunnelOpts.busySpinUs, true);
+             cfg.addLoadableVariable("datacpu", tunnelOpts.dataCpu, true);
+             cfg.addLoadableVariable("numalocal", tunnelOpts.numaLocal, true);
+             cfg.addLoadableVariable("rtpriority", tunnelOpts.rtPriority, true);
+             cfg.addLoadableVariable("lockmemory", tunnelOpts.lockMemory, true);
+             cfg.addLoadableVariable("hugepages", "off", true);
+             cfg.addLoadableVariable("sslpool", tunnelOpts.sslPool, true);
+             cfg.addLoadableVariable("packetarena", tunnelOpts.packetArenaKb, true);
+             cfg.addLoadableVariable("sndbuf", static_cast<long>(SocketTuning::UNSET), true);
+             cfg.addLoadableVariable("rcvbuf", static_cast<long>(SocketTuning::UNSET), true);
+             cfg.addLoadableVariable("nodelay", static_cast<long>(SocketTuning::UNSET), true);
+             cfg.addLoadableVariable("notsentlowat", static_cast<long>(SocketTuning::UNSET), true);
+             cfg.addLoadableVariable("busypoll", static_cast<long>(SocketTuning::UNSET), true);
+             cfg.addLoadableVariable("tcpcongestion", "", true);
+             cfg.addLoadableVariable("routes", "", true);
+             cfg.addLoadableVariable("acceptroutes", tunnelOpts.acceptRoutes, true);
+             cfg.addLoadableVariable("announce", "", true);
+             cfg.addLoadableVariable("addresspool", "", true);
+             cfg.addLoadableVariable("leasetime", tunnelOpts.leaseMs, true);
+             cfg.addLoadableVariable("hairpin", tunnelOpts.hairpin, true);
+             cfg.addLoadableVariable("egressqueue", tunnelOpts.egressQueue, true);
+             cfg.addLoadableVariable("weights", "", true);
+             cfg.addLoadableVariable("shapegroups", "", true);
+             cfg.addLoadableVariable("shaping", "", true);
     
              cfg.loadConfig();
     
@@ -109,12 +176,104 @@ int main(int argc, char** argv){
              port     = cfg.getConf("port").getPort(); 
              psize    = cfg.getConf("psize").getInteger(); 
              if(psize < 0 || ( psize % MAX_PAYLOAD ) != 0 ) throw ConfigFileException("Invalid payload size");
+             if(psize > static_cast<long>(FRAME_MAX_PAYLOAD)) throw ConfigFileException("Invalid payload size: too big");
              cert     = cfg.getConf("cert").getText();
              device   = cfg.getConf("device").getText();
              key      = cfg.getConf("key").getText();
              logFile  = cfg.getConf("log").getText();
-             cfg.getConf("tunaddress").getIp(tunaddress);
-             cfg.getConf("tunmask").getIp(tunmask);
+             // A client may take its tunnel address from the server pool instead.
+             tunnelOpts.autoAddress = !isServer && cfg.getConf("tunaddress").getText() == "auto";
+             if(!tunnelOpts.autoAddress){
+                 cfg.getConf("tunaddress").getIp(tunaddress);
+                 cfg.getConf("tunmask").getIp(tunmask);
+             }
+             tunnelOpts.keepAliveMs     = cfg.getConf("keepalive").getInteger();
+             tunnelOpts.deadPeerMs      = cfg.getConf("deadpeer").getInteger();
+             tunnelOpts.statsIntervalMs = cfg.getConf("statsinterval").getInteger();
+             if(tunnelOpts.keepAliveMs < 0 || tunnelOpts.deadPeerMs < 0 || tunnelOpts.statsIntervalMs < 0)
+                 throw ConfigFileException("Invalid keepalive, deadpeer or statsinterval: negative value");
+             if(tunnelOpts.deadPeerMs != 0 && tunnelOpts.deadPeerMs <= tunnelOpts.keepAliveMs)
+                 throw ConfigFileException("Invalid deadpeer: it must be greater than keepalive");
+             tunnelOpts.handshakeTimeoutMs = cfg.getConf("handshaketimeout").getInteger();
+             if(tunnelOpts.handshakeTimeoutMs <= 0) throw ConfigFileException("Invalid handshaketimeout: it must be positive");
+             tunnelOpts.maxHandshakes  = cfg.getConf("maxhandshakes").getInteger();
+             tunnelOpts.admissionRate  = cfg.getConf("admissionrate").getFloat();
+             tunnelOpts.admissionBurst = cfg.getConf("admissionburst").getFloat();
+             if(tunnelOpts.maxHandshakes < 0 || tunnelOpts.admissionRate < 0.0 || tunnelOpts.admissionBurst < 1.0)
+                 throw ConfigFileException("Invalid maxhandshakes, admissionrate or admissionburst");
+             tunnelOpts.tlsGroups      = cfg.getConf("tlsgroups").getText();
+             if(tunnelOpts.tlsGroups.empty()) throw ConfigFileException("Invalid tlsgroups: empty list");
+             tunnelOpts.cipherSuites   = cfg.getConf("ciphersuites").getText();
+             tunnelOpts.cipherCache    = cfg.getConf("ciphercache").getText();
+             if(tunnelOpts.cipherSuites.empty()) throw ConfigFileException("Invalid ciphersuites: empty list");
+             tunnelOpts.readAheadBytes = cfg.getConf("readahead").getInteger();
+             tunnelOpts.idleReleaseMs  = cfg.getConf("idlerelease").getInteger();
+             if(tunnelOpts.readAheadBytes < 0 || tunnelOpts.readAheadBytes > MAX_READ_AHEAD || tunnelOpts.idleReleaseMs < 0)
+                 throw ConfigFileException("Invalid readahead or idlerelease");
+             tunnelOpts.tunBatch       = cfg.getConf("tunbatch").getInteger();
+             tunnelOpts.tunBudget      = cfg.getConf("tunbudget").getInteger();
+             if(tunnelOpts.tunBatch < 1 || tunnelOpts.tunBatch > MAX_TUN_BATCH || tunnelOpts.tunBudget < psize)
+                 throw ConfigFileException("Invalid tunbatch or tunbudget");
+             tunnelOpts.flushDeadlineUs = cfg.getConf("flushdeadline").getInteger();
+             tunnelOpts.flushPackets    = cfg.getConf("flushpackets").getInteger();
+             if(tunnelOpts.flushDeadlineUs < 0 || tunnelOpts.flushDeadlineUs > MAX_FLUSH_DEADLINE || tunnelOpts.flushPackets < 1)
+                 throw ConfigFileException("Invalid flushdeadline or flushpackets");
+             tunnelOpts.recordIdleMs    = cfg.getConf("recordidle").getInteger();
+             if(tunnelOpts.recordIdleMs < 0) throw ConfigFileException("Invalid recordidle: negative value");
+             tunnelOpts.bdpIntervalMs   = cfg.getConf("bdpinterval").getInteger();
+             tunnelOpts.bdpFactor       = cfg.getConf("bdpfactor").getFloat();
+             if(tunnelOpts.bdpIntervalMs < 0 || tunnelOpts.bdpFactor < 1.0 || tunnelOpts.bdpFactor > 4.0)
+                 throw ConfigFileException("Invalid bdpinterval or bdpfactor");
+             tunnelOpts.zerocopyMin     = cfg.getConf("zerocopy").getInteger();
+             if(tunnelOpts.zerocopyMin < 0) throw ConfigFileException("Invalid zerocopy: negative value");
+             tunnelOpts.busySpinUs      = cfg.getConf("busyspin").getInteger();
+             tunnelOpts.dataCpu         = cfg.getConf("datacpu").getInteger();
+             if(tunnelOpts.busySpinUs < 0 || tunnelOpts.busySpinUs > MAX_BUSY_SPIN || tunnelOpts.dataCpu < -1 || tunnelOpts.dataCpu >= CPU_SETSIZE)
+                 throw ConfigFileException("Invalid busyspin or datacpu");
+             tunnelOpts.numaLocal       = cfg.getConf("numalocal").getBool();
+             tunnelOpts.rtPriority      = cfg.getConf("rtpriority").getInteger();
+             tunnelOpts.lockMemory      = cfg.getConf("lockmemory").getBool();
+             if(tunnelOpts.numaLocal && tunnelOpts.dataCpu < 0) throw ConfigFileException("Invalid numalocal: it requires datacpu");
+             if(tunnelOpts.rtPriority < 0 || tunnelOpts.rtPriority > sched_get_priority_max(SCHED_FIFO))
+                 throw ConfigFileException("Invalid rtpriority");
+             tunnelOpts.sslPool         = cfg.getConf("sslpool").getBool();
+             tunnelOpts.packetArenaKb   = cfg.getConf("packetarena").getInteger();
+             if(tunnelOpts.packetArenaKb < 0 || tunnelOpts.packetArenaKb > MAX_PACKET_ARENA) throw ConfigFileException("Invalid packetarena");
+             tunnelOpts.acceptRoutes    = cfg.getConf("acceptroutes").getBool();
+             tunnelOpts.leaseMs         = cfg.getConf("leasetime").getInteger();
+             if(tunnelOpts.leaseMs < 0) throw ConfigFileException("Invalid leasetime: negative value");
+             tunnelOpts.hairpin         = cfg.getConf("hairpin").getBool();
+             tunnelOpts.egressQueue     = cfg.getConf("egressqueue").getInteger();
+             if(tunnelOpts.egressQueue < 0 || tunnelOpts.egressQueue > MAX_EGRESS_QUEUE) throw ConfigFileException("Invalid egressqueue");
+             try{
+                 tunnelOpts.eventBackend = EventLoop::backendFromName(cfg.getConf("eventloop").getText());
+                 tunnelOpts.transport    = BioChannel::transportFromName(cfg.getConf("transport").getText());
+                 tunnelOpts.hugePages    = PacketArena::modeFromName(cfg.getConf("hugepages").getText());
+                 tunnelOpts.tuning       = SocketTuning::fromProfile(cfg.getConf("sockprofile").getText());
+                 for(auto [var, field] : { pair{"sndbuf", &SocketTuning::sndBuf},        pair{"rcvbuf", &SocketTuning::rcvBuf},
+                                           pair{"nodelay", &SocketTuning::noDelay},      pair{"notsentlowat", &SocketTuning::notSentLowat},
+                                           pair{"busypoll", &SocketTuning::busyPollUs} }){
+                     long value { cfg.getConf(var).getInteger() };
+                     if(value < SocketTuning::UNSET || value > INT32_MAX) throw ConfigFileException(string{"Invalid "} + var);
+                     if(value != SocketTuning::UNSET) tunnelOpts.tuning.*field = static_cast<int>(value);
+                 }
+                 if(string cc { cfg.getConf("tcpcongestion").getText() }; !cc.empty()) tunnelOpts.tuning.congestion = cc;
+                 // Spinning on epoll doesn't reach the NIC queues without socket busy polling.
+                 if(tunnelOpts.busySpinUs != 0 && tunnelOpts.tuning.busyPollUs == SocketTuning::UNSET) 
+                     tunnelOpts.tuning.busyPollUs = static_cast<int>(min(tunnelOpts.busySpinUs, DEFAULT_BUSY_POLL));
+                 tunnelOpts.tuning.validate();
+                 tunnelOpts.staticRoutes   = RouteTable::parseRoutes(cfg.getConf("routes").getText());
+                 tunnelOpts.announceRoutes = RouteTable::parsePrefixes(cfg.getConf("announce").getText());
+                 if(string range { cfg.getConf("addresspool").getText() }; !range.empty()){
+                     tunnelOpts.addressPool = RouteTable::parsePrefix(range);
+                     if(tunnelOpts.addressPool.len < POOL_MIN_PREFIX || tunnelOpts.addressPool.len > POOL_MAX_PREFIX)
+                         throw ConfigFileException("Invalid addresspool: the prefix length must be between 16 and 30");
+                 }
+                 tunnelOpts.weights        = EgressScheduler::parseWeights(cfg.getConf("weights").getText());
+                 tunnelOpts.shaping        = Shaper::parse(cfg.getConf("shapegroups").getText(), cfg.getConf("shaping").getText());
+             }catch(InetException& ex){
+                 throw ConfigFileException(ex.what());
+             }
          } catch(ConfigFileException& ex){
              ret = 1;
              string msg {"Error loading configuration file: "};
@@ -137,7 +296,11 @@ int main(int argc, char** argv){
          Capability cpb;
          try{
              cpb.init(true); 
-             cpb.reducePriv("cap_net_admin+ep");
+             // SCHED_FIFO and mlockall past RLIMIT_MEMLOCK keep needing their capabilities later.
+             string caps { "cap_net_admin" };
+             if(tunnelOpts.rtPriority != 0) caps.append(",cap_sys_nice");
+             if(tunnelOpts.lockMemory)      caps.append(",cap_ipc_lock");
+             cpb.reducePriv(caps + "+ep");
              cpb.getCredential();
              if(debugMode > 1) cpb.printStatus();
          }catch(const CapabilityException& ex){
@@ -151,12 +314,25 @@ int main(int argc, char** argv){
          }
 
          try{
+             // Pinned first: buffers are then allocated and touched on the data plane core's node.
+             if(tunnelOpts.dataCpu >= 0){
+                 CpuPlacement::pinThread(static_cast<int>(tunnelOpts.dataCpu));
+                 if(int node { CpuPlacement::nodeOfCpu(static_cast<int>(tunnelOpts.dataCpu)) }; tunnelOpts.numaLocal && node >= 0) 
+                     CpuPlacement::preferNode(node);
+             }
+             // Nothing has touched OpenSSL yet: its allocator can still be replaced.
+             if(tunnelOpts.sslPool && !SslAllocator::install())
+                 Debug::printLog("SslAllocator : OpenSSL already allocated, using malloc.", DEBUG_MODE::ERR_DEBUG);
+             if(tunnelOpts.hugePages != HUGEPAGE_OFF){
+                 PacketArena::reserve(static_cast<size_t>(tunnelOpts.packetArenaKb) * 1024, tunnelOpts.hugePages);
+                 Debug::printLog(PacketArena::report(), DEBUG_MODE::ERR_DEBUG);
+             }
              if(isServer){
-                  NnVpnServer svpn(cert, key, address, to_string(port), device, psize);
+                  NnVpnServer svpn(cert, key, address, to_string(port), device, psize, tunnelOpts);
                   svpn.init(tunaddress, tunmask);
                   svpn.start();
              } else {
-                  NnVpnClient cvpn(cert, key, address, to_string(port), device, psize);;
+                  NnVpnClient cvpn(cert, key, address, to_string(port), device, psize, tunnelOpts);
                   cvpn.init(tunaddress, tunmask);
                   cvpn.start();
              }
@@ -178,10 +354,11 @@ int main(int argc, char** argv){
 }
 
 void printInfo(char* cmd){
-      cerr << cmd << " [-f <config_full_path>] [-d level] [-s] | [-h]\n\n";
+      cerr << cmd << " [-f <config_full_path>] [-d level] [-s] | [-b <benchmark>] | [-h]\n\n";
       cerr << " -f  <full_path> Specify the configuration file path\n";
       cerr << " -d  <dbg_level> set debug mode\n";
       cerr << " -s              set server mode\n";
+      cerr << " -b  <benchmark> run a built-in benchmark and exit (handshake, cipher, eventloop, syscalls, zerocopy, forwarding, routes)\n";
       cerr << " -h              print this synopsis\n";
       exit(EXIT_FAILURE);
 }
@@ -0,0 +1,148 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <sys/mman.h>
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#include <packetArena.hpp>
+#include <inetgeneral.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::max,
+          debugmode::Debug,
+          debugmode::DEBUG_MODE,
+          stringutils::mergeStrings;
+
+    // Explicit huge pages need a preallocated pool (vm.nr_hugepages): without it the
+    // mapping fails and the arena falls back to transparent huge pages, then to small pages.
+    uint8_t* PacketArena::mapRegion(size_t bytes, HUGEPAGE_MODE mode) noexcept{
+        if(mode == HUGEPAGE_HUGETLB){
+            void* region { mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0) };
+            if(region != MAP_FAILED){
+                backing = "hugetlb";
+                return static_cast<uint8_t*>(region);
+            }
+            Debug::printLog(mergeStrings({"PacketArena : MAP_HUGETLB failed, using THP : ", strerror(errno)}), DEBUG_MODE::ERR_DEBUG);
+        }
+
+        // THP only backs 2MB aligned ranges: map one page more and trim both ends.
+        void* region { mmap(nullptr, bytes + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) };
+        if(region == MAP_FAILED) return nullptr;
+        uintptr_t start   { reinterpret_cast<uintptr_t>(region) },
+                  aligned { (start + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1) };
+        if(aligned != start) munmap(region, aligned - start);
+        munmap(reinterpret_cast<void*>(aligned + bytes), start + HUGE_PAGE - aligned);
+
+        backing = madvise(reinterpret_cast<void*>(aligned), bytes, MADV_HUGEPAGE) == 0 ? "thp" : "pages";
+        return reinterpret_cast<uint8_t*>(aligned);
+    }
+
+    void PacketArena::reserve(size_t bytes, HUGEPAGE_MODE mode) anyexcept{
+        if(base != nullptr) throw InetException("PacketArena::reserve : arena already reserved.");
+        if(mode == HUGEPAGE_OFF || bytes == 0) return;
+
+        size_t   rounded { (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE };
+        uint8_t* region  { mapRegion(rounded, mode) };
+        if(region == nullptr){
+            Debug::printLog(mergeStrings({"PacketArena : reservation failed, using the heap : ", strerror(errno)}), DEBUG_MODE::ERR_DEBUG);
+            return;
+        }
+        base     = region;
+        capacity = rounded;
+    }
+
+    uint8_t* PacketArena::acquire(size_t bytes) anyexcept{
+        if(base == nullptr) return nullptr;
+
+        size_t rounded { (bytes + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN };
+        uint8_t* block { nullptr };
+        if(auto list { freeLists.find(rounded) }; list != freeLists.end() && !list->second.empty()){
+            block = list->second.back();
+            list->second.pop_back();
+        }else if(capacity - used >= rounded){
+            block  = base + used;
+            used  += rounded;
+        }else{
+            fallbacks++;
+            return nullptr;
+        }
+        inUse += rounded;
+        peak   = max(peak, inUse);
+        return block;
+    }
+
+    void PacketArena::release(uint8_t* block, size_t bytes) noexcept{
+        size_t rounded { (bytes + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN };
+        inUse -= rounded;
+        try{
+            freeLists[rounded].push_back(block);
+        }catch(...){
+            // The block stays unused: the arena only shrinks, nothing is corrupted.
+        }
+    }
+
+    string PacketArena::report(void) anyexcept{
+        return mergeStrings({ "PACKET ARENA : reserved=", to_string(capacity),
+                              " backing=",   backing,
+                              " carved=",    to_string(used),
+                              " in_use=",    to_string(inUse),
+                              " peak=",      to_string(peak),
+                              " fallbacks=", to_string(fallbacks) });
+    }
+
+    HUGEPAGE_MODE PacketArena::modeFromName(const string& name) anyexcept{
+        if(name == "off")     return HUGEPAGE_OFF;
+        if(name == "thp")     return HUGEPAGE_THP;
+        if(name == "hugetlb") return HUGEPAGE_HUGETLB;
+        throw InetException(mergeStrings({"PacketArena::modeFromName : unknown huge page mode : ", name}));
+    }
+
+    PacketBuffer::PacketBuffer(size_t bytes) anyexcept
+        : block { PacketArena::acquire(bytes) }, len { bytes }
+    {
+        if(block == nullptr){
+            heap.resize(bytes);
+            return;
+        }
+        // Arena blocks may be recycled: start from the same zeroed state as the heap buffer.
+        memset(block, 0, bytes);
+    }
+
+    PacketBuffer::~PacketBuffer(void) noexcept{
+        if(heap.empty()) PacketArena::release(block, len);
+    }
+
+    uint8_t* PacketBuffer::data(void) noexcept{
+        return heap.empty() ? block : heap.data();
+    }
+
+    const uint8_t* PacketBuffer::data(void) const noexcept{
+        return heap.empty() ? block : heap.data();
+    }
+
+    size_t PacketBuffer::size(void) const noexcept{
+        return len;
+    }
+
+} // End namespace
@@ -0,0 +1,103 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+
+#include <algorithm>
+
+#include <recordSizer.hpp>
+#include <frames.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::min,
+          std::max,
+          stringutils::mergeStrings;
+
+    RecordSizer::RecordSizer(SSL* ssl, int fd, uint64_t idleUs) noexcept
+        : cSSL { ssl }, sockFd { fd }, idle { idleUs }, current { TLS_MAX_RECORD }, enabled { idleUs != 0 }
+    {}
+
+    // MSS and cutoff are read again at every idle restart: both may have changed since.
+    bool RecordSizer::probe(void) noexcept{
+        struct tcp_info info {};
+        socklen_t       len   { sizeof(info) };
+        if(getsockopt(sockFd, IPPROTO_TCP, TCP_INFO, &info, &len) == -1 || info.tcpi_snd_mss == 0) return false;
+        size_t mss { info.tcpi_snd_mss };
+        smallLen = std::clamp(mss - min(TLS_OVERHEAD, mss), MIN_FRAGMENT, TLS_MAX_RECORD);
+
+        unsigned int lowat { 0 };
+        len = sizeof(lowat);
+        if(getsockopt(sockFd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, &len) == -1 || lowat == 0) lowat = TLS_MAX_RECORD;
+        cutoff   = max(smallLen, min(static_cast<size_t>(lowat), TLS_MAX_RECORD));
+        return true;
+    }
+
+    void RecordSizer::apply(size_t len) noexcept{
+        current = len;
+        SSL_set_max_send_fragment(cSSL, len);
+    }
+
+    size_t RecordSizer::update(uint64_t now) noexcept{
+        if(!enabled) return current;
+
+        if(lastWrite == 0 || now - lastWrite > idle){
+            sinceIdle = 0;
+            if(!probe()){
+                enabled = false;
+                return current;
+            }
+            if(!small){
+                small = true;
+                shrinks++;
+            }
+            apply(smallLen);
+        }
+        lastWrite = now;
+
+        if(small){
+            int unsent { 0 };
+            if(sinceIdle >= BOOST_BYTES || 
+               (ioctl(sockFd, SIOCOUTQNSD, &unsent) == 0 && static_cast<size_t>(unsent) >= cutoff)){
+                small = false;
+                grows++;
+                apply(TLS_MAX_RECORD);
+            }
+        }
+        return current;
+    }
+
+    void RecordSizer::onWrite(size_t bytes) noexcept{
+        if(small) sinceIdle += bytes;
+    }
+
+    string RecordSizer::report(void) const anyexcept{
+        return mergeStrings({ "record=",   to_string(current),
+                              " small=",   to_string(smallLen),
+                              " cutoff=",  to_string(cutoff),
+                              " shrinks=", to_string(shrinks),
+                              " grows=",   to_string(grows) });
+    }
+
+} // End namespace
@@ -0,0 +1,435 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <arpa/inet.h>
+
+#include <cstdlib>
+#include <sstream>
+#include <utility>
+
+#include <routeTable.hpp>
+#include <inetgeneral.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::vector,
+          std::istringstream,
+          stringutils::mergeStrings;
+
+    RouteTable::RouteTable(void) anyexcept
+       : rootEntry(ROOT_SLOTS, 0), rootDepth(ROOT_SLOTS, 0)
+    {
+        hops.push_back(Hop{ 0, -1, 0 });
+    }
+
+    uint64_t RouteTable::key(Prefix prefix) noexcept{
+        return (static_cast<uint64_t>(prefix.addr) << 8) | prefix.len;
+    }
+
+    uint32_t RouteTable::at(size_t level, size_t index, size_t slot) const noexcept{
+        const Node& node  { chunks[level].nodes[index] };
+        size_t      word  { slot >> 6 };
+        uint64_t    upTo  { node.runs[word] & (UINT64_MAX >> (63 - (slot & 63))) };
+        return chunks[level].entry[node.base + node.rank[word] + static_cast<size_t>(__builtin_popcountll(upTo)) - 1];
+    }
+
+    uint32_t RouteTable::lookup(uint32_t dst) const noexcept{
+        uint32_t entry { rootEntry[dst >> 16] };
+        if(entry & CHUNK_FLAG){
+            entry = at(0, entry & ~CHUNK_FLAG, (dst >> 8) & 0xFF);
+            if(entry & CHUNK_FLAG) entry = at(1, entry & ~CHUNK_FLAG, dst & 0xFF);
+        }
+        return entry;
+    }
+
+    int RouteTable::resolve(uint32_t dst) const noexcept{
+        return hops[lookup(dst)].fd;
+    }
+
+    // Segments are power of two sized and recycled by size: the pool doesn't fragment.
+    uint32_t RouteTable::segment(Level& level, uint8_t order) anyexcept{
+        if(!level.spare[order].empty()){
+            uint32_t base { level.spare[order].back() };
+            level.spare[order].pop_back();
+            return base;
+        }
+        uint32_t base { static_cast<uint32_t>(level.entry.size()) };
+        level.entry.resize(level.entry.size() + (size_t{1} << order), 0);
+        level.depth.resize(level.depth.size() + (size_t{1} << order), 0);
+        return base;
+    }
+
+    void RouteTable::expand(size_t level, size_t index, Slots& slots) const noexcept{
+        const Node& node { chunks[level].nodes[index] };
+        size_t      run  { node.base };
+        for(size_t slot{0}; slot < CHUNK_SLOTS; slot++){
+            if(slot != 0 && (node.runs[slot >> 6] & (1ULL << (slot & 63)))) run++;
+            slots.entry[slot] = chunks[level].entry[run];
+            slots.depth[slot] = chunks[level].depth[run];
+        }
+    }
+
+    // A chunk moves to a larger segment when its runs outgrow it, never to a smaller one.
+    // Removals can add runs too, splitting a run of equal slots: newChunk() keeps room for 
+    // every chunk to grow to a full segment, so compress() doesn't allocate.
+    void RouteTable::compress(const Slots& slots, size_t level, size_t index) anyexcept{
+        Level&   lvl   { chunks[level] };
+        size_t   count { 0 };
+        uint8_t  order { 0 };
+        for(size_t slot{0}; slot < CHUNK_SLOTS; slot++)
+            if(slot == 0 || slots.entry[slot] != slots.entry[slot - 1] || slots.depth[slot] != slots.depth[slot - 1]) count++;
+        while((size_t{1} << order) < count) order++;
+
+        if(order > lvl.nodes[index].order){
+            uint32_t base { segment(lvl, order) };
+            Node&    node { lvl.nodes[index] };
+            lvl.spare[node.order].push_back(node.base);
+            node.base  = base;
+            node.order = order;
+        }
+
+        Node&    node  { lvl.nodes[index] };
+        size_t   run   { node.base };
+        node.runs.fill(0);
+        for(size_t slot{0}; slot < CHUNK_SLOTS; slot++){
+            if((slot & 63) == 0) node.rank[slot >> 6] = static_cast<uint16_t>(run - node.base);
+            if(slot == 0 || slots.entry[slot] != slots.entry[slot - 1] || slots.depth[slot] != slots.depth[slot - 1]){
+                node.runs[slot >> 6] |= 1ULL << (slot & 63);
+                lvl.entry[run] = slots.entry[slot];
+                lvl.depth[run] = slots.depth[slot];
+                run++;
+            }
+        }
+    }
+
+    // A slot gets a chunk the first time a longer prefix falls in it: a single run holding 
+    // the slot value, so the shorter routes covering it keep matching. Pruned chunks are 
+    // reused first, with the segment they had.
+    size_t RouteTable::newChunk(size_t level, uint32_t entry, uint8_t depth) anyexcept{
+        Level&  lvl   { chunks[level] };
+        size_t  index { lvl.nodes.size() };
+        if(!lvl.freeNodes.empty()){
+            index = lvl.freeNodes.back();
+            lvl.freeNodes.pop_back();
+        }else{
+            Node node {};
+            node.base  = segment(lvl, 0);
+            lvl.nodes.push_back(node);
+            // Room for prune() and remove(): releasing a chunk doesn't allocate, nor does 
+            // growing one. A chunk passes each segment order at most once, adding 2^order 
+            // slots to the pool and its previous segment to the spares.
+            lvl.freeNodes.reserve(lvl.nodes.capacity());
+            lvl.entry.reserve(lvl.nodes.capacity() * (2 * CHUNK_SLOTS - 1));
+            lvl.depth.reserve(lvl.nodes.capacity() * (2 * CHUNK_SLOTS - 1));
+            for(auto& spare : lvl.spare) spare.reserve(lvl.nodes.capacity());
+        }
+        Node&   node  { lvl.nodes[index] };
+        node.runs            = { 1, 0, 0, 0 };
+        node.rank            = { 0, 1, 1, 1 };
+        lvl.entry[node.base] = entry;
+        lvl.depth[node.base] = depth;
+        return index;
+    }
+
+    size_t RouteTable::rootChild(size_t slot) anyexcept{
+        if(rootEntry[slot] & CHUNK_FLAG) return rootEntry[slot] & ~CHUNK_FLAG;
+        size_t index { newChunk(0, rootEntry[slot], rootDepth[slot]) };
+        rootEntry[slot] = CHUNK_FLAG | static_cast<uint32_t>(index);
+        return index;
+    }
+
+    size_t RouteTable::midChild(size_t mid, size_t slot) anyexcept{
+        if(uint32_t entry { at(0, mid, slot) }; entry & CHUNK_FLAG) return entry & ~CHUNK_FLAG;
+
+        Slots slots;
+        expand(0, mid, slots);
+        size_t index { newChunk(1, slots.entry[slot], slots.depth[slot]) };
+        slots.entry[slot] = CHUNK_FLAG | static_cast<uint32_t>(index);
+        compress(slots, 0, mid);
+        return index;
+    }
+
+    // A single run: the chunk holds nothing its parent slot couldn't.
+    bool RouteTable::uniform(size_t level, size_t index) const noexcept{
+        const Node& node { chunks[level].nodes[index] };
+        return node.runs == std::array<uint64_t, 4>{ 1, 0, 0, 0 } && (chunks[level].entry[node.base] & CHUNK_FLAG) == 0;
+    }
+
+    // After a removal, the chunks on the address path left uniform go back to their parent 
+    // slot: routes coming and going with the sessions don't leave empty chunks behind.
+    // The parent loses a run, or keeps the count: compress() doesn't allocate.
+    void RouteTable::prune(uint32_t addr) noexcept{
+        if((rootEntry[addr >> 16] & CHUNK_FLAG) == 0) return;
+        size_t mid  { rootEntry[addr >> 16] & ~CHUNK_FLAG },
+               slot { (addr >> 8) & 0xFF };
+        if(uint32_t entry { at(0, mid, slot) }; entry & CHUNK_FLAG){
+            size_t leaf { entry & ~CHUNK_FLAG };
+            if(!uniform(1, leaf)) return;
+            Slots slots;
+            expand(0, mid, slots);
+            slots.entry[slot] = chunks[1].entry[chunks[1].nodes[leaf].base];
+            slots.depth[slot] = chunks[1].depth[chunks[1].nodes[leaf].base];
+            compress(slots, 0, mid);
+            chunks[1].freeNodes.push_back(static_cast<uint32_t>(leaf));
+        }
+        if(!uniform(0, mid)) return;
+        rootEntry[addr >> 16] = chunks[0].entry[chunks[0].nodes[mid].base];
+        rootDepth[addr >> 16] = chunks[0].depth[chunks[0].nodes[mid].base];
+        chunks[0].freeNodes.push_back(static_cast<uint32_t>(mid));
+    }
+
+    // Slots currently matched by a prefix no longer than ceiling take the new hop; longer 
+    // prefixes inside the range keep theirs. The chunks on the prefix path must exist.
+    void RouteTable::paint(Prefix prefix, uint32_t hop, uint8_t len, uint8_t ceiling) noexcept{
+        if(prefix.len <= 16){
+            fillRoot(prefix.addr >> 16, size_t{1} << (16 - prefix.len), hop, len, ceiling);
+            return;
+        }
+        size_t mid  { rootEntry[prefix.addr >> 16] & ~CHUNK_FLAG };
+        if(prefix.len <= 24){
+            fillChunk(0, mid, (prefix.addr >> 8) & 0xFF, size_t{1} << (24 - prefix.len), hop, len, ceiling);
+            return;
+        }
+        size_t leaf { at(0, mid, (prefix.addr >> 8) & 0xFF) & ~CHUNK_FLAG };
+        fillChunk(1, leaf, prefix.addr & 0xFF, size_t{1} << (32 - prefix.len), hop, len, ceiling);
+    }
+
+    void RouteTable::fillRoot(size_t first, size_t count, uint32_t hop, uint8_t len, uint8_t ceiling) noexcept{
+        for(size_t slot { first }; slot < first + count; slot++){
+            if(rootEntry[slot] & CHUNK_FLAG){
+                fillChunk(0, rootEntry[slot] & ~CHUNK_FLAG, 0, CHUNK_SLOTS, hop, len, ceiling);
+            }else if(rootDepth[slot] <= ceiling){
+                rootEntry[slot] = hop;
+                rootDepth[slot] = len;
+            }
+        }
+    }
+
+    void RouteTable::fillChunk(size_t level, size_t index, size_t first, size_t count, uint32_t hop, uint8_t len, uint8_t ceiling) noexcept{
+        Slots slots;
+        expand(level, index, slots);
+        for(size_t slot { first }; slot < first + count; slot++){
+            if(slots.entry[slot] & CHUNK_FLAG){
+                fillChunk(level + 1, slots.entry[slot] & ~CHUNK_FLAG, 0, CHUNK_SLOTS, hop, len, ceiling);
+            }else if(slots.depth[slot] <= ceiling){
+                slots.entry[slot] = hop;
+                slots.depth[slot] = len;
+            }
+        }
+        compress(slots, level, index);
+    }
+
+    // False when the prefix is already routed: the first owner keeps it.
+    bool RouteTable::insert(Prefix prefix, uint32_t hop, ROUTE_ORIGIN origin) anyexcept{
+        if(!validPrefix(prefix) || hop == 0 || hop >= hops.size())
+            throw InetException(mergeStrings({"RouteTable::insert : invalid route : ", prefixText(prefix)}));
+        if(routes.contains(key(prefix))) return false;
+
+        if(prefix.len > 16){
+            size_t mid { rootChild(prefix.addr >> 16) };
+            if(prefix.len > 24) static_cast<void>(midChild(mid, (prefix.addr >> 8) & 0xFF));
+        }
+        routes.emplace(key(prefix), Route{ hop, origin });
+        byOrigin[origin]++;
+        hops[hop].refs++;
+        paint(prefix, hop, prefix.len, prefix.len);
+        return true;
+    }
+
+    // The slots go back to the longest remaining prefix covering the removed one, if any.
+    bool RouteTable::remove(Prefix prefix) noexcept{
+        auto it { routes.find(key(prefix)) };
+        if(it == routes.end()) return false;
+        byOrigin[it->second.origin]--;
+        hops[it->second.hop].refs--;
+        routes.erase(it);
+
+        uint32_t hop { 0 };
+        uint8_t  len { 0 };
+        for(uint8_t shorter { prefix.len }; shorter-- > 0;){
+            Prefix cover { prefix.addr & prefixMask(shorter), shorter };
+            if(auto found { routes.find(key(cover)) }; found != routes.end()){
+                hop = found->second.hop;
+                len = shorter;
+                break;
+            }
+        }
+        paint(prefix, hop, len, prefix.len);
+        if(prefix.len > 16) prune(prefix.addr);
+        return true;
+    }
+
+    uint32_t RouteTable::newHop(uint32_t inner, int fd) anyexcept{
+        if(!freeHops.empty()){
+            uint32_t hop { freeHops.back() };
+            freeHops.pop_back();
+            hops[hop] = Hop{ inner, fd, 0 };
+            return hop;
+        }
+        hops.push_back(Hop{ inner, fd, 0 });
+        // Room for dropPeer(): freeing hops doesn't allocate.
+        freeHops.reserve(hops.size());
+        return static_cast<uint32_t>(hops.size() - 1);
+    }
+
+    // The hop of a client inner address: configured routes point to it before the client connects.
+    uint32_t RouteTable::hopForAddr(uint32_t inner) anyexcept{
+        if(auto it { addrHops.find(inner) }; it != addrHops.end()) return it->second;
+        uint32_t hop { newHop(inner, -1) };
+        addrHops.emplace(inner, hop);
+        return hop;
+    }
+
+    // The hop of a session, for the prefixes it announced: it goes away with the session.
+    uint32_t RouteTable::hopForPeer(int fd) anyexcept{
+        if(auto it { peerHops.find(fd) }; it != peerHops.end()) return it->second;
+        uint32_t hop { newHop(0, fd) };
+        peerHops.emplace(fd, hop);
+        return hop;
+    }
+
+    // The session bound to the hop of an inner address, -1 if none.
+    int RouteTable::holder(uint32_t inner) const noexcept{
+        auto it { addrHops.find(inner) };
+        return it == addrHops.end() ? -1 : hops[it->second].fd;
+    }
+
+    // Returns the session previously bound to the hop, -1 if none.
+    int RouteTable::bind(uint32_t hop, int fd) noexcept{
+        int previous { hops[hop].fd };
+        hops[hop].fd = fd;
+        return previous;
+    }
+
+    // Learned, leased and announced routes leave with the session, configured ones stay 
+    // unbound until their next hop connects again. Address hops no route points to anymore
+    // are freed with the session hop.
+    void RouteTable::dropPeer(int fd) noexcept{
+        for(auto it { routes.begin() }; it != routes.end();){
+            Prefix  prefix { static_cast<uint32_t>(it->first >> 8), static_cast<uint8_t>(it->first & 0xFF) };
+            bool    owned  { it->second.origin != ROUTE_STATIC && hops[it->second.hop].fd == fd };
+            ++it;
+            if(owned) static_cast<void>(remove(prefix));
+        }
+        for(auto it { addrHops.begin() }; it != addrHops.end();){
+            if(Hop& hop { hops[it->second] }; hop.fd == fd && hop.refs == 0){
+                hop = Hop{ 0, -1, 0 };
+                freeHops.push_back(it->second);
+                it = addrHops.erase(it);
+            }else{
+                ++it;
+            }
+        }
+        for(auto& hop : hops) if(hop.fd == fd) hop.fd = -1;
+        if(auto it { peerHops.find(fd) }; it != peerHops.end()){
+            hops[it->second] = Hop{ 0, -1, 0 };
+            freeHops.push_back(it->second);
+            peerHops.erase(it);
+        }
+    }
+
+    size_t RouteTable::size(void) const noexcept{
+        return routes.size();
+    }
+
+    string RouteTable::report(void) const anyexcept{
+        size_t bytes { rootEntry.size() * sizeof(uint32_t) + rootDepth.size() };
+        for(const auto& level : chunks) bytes += level.nodes.size() * sizeof(Node) + level.entry.size() * (sizeof(uint32_t) + 1);
+        return mergeStrings({ "ROUTES : prefixes=", to_string(routes.size()), 
+                              " static=",    to_string(byOrigin[ROUTE_STATIC]),
+                              " learned=",   to_string(byOrigin[ROUTE_LEARNED]),
+                              " announced=", to_string(byOrigin[ROUTE_ANNOUNCED]),
+                              " leased=",    to_string(byOrigin[ROUTE_LEASED]),
+                              " hops=",      to_string(hops.size() - 1 - freeHops.size()),
+                              " chunks=",    to_string(chunks[0].nodes.size() - chunks[0].freeNodes.size()), "/", 
+                                             to_string(chunks[1].nodes.size() - chunks[1].freeNodes.size()),
+                              " memory=",    to_string(bytes / 1024), "KB" });
+    }
+
+    // a.b.c.d/len, or a bare address for a host route.
+    Prefix RouteTable::parsePrefix(const string& text) anyexcept{
+        size_t   slash { text.find('/') };
+        string   addr  { text.substr(0, slash) };
+        in_addr  bin   {};
+        long     len   { 32 };
+
+        if(inet_pton(AF_INET, addr.c_str(), &bin) != 1)
+            throw InetException(mergeStrings({"RouteTable::parsePrefix : invalid address : ", text}));
+        if(slash != string::npos){
+            string  bits  { text.substr(slash + 1) };
+            char*   end   { nullptr };
+            len           = strtol(bits.c_str(), &end, 10);
+            if(bits.empty() || *end != '\0' || len < 0 || len > 32)
+                throw InetException(mergeStrings({"RouteTable::parsePrefix : invalid prefix length : ", text}));
+        }
+
+        Prefix prefix { ntohl(bin.s_addr), static_cast<uint8_t>(len) };
+        if(!validPrefix(prefix)) throw InetException(mergeStrings({"RouteTable::parsePrefix : host bits set : ", text}));
+        return prefix;
+    }
+
+    // Comma separated items, blanks around them removed, empty ones skipped.
+    vector<string> RouteTable::splitList(const string& text) anyexcept{
+        vector<string>  items;
+        istringstream   list  { text };
+        string          item;
+        while(getline(list, item, ',')){
+            size_t first { item.find_first_not_of(" \t") };
+            if(first == string::npos) continue;
+            items.push_back(item.substr(first, item.find_last_not_of(" \t") - first + 1));
+        }
+        return items;
+    }
+
+    // "a.b.c.d/len, ..."
+    vector<Prefix> RouteTable::parsePrefixes(const string& text) anyexcept{
+        vector<Prefix> prefixes;
+        for(const string& item : splitList(text)) prefixes.push_back(parsePrefix(item));
+        if(prefixes.size() > MAX_ANNOUNCED) 
+            throw InetException(mergeStrings({"RouteTable::parsePrefixes : too many prefixes, max ", to_string(MAX_ANNOUNCED)}));
+        return prefixes;
+    }
+
+    // "a.b.c.d/len via e.f.g.h, ..."
+    vector<StaticRoute> RouteTable::parseRoutes(const string& text) anyexcept{
+        vector<StaticRoute> parsed;
+        for(const string& item : splitList(text)){
+            istringstream  words  { item };
+            string         prefix,
+                           via,
+                           addr,
+                           extra;
+            in_addr        bin    {};
+            words >> prefix >> via >> addr >> extra;
+            if(via != "via" || addr.empty() || !extra.empty() || inet_pton(AF_INET, addr.c_str(), &bin) != 1)
+                throw InetException(mergeStrings({"RouteTable::parseRoutes : invalid route : ", item}));
+            parsed.push_back(StaticRoute{ parsePrefix(prefix), ntohl(bin.s_addr) });
+        }
+        return parsed;
+    }
+
+    string RouteTable::prefixText(Prefix prefix) anyexcept{
+        in_addr  bin     { htonl(prefix.addr) };
+        char     buff[INET_ADDRSTRLEN] {};
+        inet_ntop(AF_INET, &bin, buff, sizeof(buff));
+        return mergeStrings({ buff, "/", to_string(prefix.len) });
+    }
+
+} // End namespace
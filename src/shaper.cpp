@@ -0,0 +1,254 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
+
+#include <shaper.hpp>
+#include <inetgeneral.hpp>
+#include <StringUtils.hpp>
+#include <timeUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::vector,
+          std::istringstream,
+          std::min,
+          std::max,
+          stringutils::mergeStrings,
+          timeutils::USEC_PER_SEC;
+
+    namespace {
+        constexpr uint64_t BITS_PER_KBIT  { 1000 },
+                           BYTES_PER_KB   { 1024 };
+        constexpr const char* DIR_NAMES[SHAPE_DIRS] { "ingress", "egress" };
+    }
+
+    TokenBucket::TokenBucket(void) noexcept
+       : TokenBucket{ RateLimit{} }
+    {}
+
+    // A new bucket is full.
+    TokenBucket::TokenBucket(RateLimit limit) noexcept
+       : rate   { limit.rate }, cap { limit.burst * USEC_PER_SEC }, 
+         tokens { static_cast<int64_t>(cap) }
+    {}
+
+    bool TokenBucket::limited(void) const noexcept{
+        return rate != 0;
+    }
+
+    // Once elapsed covers the room left, the bucket is full: the product stays in range. 
+    // The first check only starts the clock, the bucket is already full.
+    bool TokenBucket::conforms(uint64_t now) noexcept{
+        if(!limited()) return true;
+        if(last == 0) last = now;
+        uint64_t elapsed { now - last },
+                 room    { static_cast<uint64_t>(static_cast<int64_t>(cap) - tokens) };
+        last    = now;
+        if(elapsed >= room / rate + 1) tokens  = static_cast<int64_t>(cap);
+        else                           tokens += static_cast<int64_t>(elapsed * rate);
+        return tokens >= 0;
+    }
+
+    void TokenBucket::consume(size_t bytes) noexcept{
+        if(limited()) tokens -= static_cast<int64_t>(bytes * USEC_PER_SEC);
+    }
+
+    // From the last refill: how long before the debt is paid back.
+    uint64_t TokenBucket::waitUs(void) const noexcept{
+        if(!limited() || tokens >= 0) return 0;
+        return (static_cast<uint64_t>(-tokens) + rate - 1) / rate;
+    }
+
+    // Whole bytes left as of the last refill, SIZE_MAX when unlimited.
+    size_t TokenBucket::available(void) const noexcept{
+        if(!limited()) return SIZE_MAX;
+        return tokens > 0 ? static_cast<size_t>(static_cast<uint64_t>(tokens) / USEC_PER_SEC) : 0;
+    }
+
+    Shaper::Shaper(const ShapingConfig& shaping) anyexcept
+       : config { shaping }
+    {
+        for(const auto& group : config.groups){
+            Limiter& limiter { groups.emplace_back() };
+            limiter.used = true;
+            for(size_t dir{0}; dir < SHAPE_DIRS; dir++) limiter.buckets[dir] = TokenBucket{ group.limits[dir] };
+        }
+    }
+
+    bool Shaper::enabled(void) const noexcept{
+        return !config.rules.empty();
+    }
+
+    // Every session gets its own buckets, even when several match the same rule.
+    uint32_t Shaper::open(uint32_t source) anyexcept{
+        const ShapeRule* rule { nullptr };
+        for(const auto& entry : config.rules)
+            if((source & prefixMask(entry.source.len)) == entry.source.addr && (rule == nullptr || entry.source.len > rule->source.len))
+                rule = &entry;
+        if(rule == nullptr) return SHAPE_NONE;
+
+        uint32_t id { SHAPE_NONE };
+        if(freeSessions.empty()){
+            sessions.emplace_back();
+            freeSessions.reserve(sessions.size());
+            id = static_cast<uint32_t>(sessions.size() - 1);
+        }else{
+            id = freeSessions.back();
+            freeSessions.pop_back();
+            sessions[id] = Limiter{};
+        }
+        Limiter& limiter { sessions[id] };
+        limiter.used  = true;
+        limiter.group = rule->group;
+        for(size_t dir{0}; dir < SHAPE_DIRS; dir++) limiter.buckets[dir] = TokenBucket{ rule->limits[dir] };
+        openSessions++;
+        return id;
+    }
+
+    void Shaper::close(uint32_t id) noexcept{
+        if(id >= sessions.size() || !sessions[id].used) return;
+        sessions[id].used = false;
+        freeSessions.push_back(id);
+        openSessions--;
+    }
+
+    // Both levels are refilled, even when the first one already refuses.
+    bool Shaper::admit(uint32_t id, SHAPE_DIR dir, uint64_t now) noexcept{
+        Limiter& limiter { sessions[id] };
+        bool     pass    { limiter.buckets[dir].conforms(now) };
+        if(limiter.group != SHAPE_NONE) pass = groups[limiter.group].buckets[dir].conforms(now) && pass;
+        if(!pass){
+            limiter.throttled[dir]++;
+            if(limiter.group != SHAPE_NONE) groups[limiter.group].throttled[dir]++;
+        }
+        return pass;
+    }
+
+    void Shaper::charge(uint32_t id, SHAPE_DIR dir, size_t bytes) noexcept{
+        Limiter& limiter { sessions[id] };
+        limiter.buckets[dir].consume(bytes);
+        limiter.bytes[dir] += bytes;
+        if(limiter.group != SHAPE_NONE){
+            groups[limiter.group].buckets[dir].consume(bytes);
+            groups[limiter.group].bytes[dir] += bytes;
+        }
+    }
+
+    uint64_t Shaper::waitUs(uint32_t id, SHAPE_DIR dir) const noexcept{
+        const Limiter& limiter { sessions[id] };
+        uint64_t       wait    { limiter.buckets[dir].waitUs() };
+        if(limiter.group != SHAPE_NONE) wait = max(wait, groups[limiter.group].buckets[dir].waitUs());
+        return wait;
+    }
+
+    // What can pass now at both levels: the readers stop there, the debt stays within a record.
+    size_t Shaper::available(uint32_t id, SHAPE_DIR dir, uint64_t now) noexcept{
+        Limiter& limiter { sessions[id] };
+        static_cast<void>(limiter.buckets[dir].conforms(now));
+        size_t   bytes   { limiter.buckets[dir].available() };
+        if(limiter.group != SHAPE_NONE){
+            static_cast<void>(groups[limiter.group].buckets[dir].conforms(now));
+            bytes = min(bytes, groups[limiter.group].buckets[dir].available());
+        }
+        return bytes;
+    }
+
+    string Shaper::counters(const Limiter& limiter) const anyexcept{
+        string text;
+        for(size_t dir{0}; dir < SHAPE_DIRS; dir++)
+            text.append(mergeStrings({ " ", DIR_NAMES[dir], "_bytes=", to_string(limiter.bytes[dir]),
+                                       " ", DIR_NAMES[dir], "_throttled=", to_string(limiter.throttled[dir]) }));
+        return text;
+    }
+
+    string Shaper::report(void) const anyexcept{
+        string text { mergeStrings({ "SHAPER : rules=", to_string(config.rules.size()),
+                                     " sessions=",      to_string(openSessions),
+                                     " groups=",        to_string(groups.size()) }) };
+        for(size_t group{0}; group < groups.size(); group++)
+            text.append(mergeStrings({ " GROUP ", config.groups[group].name, " :", counters(groups[group]) }));
+        return text;
+    }
+
+    string Shaper::report(uint32_t id) const anyexcept{
+        if(id >= sessions.size()) return "SHAPING : none";
+        const Limiter& limiter { sessions[id] };
+        return mergeStrings({ "SHAPING : group=", limiter.group == SHAPE_NONE ? "none" : config.groups[limiter.group].name,
+                              counters(limiter) });
+    }
+
+    // "ingress_kbit ingress_burst_kb egress_kbit egress_burst_kb": the tail of both lists.
+    static ShapeLimits parseLimits(istringstream& words, const string& item, const char* where) anyexcept{
+        ShapeLimits limits {};
+        for(size_t dir{0}; dir < SHAPE_DIRS; dir++){
+            string   rate,
+                     burst;
+            char     *rateEnd   { nullptr },
+                     *burstEnd  { nullptr };
+            words >> rate >> burst;
+            long long kbit { strtoll(rate.c_str(), &rateEnd, 10) },
+                      kb   { strtoll(burst.c_str(), &burstEnd, 10) };
+            if(rate.empty() || burst.empty() || *rateEnd != '\0' || *burstEnd != '\0' || kbit < 0 || kb < 0 ||
+               static_cast<uint64_t>(kbit) > SHAPE_MAX_RATE_KBIT || static_cast<uint64_t>(kb) > SHAPE_MAX_BURST_KB || (kbit > 0 && kb == 0))
+                throw InetException(mergeStrings({ where, " : invalid ", DIR_NAMES[dir], " limit : ", item }));
+            limits[dir] = RateLimit{ static_cast<uint64_t>(kbit) * BITS_PER_KBIT / 8, static_cast<uint64_t>(kb) * BYTES_PER_KB };
+        }
+        return limits;
+    }
+
+    // Groups: "name ingress_kbit ingress_burst_kb egress_kbit egress_burst_kb, ..."
+    // Rules:  "a.b.c.d/len ingress_kbit ingress_burst_kb egress_kbit egress_burst_kb [group], ..."
+    ShapingConfig Shaper::parse(const string& groups, const string& rules) anyexcept{
+        ShapingConfig parsed;
+        for(const string& item : RouteTable::splitList(groups)){
+            istringstream  words  { item };
+            string         name,
+                           extra;
+            words >> name;
+            ShapeLimits    limits { parseLimits(words, item, "Shaper::parse") };
+            words >> extra;
+            if(!extra.empty()) throw InetException(mergeStrings({ "Shaper::parse : invalid group : ", item }));
+            for(const auto& group : parsed.groups)
+                if(group.name == name) throw InetException(mergeStrings({ "Shaper::parse : duplicated group : ", name }));
+            parsed.groups.push_back(ShapeGroup{ name, limits });
+        }
+
+        for(const string& item : RouteTable::splitList(rules)){
+            istringstream  words  { item };
+            string         prefix,
+                           group,
+                           extra;
+            words >> prefix;
+            ShapeRule      rule   { RouteTable::parsePrefix(prefix), parseLimits(words, item, "Shaper::parse"), SHAPE_NONE };
+            words >> group >> extra;
+            if(!extra.empty()) throw InetException(mergeStrings({ "Shaper::parse : invalid rule : ", item }));
+            if(!group.empty()){
+                auto found { std::find_if(parsed.groups.begin(), parsed.groups.end(), [&group](const ShapeGroup& g){ return g.name == group; }) };
+                if(found == parsed.groups.end()) throw InetException(mergeStrings({ "Shaper::parse : unknown group : ", item }));
+                rule.group = static_cast<uint32_t>(found - parsed.groups.begin());
+            }
+            parsed.rules.push_back(rule);
+        }
+        return parsed;
+    }
+
+} // End namespace
@@ -0,0 +1,113 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <cerrno>
+
+#include <socketTuning.hpp>
+#include <inetgeneral.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          stringutils::mergeStrings;
+
+    // latency:    no Nagle, small unsent backlog, kernel buffer autotuning.
+    // throughput: large fixed buffers for long fat links, BBR.
+    // lossy:      BBR, which doesn't read random loss as congestion, and buffers 
+    //             deep enough to keep the pipe full across recoveries.
+    SocketTuning SocketTuning::fromProfile(const string& name) anyexcept{
+        SocketTuning tuning {};
+        tuning.profile = name;
+        if(name == "default")    return tuning;
+
+        tuning.noDelay = 1;
+        if(name == "latency"){
+            tuning.notSentLowat = 16384;
+        }else if(name == "throughput"){
+            tuning.sndBuf       = 4 * 1024 * 1024;
+            tuning.rcvBuf       = 4 * 1024 * 1024;
+            tuning.notSentLowat = 131072;
+            tuning.congestion   = "bbr";
+        }else if(name == "lossy"){
+            tuning.sndBuf       = 8 * 1024 * 1024;
+            tuning.rcvBuf       = 8 * 1024 * 1024;
+            tuning.notSentLowat = 131072;
+            tuning.congestion   = "bbr";
+        }else{
+            throw InetException(mergeStrings({"SocketTuning::fromProfile : unknown profile: ", name}));
+        }
+        return tuning;
+    }
+
+    void SocketTuning::apply(int fd) const anyexcept{
+        auto setInt { [fd](int level, int opt, int value, const char* optName){
+                          if(value == UNSET) return;
+                          if(setsockopt(fd, level, opt, &value, sizeof(value)) == -1)
+                              throw InetException(mergeStrings({"SocketTuning::apply : ", optName, " : ", strerror(errno)}));
+                      } };
+
+        setInt(SOL_SOCKET,  SO_SNDBUF,         sndBuf,       "SO_SNDBUF");
+        setInt(SOL_SOCKET,  SO_RCVBUF,         rcvBuf,       "SO_RCVBUF");
+        setInt(IPPROTO_TCP, TCP_NODELAY,       noDelay,      "TCP_NODELAY");
+        setInt(IPPROTO_TCP, TCP_NOTSENT_LOWAT, notSentLowat, "TCP_NOTSENT_LOWAT");
+        setInt(SOL_SOCKET,  SO_BUSY_POLL,      busyPollUs,   "SO_BUSY_POLL");
+        if(!congestion.empty() && 
+           setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, congestion.c_str(), static_cast<socklen_t>(congestion.size())) == -1)
+            throw InetException(mergeStrings({"SocketTuning::apply : TCP_CONGESTION ", congestion, " : ", strerror(errno)}));
+    }
+
+    // A missing congestion module or a busy poll value needing CAP_NET_ADMIN is 
+    // reported at startup instead of failing every connection.
+    void SocketTuning::validate(void) const anyexcept{
+        int fd { socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+        if(fd == -1) throw InetException(mergeStrings({"SocketTuning::validate : socket error : ", strerror(errno)}));
+        try{
+            apply(fd);
+        }catch(InetException&){
+            close(fd);
+            throw;
+        }
+        close(fd);
+    }
+
+    string SocketTuning::describe(int fd) anyexcept{
+        auto getInt { [fd](int level, int opt){
+                          int       value { 0 };
+                          socklen_t len   { sizeof(value) };
+                          return getsockopt(fd, level, opt, &value, &len) == -1 ? string{"?"} : to_string(value);
+                      } };
+        char      cc[16] {};
+        socklen_t ccLen  { sizeof(cc) - 1 };
+        if(getsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, cc, &ccLen) == -1) cc[0] = '?';
+
+        return mergeStrings({ "sndbuf=",    getInt(SOL_SOCKET,  SO_SNDBUF),
+                              " rcvbuf=",   getInt(SOL_SOCKET,  SO_RCVBUF),
+                              " nodelay=",  getInt(IPPROTO_TCP, TCP_NODELAY),
+                              " lowat=",    getInt(IPPROTO_TCP, TCP_NOTSENT_LOWAT),
+                              " busypoll=", getInt(SOL_SOCKET,  SO_BUSY_POLL),
+                              " cc=",       cc });
+    }
+
+} // End namespace
@@ -0,0 +1,196 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <openssl/crypto.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+
+#include <sslAllocator.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::atomic,
+          std::max,
+          std::memory_order_relaxed,
+          stringutils::mergeStrings;
+
+    namespace {
+        constexpr size_t    MIN_SHIFT     { 4 },
+                            CLASSES       { 12 },
+                            LARGE         { CLASSES },
+                            CACHE_BYTES   { 256UL * 1024 },
+                            MIN_CACHED    { 16 };
+
+        // Keeps the payload 16 bytes aligned, as malloc does.
+        struct alignas(16) BlockHeader{
+            size_t    sizeClass;
+            size_t    size;
+        };
+
+        struct FreeBlock{
+            FreeBlock*  next;
+        };
+
+        struct ThreadCache{
+            FreeBlock*  heads[CLASSES]   {};
+            size_t      counts[CLASSES]  {};
+
+            ~ThreadCache(void) noexcept;
+        };
+
+        atomic<uint64_t>      allocs    { 0 },
+                              frees     { 0 },
+                              cacheHits { 0 },
+                              large     { 0 },
+                              liveBytes { 0 },
+                              peakBytes { 0 };
+        bool                  active    { false };
+
+        // The cache is gone once its thread starts exiting: OpenSSL's own cleanup may still free
+        // blocks after that, and those go back to malloc.
+        thread_local bool         cacheAlive { true };
+        thread_local ThreadCache  cache;
+
+        ThreadCache::~ThreadCache(void) noexcept{
+            cacheAlive = false;
+            for(size_t cls{0}; cls < CLASSES; cls++){
+                while(heads[cls] != nullptr){
+                    FreeBlock* block { heads[cls] };
+                    heads[cls] = block->next;
+                    free(reinterpret_cast<BlockHeader*>(block) - 1);
+                }
+            }
+        }
+
+        size_t classOf(size_t num) noexcept{
+            size_t cls { 0 };
+            while(cls < CLASSES && (size_t{1} << (cls + MIN_SHIFT)) < num) cls++;
+            return cls;
+        }
+
+        size_t classSize(size_t cls) noexcept{
+            return size_t{1} << (cls + MIN_SHIFT);
+        }
+
+        void addLive(size_t bytes) noexcept{
+            uint64_t live { liveBytes.fetch_add(bytes, memory_order_relaxed) + bytes },
+                     peak { peakBytes.load(memory_order_relaxed) };
+            while(live > peak && !peakBytes.compare_exchange_weak(peak, live, memory_order_relaxed)){}
+        }
+    }
+
+    bool SslAllocator::install(void) noexcept{
+        active = CRYPTO_set_mem_functions(allocate, reallocate, release) == 1;
+        return active;
+    }
+
+    bool SslAllocator::installed(void) noexcept{
+        return active;
+    }
+
+    void* SslAllocator::allocate(size_t num, const char* file, int line) noexcept{
+        static_cast<void>(file);
+        static_cast<void>(line);
+
+        size_t       cls   { classOf(num) },
+                     bytes { cls == LARGE ? num : classSize(cls) };
+        BlockHeader* hdr   { nullptr };
+
+        allocs.fetch_add(1, memory_order_relaxed);
+        if(cls != LARGE && cacheAlive && cache.heads[cls] != nullptr){
+            FreeBlock* block { cache.heads[cls] };
+            cache.heads[cls] = block->next;
+            cache.counts[cls]--;
+            cacheHits.fetch_add(1, memory_order_relaxed);
+            hdr = reinterpret_cast<BlockHeader*>(block) - 1;
+        }else{
+            hdr = static_cast<BlockHeader*>(malloc(sizeof(BlockHeader) + bytes));
+            if(hdr == nullptr) return nullptr;
+            if(cls == LARGE) large.fetch_add(1, memory_order_relaxed);
+        }
+        hdr->sizeClass = cls;
+        hdr->size      = bytes;
+        addLive(bytes);
+        return hdr + 1;
+    }
+
+    void* SslAllocator::reallocate(void* ptr, size_t num, const char* file, int line) noexcept{
+        if(ptr == nullptr) return allocate(num, file, line);
+        if(num == 0){
+            release(ptr, file, line);
+            return nullptr;
+        }
+
+        // The class already leaves room to grow: OpenSSL grows its buffers in small steps.
+        size_t capacity { (static_cast<BlockHeader*>(ptr) - 1)->size };
+        if(num <= capacity) return ptr;
+
+        void* grown { allocate(num, file, line) };
+        if(grown == nullptr) return nullptr;
+        memcpy(grown, ptr, capacity);
+        release(ptr, file, line);
+        return grown;
+    }
+
+    void SslAllocator::release(void* ptr, const char* file, int line) noexcept{
+        static_cast<void>(file);
+        static_cast<void>(line);
+        if(ptr == nullptr) return;
+
+        BlockHeader* hdr { static_cast<BlockHeader*>(ptr) - 1 };
+        size_t       cls { hdr->sizeClass };
+        frees.fetch_add(1, memory_order_relaxed);
+        liveBytes.fetch_sub(hdr->size, memory_order_relaxed);
+        if(cls != LARGE && cacheAlive && cache.counts[cls] < max(MIN_CACHED, CACHE_BYTES / classSize(cls))){
+            FreeBlock* block { static_cast<FreeBlock*>(ptr) };
+            block->next       = cache.heads[cls];
+            cache.heads[cls]  = block;
+            cache.counts[cls]++;
+            return;
+        }
+        free(hdr);
+    }
+
+    SslAllocStats SslAllocator::stats(void) noexcept{
+        SslAllocStats snapshot;
+        snapshot.allocs    = allocs.load(memory_order_relaxed);
+        snapshot.frees     = frees.load(memory_order_relaxed);
+        snapshot.cacheHits = cacheHits.load(memory_order_relaxed);
+        snapshot.large     = large.load(memory_order_relaxed);
+        snapshot.liveBytes = liveBytes.load(memory_order_relaxed);
+        snapshot.peakBytes = peakBytes.load(memory_order_relaxed);
+        return snapshot;
+    }
+
+    string SslAllocator::report(void) anyexcept{
+        if(!active) return "SSL ALLOCATOR : not installed";
+        SslAllocStats current { stats() };
+        return mergeStrings({ "SSL ALLOCATOR : allocs=", to_string(current.allocs),
+                              " frees=",       to_string(current.frees),
+                              " cache_hits=",  to_string(current.cacheHits),
+                              " large=",       to_string(current.large),
+                              " live_bytes=",  to_string(current.liveBytes),
+                              " peak_bytes=",  to_string(current.peakBytes) });
+    }
+
+} // End namespace
@@ -0,0 +1,76 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <stats.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          stringutils::mergeStrings;
+
+    string TunnelStats::report(void) const anyexcept{
+        return mergeStrings({ "tun_rx_pkts=",    to_string(tunRxPackets),
+                              " tun_rx_bytes=",  to_string(tunRxBytes),
+                              " tun_tx_pkts=",   to_string(tunTxPackets),
+                              " tun_tx_bytes=",  to_string(tunTxBytes),
+                              " hairpin_pkts=",  to_string(hairpinPackets),
+                              " ssl_rx_recs=",   to_string(sslRxRecords),
+                              " ssl_rx_bytes=",  to_string(sslRxBytes),
+                              " ssl_tx_recs=",   to_string(sslTxRecords),
+                              " ssl_tx_bytes=",  to_string(sslTxBytes),
+                              " tx_backlogged=", to_string(txBacklogged),
+                              " backlog_drops=", to_string(txBacklogDrops),
+                              " ctrl_rx=",       to_string(ctrlRxFrames),
+                              " ctrl_tx=",       to_string(ctrlTxFrames),
+                              " rx_wakeups=",    to_string(rxWakeups),
+                              " buff_releases=", to_string(buffReleases) });
+    }
+
+    string ServerStats::report(size_t peers, size_t pending) const anyexcept{
+        return mergeStrings({ "SERVER STATS : peers=",   to_string(peers),
+                              " handshakes_pending=",    to_string(pending),
+                              " handshakes_started=",    to_string(handshakesStarted),
+                              " handshakes_done=",       to_string(handshakesDone),
+                              " handshakes_failed=",     to_string(handshakesFailed),
+                              " handshakes_timeout=",    to_string(handshakesTimedOut),
+                              " peers_closed=",          to_string(peersClosed),
+                              " noroute_drops=",         to_string(noRouteDrops),
+                              " hairpin_packets=",       to_string(hairpinPackets),
+                              " hairpin_bytes=",         to_string(hairpinBytes),
+                              " accept_backoffs=",       to_string(acceptBackoffs) });
+    }
+
+    void TunnelStats::onDumpSignal(int) noexcept{
+        dumpRequested = 1;
+    }
+
+    void TunnelStats::installDumpSignal(void) noexcept{
+        struct sigaction sa {};
+        sa.sa_handler = onDumpSignal;
+        sigemptyset(&sa.sa_mask);
+        static_cast<void>(sigaction(SIGUSR1, &sa, nullptr));
+    }
+
+    bool TunnelStats::takeDumpRequest(void) noexcept{
+        if(dumpRequested == 0) return false;
+        dumpRequested = 0;
+        return true;
+    }
+
+} // End namespace
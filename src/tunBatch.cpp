@@ -0,0 +1,107 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstring>
+#include <algorithm>
+
+#include <tunBatch.hpp>
+#include <frames.hpp>
+#include <inetgeneral.hpp>
+#include <StringUtils.hpp>
+
+namespace inetlib{
+
+    using std::string,
+          std::to_string,
+          std::max,
+          stringutils::mergeStrings;
+
+    namespace {
+        constexpr size_t SLOT_ALIGN { 64 };
+    }
+
+    TunBatch::TunBatch(size_t slots, size_t payloadSize, size_t byteBudget) anyexcept
+        : lengths(slots, 0),
+          stride  { (FRAME_HEADER_LEN + payloadSize + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN },
+          payload { payloadSize }, budget { max(byteBudget, payloadSize) }, arena { slots * stride }
+    {
+        if(slots == 0 || payloadSize == 0) throw InetException("TunBatch::TunBatch : invalid batch size.");
+    }
+
+    IO_STATUS TunBatch::drain(int tunFd, size_t& count) noexcept{
+        IO_STATUS status { IO_OK };
+        size_t    bytes  { 0 };
+        count = 0;
+        empty = false;
+        while(count < lengths.size()){
+            if(bytes >= budget){
+                budgetHits++;
+                break;
+            }
+            ssize_t got { read(tunFd, frame(count) + FRAME_HEADER_LEN, payload) };
+            if(got > 0){
+                lengths[count++]  = static_cast<size_t>(got);
+                bytes            += static_cast<size_t>(got);
+                continue;
+            }
+            if(got == -1 && errno == EINTR) continue;
+            if(got == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                empty = true;
+                break;
+            }
+            status = got == 0 ? IO_CLOSED : IO_TUN_ERROR;
+            break;
+        }
+
+        if(count != 0){
+            batches++;
+            packets  += count;
+            maxBatch  = max<uint64_t>(maxBatch, count);
+            if(count == lengths.size()) fullBatches++;
+        }
+        return status;
+    }
+
+    uint8_t* TunBatch::frame(size_t index) noexcept{
+        return arena.data() + index * stride;
+    }
+
+    size_t TunBatch::length(size_t index) const noexcept{
+        return lengths[index];
+    }
+
+    // The last drain stopped because the device had nothing more to read.
+    bool TunBatch::drained(void) const noexcept{
+        return empty;
+    }
+
+    string TunBatch::report(void) const anyexcept{
+        uint64_t avgX100 { batches == 0 ? 0 : packets * 100 / batches };
+        string   decimals{ to_string(avgX100 % 100) };
+        if(decimals.size() == 1) decimals.insert(0, "0");
+        return mergeStrings({ "TUN BATCH STATS : batches=", to_string(batches),
+                              " packets=",       to_string(packets),
+                              " avg_batch=",     to_string(avgX100 / 100), ".", decimals,
+                              " max_batch=",     to_string(maxBatch),
+                              " full_batches=",  to_string(fullBatches),
+                              " budget_hits=",   to_string(budgetHits) });
+    }
+
+} // End namespace
@@ -0,0 +1,563 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <cstring>
+
+#include <algorithm>
+#include <utility>
+
+#include <inetgeneral.hpp>
+#include <StringUtils.hpp>
+#include <Types.hpp>
+#include <timeUtils.hpp>
+#include <packet.hpp>
+
+namespace inetlib{
+
+using std::string,
+      std::to_string,
+      std::vector,
+      std::array,
+      std::exchange,
+      std::min,
+      std::max,
+      typeutils::safeSizeRange,
+      stringutils::mergeStrings,
+      stringutils::trace,
+      timeutils::monotonicUs,
+      timeutils::USEC_PER_MSEC,
+      debugmode::Debug,
+      debugmode::DEBUG_MODE;
+
+VpnSession::VpnSession(SSL* ssl, int fd, size_t payloadSize, const TunnelOptions& opts, string name) anyexcept
+   : cSSL { ssl }, sockFd { fd }, label { name }, sockProfile { opts.tuning.profile }, payloadLimit { payloadSize }, reader { payloadSize },
+     keepalive { static_cast<uint64_t>(opts.keepAliveMs) * USEC_PER_MSEC, static_cast<uint64_t>(opts.deadPeerMs) * USEC_PER_MSEC },
+     statsInterval { static_cast<uint64_t>(opts.statsIntervalMs) * USEC_PER_MSEC },
+     policy { static_cast<uint64_t>(opts.flushDeadlineUs), static_cast<size_t>(opts.flushPackets), TLS_MAX_RECORD },
+     sizer { ssl, fd, static_cast<uint64_t>(opts.recordIdleMs) * USEC_PER_MSEC },
+     bdp { fd, opts.tuning.sndBuf == SocketTuning::UNSET ? static_cast<uint64_t>(opts.bdpIntervalMs) * USEC_PER_MSEC : 0, opts.bdpFactor },
+     pending(TLS_MAX_RECORD), stallLimit { static_cast<uint64_t>(opts.deadPeerMs) * USEC_PER_MSEC }, 
+     debugMode { Debug::getDebugLevel() }
+{
+    if(cSSL == nullptr || sockFd < 0) throw InetException("VpnSession::VpnSession : invalid SSL session.");
+    // A write retried from the backlog may start from a different address after it's compacted.
+    // On the non-blocking data socket, records without application data (e.g. tickets) can't 
+    // block SSL_read anymore: it goes on to the next record, and WANT_READ means an incomplete one.
+    SSL_set_mode(cSSL, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_AUTO_RETRY);
+    if(opts.transport == TRANSPORT_MEMBIO)
+        channel = std::make_unique<BioChannel>(cSSL, sockFd, static_cast<size_t>(opts.readAheadBytes), static_cast<size_t>(opts.zerocopyMin));
+}
+
+void VpnSession::start(uint64_t now) noexcept{
+    keepalive.start(now);
+    nextStats  = now + statsInterval;
+    lastActive = now;
+}
+
+// Failures keep errno and the SSL error for errorText(): nothing is formatted on the data path.
+IO_STATUS VpnSession::fail(IO_STATUS status, int sslErr) noexcept{
+    sysError = status == IO_SOCKET_ERROR || status == IO_TUN_ERROR ? errno : 0;
+    sslError = sslErr;
+    return status;
+}
+
+// Without partial writes SSL_write takes all of len or returns an error: IO_AGAIN means the 
+// socket (or the channel) is full, and the retry must offer the same bytes again.
+IO_STATUS VpnSession::writeSsl(const uint8_t* buf, size_t len) noexcept{
+    int nbytes { SSL_write(cSSL, buf, safeSizeRange<int>(len)) };
+    if(nbytes > 0) return IO_OK;
+    int errCode { SSL_get_error(cSSL, nbytes) };
+    switch(errCode){
+       case SSL_ERROR_WANT_WRITE:
+       case SSL_ERROR_WANT_READ:
+       case SSL_ERROR_WANT_ASYNC_JOB:
+               return IO_AGAIN;
+       case SSL_ERROR_SYSCALL:
+               return fail(IO_SOCKET_ERROR, errCode);
+       default:
+               return fail(IO_SSL_ERROR, errCode);
+    }
+}
+
+void VpnSession::onWritten(size_t len) noexcept{
+    sizer.onWrite(len);
+    stats.sslTxRecords++;
+    stats.sslTxBytes += len;
+}
+
+// The socket is non-blocking: a record it can't take waits in the backlog, and so does 
+// everything written after it, until the event loop reports the socket writable.
+IO_STATUS VpnSession::writeRecord(const uint8_t* buf, size_t len) noexcept{
+    sizer.update(monotonicUs());
+    if(backHead != backlog.size()) return queueRecord(buf, len);
+
+    IO_STATUS status { writeSsl(buf, len) };
+    if(status == IO_AGAIN){
+        // Part of it may be sealed already: the first retry covers at least the same bytes.
+        backRetry = len;
+        return queueRecord(buf, len);
+    }
+    if(status != IO_OK) return status;
+    onWritten(len);
+    return IO_OK;
+}
+
+// The backlog is bounded: past BACKLOG_MAX a peer that doesn't read loses records, as a 
+// congested link would, and is closed as dead if nothing moves for the dead peer interval.
+// The record SSL_write is retrying is always the first one, it's never dropped.
+IO_STATUS VpnSession::queueRecord(const uint8_t* buf, size_t len) noexcept{
+    size_t queued { backlog.size() - backHead };
+    if(queued != 0 && queued + len > BACKLOG_MAX){
+        stats.txBacklogDrops++;
+        return IO_OK;
+    }
+    try{
+        if(queued == 0){
+            backlog.clear();
+            backHead     = 0;
+            backProgress = monotonicUs();
+            if(backlog.capacity() == 0) backlog.reserve(BACKLOG_MAX);
+        }else if(backlog.size() + len > backlog.capacity()){
+            backlog.erase(backlog.begin(), backlog.begin() + static_cast<std::ptrdiff_t>(backHead));
+            backHead = 0;
+        }
+        backlog.insert(backlog.end(), buf, buf + len);
+    }catch(...){
+        if(queued == 0) return fail(IO_SOCKET_ERROR);
+        stats.txBacklogDrops++;
+        return IO_OK;
+    }
+    stats.txBacklogged++;
+    return IO_OK;
+}
+
+// IO_OK also when the socket filled up again: the rest waits for the next writable event.
+IO_STATUS VpnSession::writeBacklog(void) noexcept{
+    while(backHead != backlog.size()){
+        size_t    len    { max(backRetry, min(backlog.size() - backHead, TLS_MAX_RECORD)) };
+        IO_STATUS status { writeSsl(backlog.data() + backHead, len) };
+        if(status == IO_AGAIN){
+            backRetry = len;
+            return IO_OK;
+        }
+        if(status != IO_OK) return status;
+        onWritten(len);
+        backHead    += len;
+        backRetry    = 0;
+        backProgress = monotonicUs();
+    }
+    return IO_OK;
+}
+
+IO_STATUS VpnSession::writeTun(int tunFd, const uint8_t* buf, size_t len) noexcept{
+    size_t written { 0 };
+    while( written < len){
+        ssize_t nbytes { write(tunFd, buf + written, len - written) };
+        if( nbytes <= 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            return fail(IO_TUN_ERROR);
+        }
+        written += static_cast<size_t>(nbytes);
+    }
+    stats.tunTxPackets++;
+    stats.tunTxBytes += len;
+    return IO_OK;
+}
+
+IO_STATUS VpnSession::sendPacket(uint8_t* frame, size_t len) noexcept{
+    if(debugMode >= DEBUG_MODE::VERBOSE_DEBUG) trace("READ TUN -> SSL WRITE:", frame + FRAME_HEADER_LEN, len);
+    stats.tunRxPackets++;
+    stats.tunRxBytes += len;
+
+    putFrameHeader(frame, FRAME_DATA, len);
+    size_t frameLen { len + FRAME_HEADER_LEN };
+    if(frameLen > pending.size()){
+        uint64_t now { monotonicUs() };
+        if(pendingLen != 0)
+            if(IO_STATUS status { writePending(now, FLUSH_BYTES) }; status != IO_OK) return status;
+        if(IO_STATUS status { writeRecord(frame, frameLen) }; status != IO_OK) return status;
+        policy.onFlush(now, frameLen, 1, FLUSH_BYTES);
+        return IO_OK;
+    }
+
+    if(pendingLen + frameLen > pending.size())
+        if(IO_STATUS status { writePending(monotonicUs(), FLUSH_BYTES) }; status != IO_OK) return status;
+    if(pendingLen == 0) pendingSince = monotonicUs();
+    std::memcpy(pending.data() + pendingLen, frame, frameLen);
+    pendingLen += frameLen;
+    pendingPkts++;
+
+    if(FLUSH_REASON reason { policy.trigger(pendingLen, pendingPkts) }; reason != FLUSH_REASONS)
+        return writePending(monotonicUs(), reason);
+    return IO_OK;
+}
+
+// Frames from the same pass share a record: one seal and one TLS header instead of one per packet.
+IO_STATUS VpnSession::writePending(uint64_t now, FLUSH_REASON reason) noexcept{
+    size_t len  { pendingLen },
+           pkts { pendingPkts };
+    pendingLen  = 0;
+    pendingPkts = 0;
+    if(IO_STATUS status { writeRecord(pending.data(), len) }; status != IO_OK) return status;
+    policy.onFlush(now, len, pkts, reason);
+    return IO_OK;
+}
+
+// IO_AGAIN: no complete record yet, or the TLS layer has to write before reading on.
+IO_STATUS VpnSession::readRecord(void) noexcept{
+    int readFromSsl { SSL_read(cSSL, reader.writePtr(), safeSizeRange<int>(reader.writeSpace())) };
+    if( readFromSsl <= 0) {
+         int errCode { SSL_get_error(cSSL, readFromSsl) };
+         switch(errCode){
+             case SSL_ERROR_WANT_READ:
+             case SSL_ERROR_WANT_ASYNC_JOB:
+                  return IO_AGAIN;
+             // The TLS layer has something to send first (e.g. a key update): reading goes on
+             // once the socket is writable.
+             case SSL_ERROR_WANT_WRITE:
+                  readBlocked = true;
+                  return IO_AGAIN;
+             case SSL_ERROR_ZERO_RETURN:
+                  return fail(IO_CLOSED, errCode);
+             case SSL_ERROR_SYSCALL:
+                  return fail(IO_SOCKET_ERROR, errCode);
+             default:
+                  return fail(IO_SSL_ERROR, errCode);
+         }
+    }
+
+    reader.commit(static_cast<size_t>(readFromSsl));
+    stats.sslRxRecords++;
+    stats.sslRxBytes += static_cast<uint64_t>(readFromSsl);
+    return IO_OK;
+}
+
+IO_STATUS VpnSession::dispatchFrames(int tunFd, uint64_t now) noexcept{
+    Frame frame {};
+    for(;;){
+        switch(reader.next(frame)){
+            [[likely]]   case FRAME_READY:
+            break;
+            [[likely]]   case FRAME_INCOMPLETE:
+                return IO_OK;
+            [[unlikely]] case FRAME_INVALID:
+                return fail(IO_BAD_FRAME);
+        }
+
+        switch(frame.type){
+            [[likely]]   case FRAME_DATA:
+                if(debugMode >= DEBUG_MODE::VERBOSE_DEBUG) trace("READ SSL -> TUN WRITE:", frame.payload, frame.len);
+                static_cast<void>(ipv4Source(frame.payload, frame.len, innerAddr));
+                // The frame is consumed: its header, right before the payload, is rewritten in place.
+                if(hairpin != nullptr && hairpin->forward(const_cast<uint8_t*>(frame.payload) - FRAME_HEADER_LEN, 
+                                                          frame.len, sockFd)){
+                    stats.hairpinPackets++;
+                    break;
+                }
+                if(IO_STATUS status { writeTun(tunFd, frame.payload, frame.len) }; status != IO_OK) return status;
+            break;
+            [[unlikely]] case FRAME_PING:
+                stats.ctrlRxFrames++;
+                if(size_t len { Keepalive::buildPong(ctrlBuff.data(), frame.payload, frame.len) }; len > 0){
+                    if(IO_STATUS status { writeRecord(ctrlBuff.data(), len) }; status != IO_OK) return status;
+                    stats.ctrlTxFrames++;
+                }
+            break;
+            [[unlikely]] case FRAME_PONG:
+                stats.ctrlRxFrames++;
+                if(!keepalive.onPong(frame.payload, frame.len, now) && debugMode >= DEBUG_MODE::STD_DEBUG)
+                    Debug::printLog("VpnSession::dispatchFrames : discarded malformed PONG.", DEBUG_MODE::STD_DEBUG);
+            break;
+            [[unlikely]] case FRAME_ROUTE:
+                stats.ctrlRxFrames++;
+                if(IO_STATUS status { readAnnounce(frame) }; status != IO_OK) return status;
+            break;
+            [[unlikely]] case FRAME_ADDRESS:
+                stats.ctrlRxFrames++;
+                if(IO_STATUS status { readAssign(frame) }; status != IO_OK) return status;
+            break;
+            [[unlikely]] case FRAME_LEASE:
+                stats.ctrlRxFrames++;
+                if(IO_STATUS status { readRequest(frame) }; status != IO_OK) return status;
+            break;
+        }
+    }
+}
+
+// Announced prefixes wait for the server to take them, after the receive pass.
+IO_STATUS VpnSession::readAnnounce(const Frame& frame) noexcept{
+    if(frame.len % PREFIX_WIRE_LEN != 0 || announced.size() + frame.len / PREFIX_WIRE_LEN > MAX_ANNOUNCED) 
+        return fail(IO_BAD_FRAME);
+    try{
+        for(size_t offset{0}; offset < frame.len; offset += PREFIX_WIRE_LEN){
+            Prefix prefix { loadBe32(frame.payload + offset), frame.payload[offset + 4] };
+            if(!validPrefix(prefix)) return fail(IO_BAD_FRAME);
+            announced.push_back(prefix);
+        }
+    }catch(...){
+        // No room to keep it: refused as a whole, like a malformed one.
+        announced.clear();
+        return fail(IO_BAD_FRAME);
+    }
+    return IO_OK;
+}
+
+// The tunnel address from the server pool, applied by the client after the receive pass.
+IO_STATUS VpnSession::readAssign(const Frame& frame) noexcept{
+    if(frame.len != ADDRESS_WIRE_LEN) return fail(IO_BAD_FRAME);
+    uint32_t addr { loadBe32(frame.payload) };
+    uint8_t  len  { frame.payload[4] };
+    if(addr == 0 || len < POOL_MIN_PREFIX || len > POOL_MAX_PREFIX) return fail(IO_BAD_FRAME);
+    assignedAddr = addr;
+    assignedLen  = len;
+    return IO_OK;
+}
+
+// An address request from a client, taken by the server after the receive pass.
+IO_STATUS VpnSession::readRequest(const Frame& frame) noexcept{
+    if(frame.len != LEASE_WIRE_LEN) return fail(IO_BAD_FRAME);
+    requestedBy = (static_cast<uint64_t>(loadBe32(frame.payload)) << 32) | loadBe32(frame.payload + 4);
+    requested   = true;
+    return IO_OK;
+}
+
+// Records may wait in memory after the socket is drained: in the channel, or in the TLS 
+// read buffer with read-ahead. The event loop wouldn't report them.
+bool VpnSession::pendingInput(void) const noexcept{
+    return channel ? channel->pendingInput() || SSL_pending(cSSL) > 0 : SSL_has_pending(cSSL) == 1;
+}
+
+// Records in memory are consumed here, until budget bytes were read: at least one record
+// per pass. What's left over is the caller's business, see pendingInput(). IO_AGAIN leaves 
+// the rest of an incomplete record for the next readable event.
+IO_STATUS VpnSession::receive(int tunFd, size_t budget) noexcept{
+    stats.rxWakeups++;
+    if(channel){
+        IO_STATUS got { channel->fill() };
+        if(got == IO_AGAIN && !channel->pendingInput()) return IO_OK;
+        if(got != IO_OK && got != IO_AGAIN)             return fail(got);
+    }
+
+    uint64_t first { stats.sslRxBytes };
+    do{
+        IO_STATUS status { readRecord() };
+        if(status == IO_AGAIN) break;
+        if(status != IO_OK)    return status;
+        uint64_t now { monotonicUs() };
+        keepalive.touch(now);
+        if(IO_STATUS frames { dispatchFrames(tunFd, now) }; frames != IO_OK) return frames;
+    }while(stats.sslRxBytes - first < budget && pendingInput());
+    return IO_OK;
+}
+
+IO_STATUS VpnSession::flush(uint64_t now) noexcept{
+    if(pendingLen != 0){
+        uint64_t  deadline { policy.deadline(pendingSince) };
+        IO_STATUS status   { IO_OK };
+        if(deadline == pendingSince)  status = writePending(now, FLUSH_PASS);
+        else if(now >= deadline)      status = writePending(now, FLUSH_DEADLINE);
+        if(status != IO_OK) return status;
+    }
+    if(channel && !channel->flushQuiet()) return fail(IO_SOCKET_ERROR);
+    return IO_OK;
+}
+
+// Ciphertext waiting in the channel, a backlog or a read that has to write first.
+bool VpnSession::wantWrite(void) const noexcept{
+    return backHead != backlog.size() || readBlocked || (channel && channel->pendingOutput());
+}
+
+IO_STATUS VpnSession::onWritable(int tunFd) noexcept{
+    if(channel && !channel->flushQuiet()) return fail(IO_SOCKET_ERROR);
+    if(IO_STATUS status { writeBacklog() }; status != IO_OK) return status;
+    if(channel && !channel->flushQuiet()) return fail(IO_SOCKET_ERROR);
+    if(readBlocked){
+        readBlocked = false;
+        return receive(tunFd);
+    }
+    return IO_OK;
+}
+
+void VpnSession::shutdown(void) noexcept{
+    if(pendingLen != 0) static_cast<void>(writePending(monotonicUs(), FLUSH_PASS));
+    static_cast<void>(writeBacklog());
+    SSL_shutdown(cSSL);
+    if(channel) static_cast<void>(channel->flushQuiet());
+}
+
+// The peer counts as alive while its records are left unread on purpose, e.g. throttled.
+void VpnSession::holdAlive(uint64_t now) noexcept{
+    keepalive.touch(now);
+}
+
+IO_STATUS VpnSession::timers(uint64_t now) noexcept{
+    if(keepalive.isDead(now)) return fail(IO_DEAD_PEER);
+    // Pings may still arrive from a peer that stopped reading: its backlog tells.
+    if(stallLimit != 0 && backHead != backlog.size() && now - backProgress >= stallLimit) return fail(IO_STALLED);
+
+    if(keepalive.pingDue(now)){
+        if(IO_STATUS status { writeRecord(ctrlBuff.data(), keepalive.buildPing(ctrlBuff.data(), now)) }; status != IO_OK) return status;
+        stats.ctrlTxFrames++;
+    }
+
+    if(idleRelease != 0) checkIdle(now);
+
+    // The membio queue follows the kernel buffer: ciphertext beyond the BDP budget leaves early.
+    if(size_t budget { bdp.sample(now, label) }; budget != 0 && channel) channel->setQueueLimit(budget);
+
+    if(statsInterval != 0 && now >= nextStats){
+        nextStats = now + statsInterval;
+        try{
+            Debug::printLog(report(), DEBUG_MODE::ERR_DEBUG);
+        }catch(...){
+            // A periodic report that can't be built is skipped, the session goes on.
+        }
+    }
+    return IO_OK;
+}
+
+void VpnSession::setIdleRelease(uint64_t idleUs) noexcept{
+    idleRelease = idleUs;
+}
+
+void VpnSession::setHairpin(Hairpin* hp) noexcept{
+    hairpin = hp;
+}
+
+// Idle sessions give their TLS read/write buffers back (about 34KB each, more with 
+// read-ahead); busy ones keep them to avoid an allocation per record.
+void VpnSession::checkIdle(uint64_t now) noexcept{
+    uint64_t packets { stats.tunRxPackets + stats.tunTxPackets + stats.hairpinPackets };
+    if(packets != lastPackets){
+        lastPackets = packets;
+        lastActive  = now;
+        if(released){
+            SSL_clear_mode(cSSL, SSL_MODE_RELEASE_BUFFERS);
+            released = false;
+        }
+    }else if(!released && now - lastActive >= idleRelease){
+        SSL_set_mode(cSSL, SSL_MODE_RELEASE_BUFFERS);
+        released = true;
+        stats.buffReleases++;
+    }
+}
+
+uint64_t VpnSession::nextTimeoutUs(uint64_t now) const noexcept{
+    uint64_t next { keepalive.nextEventUs(now) };
+    if(statsInterval != 0) next = min(next, nextStats > now ? nextStats - now : 0);
+    if(pendingLen != 0){
+        uint64_t deadline { policy.deadline(pendingSince) };
+        next = min(next, deadline > now ? deadline - now : 0);
+    }
+    return next;
+}
+
+uint32_t VpnSession::getInnerAddr(void) const noexcept{
+    return innerAddr;
+}
+
+const TunnelStats& VpnSession::getStats(void) const noexcept{
+    return stats;
+}
+
+// Sent once after the handshake: the prefixes reachable behind this end of the tunnel.
+// Frames keep to the payload limit (psize, the same at both ends): the peer's reader
+// refuses anything longer as an invalid frame.
+IO_STATUS VpnSession::announce(const vector<Prefix>& prefixes) noexcept{
+    size_t perFrame { max<size_t>(min(payloadLimit, TLS_MAX_RECORD - FRAME_HEADER_LEN) / PREFIX_WIRE_LEN, 1) };
+
+    if(pendingLen != 0)
+        if(IO_STATUS status { writePending(monotonicUs(), FLUSH_CONTROL) }; status != IO_OK) return status;
+    for(size_t first{0}; first < prefixes.size(); first += perFrame){
+        size_t   count { min(perFrame, prefixes.size() - first) };
+        uint8_t* out   { pending.data() + FRAME_HEADER_LEN };
+        for(size_t idx { first }; idx < first + count; idx++, out += PREFIX_WIRE_LEN){
+            storeBe32(out, prefixes[idx].addr);
+            out[4] = prefixes[idx].len;
+        }
+        putFrameHeader(pending.data(), FRAME_ROUTE, count * PREFIX_WIRE_LEN);
+        if(IO_STATUS status { writeRecord(pending.data(), FRAME_HEADER_LEN + count * PREFIX_WIRE_LEN) }; status != IO_OK) return status;
+        stats.ctrlTxFrames++;
+    }
+    return IO_OK;
+}
+
+IO_STATUS VpnSession::assign(uint32_t addr, uint8_t len) noexcept{
+    array<uint8_t, FRAME_HEADER_LEN + ADDRESS_WIRE_LEN> frame;
+    putFrameHeader(frame.data(), FRAME_ADDRESS, ADDRESS_WIRE_LEN);
+    storeBe32(frame.data() + FRAME_HEADER_LEN, addr);
+    frame[FRAME_HEADER_LEN + 4] = len;
+
+    if(pendingLen != 0)
+        if(IO_STATUS status { writePending(monotonicUs(), FLUSH_CONTROL) }; status != IO_OK) return status;
+    if(IO_STATUS status { writeRecord(frame.data(), frame.size()) }; status != IO_OK) return status;
+    stats.ctrlTxFrames++;
+    return IO_OK;
+}
+
+// False when no new address was received since the last call.
+bool VpnSession::takeAssigned(uint32_t& addr, uint8_t& len) noexcept{
+    if(assignedAddr == 0) return false;
+    addr         = assignedAddr;
+    len          = assignedLen;
+    assignedAddr = 0;
+    return true;
+}
+
+// Sent once after the handshake by a client configured with tunaddress = "auto".
+IO_STATUS VpnSession::requestAddress(uint64_t identity) noexcept{
+    array<uint8_t, FRAME_HEADER_LEN + LEASE_WIRE_LEN> frame;
+    putFrameHeader(frame.data(), FRAME_LEASE, LEASE_WIRE_LEN);
+    storeBe32(frame.data() + FRAME_HEADER_LEN, static_cast<uint32_t>(identity >> 32));
+    storeBe32(frame.data() + FRAME_HEADER_LEN + 4, static_cast<uint32_t>(identity));
+
+    if(pendingLen != 0)
+        if(IO_STATUS status { writePending(monotonicUs(), FLUSH_CONTROL) }; status != IO_OK) return status;
+    if(IO_STATUS status { writeRecord(frame.data(), frame.size()) }; status != IO_OK) return status;
+    stats.ctrlTxFrames++;
+    return IO_OK;
+}
+
+// False when no request was received since the last call.
+bool VpnSession::takeRequest(uint64_t& identity) noexcept{
+    if(!requested) return false;
+    identity  = requestedBy;
+    requested = false;
+    return true;
+}
+
+bool VpnSession::hasAnnounced(void) const noexcept{
+    return !announced.empty();
+}
+
+vector<Prefix> VpnSession::takeAnnounced(void) noexcept{
+    return exchange(announced, {});
+}
+
+string VpnSession::errorText(IO_STATUS status) const anyexcept{
+    string text { mergeStrings({"VpnSession : ", label, " : ", ioStatusText(status)}) };
+    if(sslError != 0) text.append(mergeStrings({" : ssl error ", to_string(sslError)}));
+    if(sysError != 0) text.append(mergeStrings({" : ", strerror(sysError)}));
+    return text;
+}
+
+string VpnSession::report(void) const anyexcept{
+    return mergeStrings({ "STATS ", label, " : ", stats.report(), " ", keepalive.report(), " FLUSH : ", policy.report(), " RECORD : ", sizer.report(), " BDP : ", bdp.report(),
+                          " SOCKET : profile=", sockProfile, " ", SocketTuning::describe(sockFd), channel ? " " + channel->report() : string{} });
+}
+
+} // End namespace
@@ -0,0 +1,151 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+// Route announcements longer than one frame: the receiving end must get every prefix 
+// back, none of the frames may exceed its payload limit (psize).
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <inetgeneral.hpp>
+#include <routeTable.hpp>
+#include <timeUtils.hpp>
+
+namespace {
+
+    using std::cerr,
+          std::unique_ptr,
+          std::vector,
+          inetlib::Inet,
+          inetlib::VpnSession,
+          inetlib::TunnelOptions,
+          inetlib::Prefix,
+          inetlib::IO_STATUS,
+          inetlib::IO_OK,
+          inetlib::MAX_ANNOUNCED,
+          timeutils::monotonicUs;
+
+    using PkeyPtr   = unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)>;
+    using X509Ptr   = unique_ptr<X509,     decltype(&X509_free)>;
+    using CtxPtr    = unique_ptr<SSL_CTX,  decltype(&SSL_CTX_free)>;
+
+    constexpr size_t  PAYLOAD_SIZE  { 1500 };
+    constexpr size_t  PREFIXES      { 1000 };
+    constexpr int     MAX_ROUNDS    { 1000 };
+
+    X509Ptr makeCert(EVP_PKEY* pkey){
+        X509Ptr cert { X509_new(), X509_free };
+        if(!cert) return cert;
+        ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert.get()), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert.get()), 3600);
+        X509_set_pubkey(cert.get(), pkey);
+        X509_NAME* name { X509_get_subject_name(cert.get()) };
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("nnvpn-test"), -1, -1, 0);
+        X509_set_issuer_name(cert.get(), name);
+        if(X509_sign(cert.get(), pkey, EVP_sha256()) == 0) cert.reset();
+        return cert;
+    }
+
+    int fail(const char* msg){
+        cerr << "announceTest : " << msg << '\n';
+        return 1;
+    }
+}
+
+int main(void){
+    PkeyPtr pkey   { EVP_PKEY_Q_keygen(nullptr, nullptr, "EC", "P-256"), EVP_PKEY_free };
+    if(!pkey) return fail("key generation error.");
+    X509Ptr cert   { makeCert(pkey.get()) };
+    CtxPtr  srvCtx { SSL_CTX_new(TLS_server_method()), SSL_CTX_free },
+            cliCtx { SSL_CTX_new(TLS_client_method()), SSL_CTX_free };
+    if(!cert || !srvCtx || !cliCtx) return fail("certificate or context error.");
+    SSL_CTX_use_certificate(srvCtx.get(), cert.get());
+    SSL_CTX_use_PrivateKey(srvCtx.get(), pkey.get());
+
+    int fds[2] { -1, -1 };
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) return fail("socketpair error.");
+    Inet::setFdBlocking(fds[0], false);
+    Inet::setFdBlocking(fds[1], false);
+    SSL* srv { SSL_new(srvCtx.get()) };
+    SSL* cli { SSL_new(cliCtx.get()) };
+    SSL_set_fd(srv, fds[0]);
+    SSL_set_fd(cli, fds[1]);
+    SSL_set_accept_state(srv);
+    SSL_set_connect_state(cli);
+    bool srvDone { false },
+         cliDone { false };
+    for(int round{0}; !(srvDone && cliDone) && round < 32; round++){
+        if(!cliDone) cliDone = SSL_do_handshake(cli) == 1;
+        if(!srvDone) srvDone = SSL_do_handshake(srv) == 1;
+    }
+    if(!(srvDone && cliDone)) return fail("handshake didn't complete.");
+
+    int          tunFd  { open("/dev/null", O_WRONLY | O_CLOEXEC) };
+    int          status { 0 };
+    {
+        TunnelOptions  opts;
+        VpnSession     client { cli, fds[1], PAYLOAD_SIZE, opts, "client" },
+                       server { srv, fds[0], PAYLOAD_SIZE, opts, "server" };
+        uint64_t       now    { monotonicUs() };
+        client.start(now);
+        server.start(now);
+
+        static_assert(PREFIXES * inetlib::PREFIX_WIRE_LEN > PAYLOAD_SIZE && PREFIXES <= MAX_ANNOUNCED, 
+                      "announceTest : the prefixes must span more than one frame.");
+        vector<Prefix> sent;
+        for(uint32_t idx{0}; idx < PREFIXES; idx++) sent.push_back(Prefix{ 0x0a000000U | (idx << 8), 24 });
+
+        vector<Prefix> got;
+        IO_STATUS      result { client.announce(sent) };
+        for(int round{0}; result == IO_OK && got.size() < sent.size() && round < MAX_ROUNDS; round++){
+            if(client.wantWrite()) result = client.onWritable(tunFd);
+            if(result == IO_OK) result = server.receive(tunFd);
+            if(server.hasAnnounced())
+                for(const Prefix& prefix : server.takeAnnounced()) got.push_back(prefix);
+        }
+
+        if(result != IO_OK){
+            cerr << server.errorText(result) << '\n';
+            status = fail("announcement refused.");
+        }else if(got.size() != sent.size()){
+            status = fail("prefixes missing.");
+        }else{
+            for(size_t idx{0}; idx < sent.size(); idx++)
+                if(got[idx].addr != sent[idx].addr || got[idx].len != sent[idx].len){
+                    status = fail("prefix mismatch.");
+                    break;
+                }
+        }
+    }
+
+    SSL_free(srv);
+    SSL_free(cli);
+    close(fds[0]);
+    close(fds[1]);
+    close(tunFd);
+    return status;
+}
@@ -0,0 +1,158 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+// Deficit round-robin on the server egress: weighted shares, the longest queue paying when 
+// the pool is full, the deficit lost by a queue leaving the round, and a dequeue pass 
+// ending when every backlogged session is over its rate.
+
+#include <cstdint>
+#include <iostream>
+#include <array>
+#include <string>
+
+#include <egressScheduler.hpp>
+#include <shaper.hpp>
+#include <frames.hpp>
+
+namespace {
+
+    using std::cerr,
+          std::array,
+          std::string,
+          inetlib::EgressScheduler,
+          inetlib::EgressPacket,
+          inetlib::Shaper,
+          inetlib::SHAPE_NONE,
+          inetlib::FRAME_HEADER_LEN;
+
+    constexpr size_t   PAYLOAD   { 100 };
+    constexpr uint64_t NOW       { 1000000 };
+
+    // The first payload byte tells the packets apart.
+    void push(EgressScheduler& egress, uint32_t queue, size_t len, uint8_t tag){
+        array<uint8_t, PAYLOAD> pkt {};
+        pkt[0] = tag;
+        egress.enqueue(queue, pkt.data(), len);
+    }
+
+    uint8_t tagOf(const EgressPacket& packet){
+        return packet.frame[FRAME_HEADER_LEN];
+    }
+
+    bool reports(const EgressScheduler& egress, uint32_t queue, const char* field){
+        return egress.report(queue).find(field) != string::npos;
+    }
+
+    int fail(const char* msg){
+        cerr << "egressSchedulerTest : " << msg << '\n';
+        return 1;
+    }
+}
+
+int main(void){
+    EgressPacket packet {};
+
+    // Weights 1 and 3, full sized packets: whole rounds split 1:3.
+    {
+        EgressScheduler egress { 200, 400, PAYLOAD };
+        uint32_t        light  { egress.open(1, 1) },
+                        heavy  { egress.open(2, 3) };
+        for(int idx{0}; idx < 100; idx++){
+            push(egress, light, PAYLOAD, 0);
+            push(egress, heavy, PAYLOAD, 0);
+        }
+        array<size_t, 3> count {};
+        for(int idx{0}; idx < 80; idx++){
+            if(!egress.dequeue(packet, NOW)) return fail("backlogged queues sent nothing.");
+            count[static_cast<size_t>(packet.owner)]++;
+        }
+        if(count[1] != 20 || count[2] != 60) return fail("weighted share not 1:3.");
+    }
+
+    // A full pool drops the head of the longest queue, never the packet of a shorter one.
+    {
+        EgressScheduler egress { 10, 10, PAYLOAD };
+        uint32_t        big    { egress.open(1, 1) },
+                        mid    { egress.open(2, 1) },
+                        small  { egress.open(3, 1) };
+        for(uint8_t idx{0}; idx < 6; idx++) push(egress, big, PAYLOAD, idx);
+        for(uint8_t idx{0}; idx < 3; idx++) push(egress, mid, PAYLOAD, idx);
+        push(egress, small, PAYLOAD, 0);
+        push(egress, small, PAYLOAD, 1);
+        if(!reports(egress, big, "depth=5 ") || !reports(egress, big, "pushed_out=1") || 
+           !reports(egress, mid, "pushed_out=0") || !reports(egress, small, "depth=2 "))
+            return fail("push out didn't pick the longest queue.");
+        if(!egress.dequeue(packet, NOW) || packet.owner != 1 || tagOf(packet) != 1) 
+            return fail("the longest queue didn't lose its head.");
+        // The longest queue itself can't push out: its own packet is dropped.
+        EgressScheduler full   { 10, 4, PAYLOAD };
+        uint32_t        only   { full.open(1, 1) };
+        for(uint8_t idx{0}; idx < 5; idx++) push(full, only, PAYLOAD, idx);
+        if(!reports(full, only, "depth=4 ") || !reports(full, only, "drops=1 ") || !reports(full, only, "pushed_out=0"))
+            return fail("a queue pushed out its own packets.");
+    }
+
+    // An emptied queue loses what is left of its deficit: back in the round it sends one 
+    // 60 byte packet per quantum, not two.
+    {
+        EgressScheduler egress { 10, 20, PAYLOAD };
+        uint32_t        first  { egress.open(1, 1) },
+                        second { egress.open(2, 1) };
+        push(egress, first, 60, 0);
+        if(!egress.dequeue(packet, NOW) || packet.owner != 1) return fail("single packet not sent.");
+        if(egress.dequeue(packet, NOW) || egress.backlog()) return fail("empty queue left in the round.");
+        push(egress, first, 60, 1);
+        push(egress, first, 60, 2);
+        push(egress, second, PAYLOAD, 0);
+        push(egress, second, PAYLOAD, 1);
+        array<int, 4> order {};
+        for(int& owner : order){
+            if(!egress.dequeue(packet, NOW)) return fail("backlogged queues sent nothing.");
+            owner = packet.owner;
+        }
+        if(order != array<int, 4>{ 1, 2, 1, 2 }) return fail("deficit kept after leaving the round.");
+    }
+
+    // Sessions over their rate are skipped: the pass ends after a whole turn of them and 
+    // tells how long before the first conforms, the unshaped session going on meanwhile.
+    {
+        Shaper          shaper { Shaper::parse("", "10.0.0.0/8 0 0 800 1") };
+        EgressScheduler egress { 50, 100, PAYLOAD };
+        egress.setShaper(&shaper);
+        uint32_t        shapedA { egress.open(1, 1, shaper.open(0x0a000001U)) },
+                        shapedB { egress.open(2, 1, shaper.open(0x0a000002U)) },
+                        plain   { egress.open(3, 1, SHAPE_NONE) };
+        for(int idx{0}; idx < 20; idx++){
+            push(egress, shapedA, PAYLOAD, 0);
+            push(egress, shapedB, PAYLOAD, 0);
+        }
+        for(int idx{0}; idx < 5; idx++) push(egress, plain, PAYLOAD, 0);
+
+        // 1KB burst each: ten packets of 104 bytes on the wire, then debt.
+        array<size_t, 4> count {};
+        while(egress.dequeue(packet, NOW)) count[static_cast<size_t>(packet.owner)]++;
+        if(count[1] != 10 || count[2] != 10 || count[3] != 5) return fail("shaped queues not stopped at the burst.");
+        if(!egress.backlog() || egress.blockedUs() == 0) return fail("blocked pass without a wait.");
+        // 800 kbit/s: 100 bytes per millisecond.
+        uint64_t debt { 10 * (PAYLOAD + FRAME_HEADER_LEN) - 1024 };
+        if(egress.blockedUs() != debt * 10) return fail("wrong wait for the shaped queues.");
+        if(egress.dequeue(packet, NOW + egress.blockedUs() - 1)) return fail("shaped queue sent before conforming.");
+        if(!egress.dequeue(packet, NOW + debt * 10)) return fail("shaped queue still blocked after the wait.");
+    }
+
+    return 0;
+}
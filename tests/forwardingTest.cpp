@@ -0,0 +1,239 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+// The server forwarding path in steady state must not touch the heap: packets read from 
+// the TUN device go through the route lookup, the egress queues and the shaper to the 
+// session, and on to the client. Datagram socketpairs stand in for the TUN devices and a 
+// stream socketpair for the client connection. Built with NNVPN_ALLOC_CHECK: malloc is 
+// interposed and counted while the packets are forwarded.
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/pem.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <inetgeneral.hpp>
+#include <eventLoop.hpp>
+#include <allocTracker.hpp>
+#include <sslAllocator.hpp>
+#include <packet.hpp>
+#include <frames.hpp>
+#include <timeUtils.hpp>
+
+namespace inetlib {
+
+    using std::cerr,
+          std::string,
+          std::vector,
+          std::unique_ptr,
+          std::make_unique,
+          timeutils::monotonicUs;
+
+    using PkeyPtr   = unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)>;
+    using X509Ptr   = unique_ptr<X509,     decltype(&X509_free)>;
+    using CtxPtr    = unique_ptr<SSL_CTX,  decltype(&SSL_CTX_free)>;
+
+    class NnVpnServerTest{
+        public:
+            static int   run(void)                                         anyexcept;
+
+        private:
+            static constexpr size_t    PAYLOAD_SIZE { 1500 },
+                                       PACKET_LEN   { 1400 },
+                                       BURST        { 16 },
+                                       WARMUP       { 4096 },
+                                       PACKETS      { 16000 };
+            static constexpr uint32_t  CLIENT_ADDR  { 0x0a090002U };
+            static constexpr int       MAX_ROUNDS   { 64 };
+
+            static X509Ptr  makeCert(EVP_PKEY* pkey)                       noexcept;
+            static bool     writePem(const string& dir, EVP_PKEY* pkey, 
+                                     X509* cert)                           noexcept;
+            static int      fail(const char* msg)                          noexcept;
+    };
+
+    X509Ptr NnVpnServerTest::makeCert(EVP_PKEY* pkey) noexcept{
+        X509Ptr cert { X509_new(), X509_free };
+        if(!cert) return cert;
+        ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert.get()), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert.get()), 3600);
+        X509_set_pubkey(cert.get(), pkey);
+        X509_NAME* name { X509_get_subject_name(cert.get()) };
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("nnvpn-test"), -1, -1, 0);
+        X509_set_issuer_name(cert.get(), name);
+        if(X509_sign(cert.get(), pkey, EVP_sha256()) == 0) cert.reset();
+        return cert;
+    }
+
+    // The server loads its certificate and key from files.
+    bool NnVpnServerTest::writePem(const string& dir, EVP_PKEY* pkey, X509* cert) noexcept{
+        FILE* certFile { fopen((dir + "/cert.pem").c_str(), "w") };
+        FILE* keyFile  { fopen((dir + "/key.pem").c_str(), "w") };
+        bool  done     { certFile != nullptr && keyFile != nullptr &&
+                         PEM_write_X509(certFile, cert) == 1 && 
+                         PEM_write_PrivateKey(keyFile, pkey, nullptr, nullptr, 0, nullptr, nullptr) == 1 };
+        if(certFile != nullptr) fclose(certFile);
+        if(keyFile != nullptr)  fclose(keyFile);
+        return done;
+    }
+
+    int NnVpnServerTest::fail(const char* msg) noexcept{
+        cerr << "forwardingTest : " << msg << '\n';
+        return 1;
+    }
+
+    int NnVpnServerTest::run(void) anyexcept{
+        SslAllocator::install();
+        char    dirName[] { "/tmp/nnvpnTestXXXXXX" };
+        if(mkdtemp(dirName) == nullptr) return fail("temporary directory error.");
+        string  dir       { dirName };
+        PkeyPtr pkey      { EVP_PKEY_Q_keygen(nullptr, nullptr, "EC", "P-256"), EVP_PKEY_free };
+        X509Ptr cert      { pkey ? makeCert(pkey.get()) : X509Ptr{ nullptr, X509_free } };
+        bool    written   { cert && writePem(dir, pkey.get(), cert.get()) };
+
+        // Egress queues and an egress rate the test never reaches: every stage is on the path.
+        TunnelOptions opts;
+        opts.flushDeadlineUs = 0;
+        opts.shaping         = Shaper::parse("", "127.0.0.0/8 0 0 100000000 1048576");
+        unique_ptr<NnVpnServer> server;
+        if(written) server = make_unique<NnVpnServer>(dir + "/cert.pem", dir + "/key.pem", "127.0.0.1", "0", "nnvpntest", PAYLOAD_SIZE, opts);
+        static_cast<void>(unlink((dir + "/cert.pem").c_str()));
+        static_cast<void>(unlink((dir + "/key.pem").c_str()));
+        static_cast<void>(rmdir(dir.c_str()));
+        if(!server) return fail("certificate error.");
+
+        int  conn[2]   { -1, -1 },
+             srvTun[2] { -1, -1 },
+             cliTun[2] { -1, -1 };
+        if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, conn) == -1 ||
+           socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, srvTun) == -1 ||
+           socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, cliTun) == -1)
+            return fail("socketpair error.");
+
+        // As acceptPeers() does, with the server end of the pair for the accepted socket.
+        server->loop         = EventLoop::create(opts.eventBackend);
+        auto    accepted     { make_unique<ServerPeer>() };
+        accepted->fd         = conn[0];
+        accepted->source     = 0x7f000001U;
+        accepted->name       = "client";
+        accepted->cSSL       = server->sslServer.newSession(conn[0]);
+        server->loop->add(conn[0], EV_READ);
+        ServerPeer& peer     { *(server->peers.emplace(conn[0], std::move(accepted)).first->second) };
+
+        CtxPtr  cliCtx       { SSL_CTX_new(TLS_client_method()), SSL_CTX_free };
+        SSL*    cli          { SSL_new(cliCtx.get()) };
+        SSL_set_fd(cli, conn[1]);
+        SSL_set_connect_state(cli);
+        bool    cliDone      { false };
+        for(int round{0}; !(cliDone && peer.state == PEER_ESTABLISHED) && round < MAX_ROUNDS; round++){
+            if(!cliDone) cliDone = SSL_do_handshake(cli) == 1;
+            if(peer.state == PEER_HANDSHAKE && !server->handshake(peer, monotonicUs())) break;
+        }
+        if(!cliDone || peer.state != PEER_ESTABLISHED) return fail("handshake didn't complete.");
+        if(peer.queue == EGRESS_NO_QUEUE || peer.shape == SHAPE_NONE) return fail("egress queue or shaper not on the path.");
+
+        int     status { 0 };
+        {
+            VpnSession       client  { cli, conn[1], PAYLOAD_SIZE, opts, "client" };
+            vector<uint8_t>  frame(FRAME_HEADER_LEN + PACKET_LEN, 0),
+                             sink(FRAME_MAX_PAYLOAD);
+            pollfd           srvPfd  { conn[0], POLLIN, 0 },
+                             cliPfd  { conn[1], POLLIN, 0 };
+            uint8_t*         ipHdr   { frame.data() + FRAME_HEADER_LEN + VNET_HDR_LEN };
+            client.start(monotonicUs());
+
+            // A packet from the client inner address: the server learns the route to it.
+            ipHdr[0] = 0x45;
+            storeBe32(ipHdr + 12, CLIENT_ADDR);
+            IO_STATUS result { client.sendPacket(frame.data(), PACKET_LEN) };
+            if(result == IO_OK) result = client.flush(monotonicUs());
+            for(int round{0}; result == IO_OK && server->routes.resolve(CLIENT_ADDR) != conn[0] && round < MAX_ROUNDS; round++)
+                if(poll(&srvPfd, 1, 10) > 0) server->servePeer(peer, EV_READ, srvTun[0], monotonicUs());
+            if(result != IO_OK || server->routes.resolve(CLIENT_ADDR) != conn[0]) return fail("route to the client not learned.");
+            while(read(srvTun[1], sink.data(), sink.size()) > 0){}
+
+            // Packets to the client inner address, as the TUN device returns them.
+            storeBe32(ipHdr + 12, 0x0a090001U);
+            storeBe32(ipHdr + 16, CLIENT_ADDR);
+            auto forward { [&](size_t count) -> size_t {
+                size_t delivered { 0 };
+                for(size_t sent{0}; sent < count && result == IO_OK; sent += BURST){
+                    for(size_t pkt{0}; pkt < BURST; pkt++)
+                        if(write(srvTun[1], frame.data() + FRAME_HEADER_LEN, PACKET_LEN) == -1) return delivered;
+                    server->forwardFromTun(srvTun[0]);
+                    server->serveEgress();
+                    static_cast<void>(server->serviceTimers(monotonicUs()));
+                    while(result == IO_OK && poll(&cliPfd, 1, 0) > 0) result = client.receive(cliTun[0]);
+                    if(result == IO_OK) result = client.timers(monotonicUs());
+                    if(result == IO_OK) result = client.flush(monotonicUs());
+                    // Keepalive answers: the server side reads the client as in service.
+                    if(server->peers.contains(conn[0]) && poll(&srvPfd, 1, 0) > 0) 
+                        server->servePeer(peer, EV_READ, srvTun[0], monotonicUs());
+                    while(read(cliTun[1], sink.data(), sink.size()) > 0) delivered++;
+                }
+                return delivered;
+            } };
+
+            static_cast<void>(forward(WARMUP));
+            AllocTracker::arm();
+            size_t    delivered { forward(PACKETS) };
+            uint64_t  allocs    { AllocTracker::disarm() };
+
+            if(result != IO_OK){
+                cerr << client.errorText(result) << '\n';
+                status = fail("client session error.");
+            }else if(!server->peers.contains(conn[0])){
+                status = fail("server closed the session.");
+            }else if(delivered != PACKETS){
+                cerr << delivered << " of " << PACKETS << '\n';
+                status = fail("packets lost.");
+            }else if(allocs != 0){
+                cerr << allocs << " heap allocations, last of " << AllocTracker::lastSize() << " bytes\n";
+                status = fail("the forwarding path allocated.");
+            }
+            client.shutdown();
+        }
+
+        // The peer closes its end with the server.
+        server.reset();
+        SSL_free(cli);
+        for(int fd : { conn[1], srvTun[0], srvTun[1], cliTun[0], cliTun[1] }) close(fd);
+        return status;
+    }
+
+} // End namespace
+
+int main(void){
+    try{
+        return inetlib::NnVpnServerTest::run();
+    }catch(inetlib::InetException& ex){
+        std::cerr << "forwardingTest : " << ex.what() << '\n';
+        return 1;
+    }
+}
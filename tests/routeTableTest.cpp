@@ -0,0 +1,170 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+// The route table against a linear longest prefix match: inserts, removals, lookups and 
+// the chunks given back by prune. Removals must not allocate, whatever run they split 
+// (counted when built with NNVPN_ALLOC_CHECK).
+
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+
+#include <routeTable.hpp>
+#include <allocTracker.hpp>
+
+namespace {
+
+    using std::cerr,
+          std::string,
+          std::vector,
+          std::mt19937,
+          std::any_of,
+          inetlib::RouteTable,
+          inetlib::Prefix,
+          inetlib::AllocTracker,
+          inetlib::prefixMask,
+          inetlib::ROUTE_STATIC,
+          inetlib::ROUTE_ANNOUNCED;
+
+    constexpr int     PEERS       { 8 };
+    constexpr int     FUZZ_ROUNDS { 20000 };
+
+    struct Entry{
+        Prefix   prefix;
+        int      fd;
+    };
+
+    // The reference: the longest prefix wins, -1 if none.
+    int naive(const vector<Entry>& entries, uint32_t dst){
+        int     fd   { -1 };
+        int     best { -1 };
+        for(const Entry& entry : entries)
+            if((dst & prefixMask(entry.prefix.len)) == entry.prefix.addr && entry.prefix.len > best){
+                best = entry.prefix.len;
+                fd   = entry.fd;
+            }
+        return fd;
+    }
+
+    bool sameRoutes(const RouteTable& table, const vector<Entry>& entries, const vector<uint32_t>& probes){
+        for(uint32_t dst : probes)
+            if(table.resolve(dst) != naive(entries, dst)) return false;
+        return true;
+    }
+
+    bool noChunks(const RouteTable& table){
+        return table.report().find(" chunks=0/0 ") != string::npos;
+    }
+
+    int fail(const char* msg){
+        cerr << "routeTableTest : " << msg << '\n';
+        return 1;
+    }
+}
+
+int main(void){
+    RouteTable        table;
+    vector<uint32_t>  hops;
+    for(int fd{0}; fd < PEERS; fd++){
+        hops.push_back(table.hopForAddr(0x0a000001U + static_cast<uint32_t>(fd)));
+        static_cast<void>(table.bind(hops.back(), fd));
+    }
+
+    // Nested prefixes: each removal falls back to the next shorter one.
+    vector<Entry>     entries { { { 0x0a000000U, 8 },  0 }, { { 0x0a010000U, 16 }, 1 }, 
+                                { { 0x0a010200U, 24 }, 2 }, { { 0x0a010203U, 32 }, 3 } };
+    vector<uint32_t>  probes  { 0x0a010203U, 0x0a010204U, 0x0a0103ffU, 0x0a020000U, 0x0b000000U, 0 };
+    for(const Entry& entry : entries)
+        if(!table.insert(entry.prefix, hops[entry.fd], ROUTE_STATIC)) return fail("insert refused.");
+    if(table.insert(entries[2].prefix, hops[4], ROUTE_STATIC)) return fail("duplicate prefix accepted.");
+    if(!sameRoutes(table, entries, probes)) return fail("nested lookup mismatch.");
+    while(!entries.empty()){
+        size_t victim { entries.size() > 2 ? size_t{1} : entries.size() - 1 };
+        if(!table.remove(entries[victim].prefix)) return fail("remove refused.");
+        entries.erase(entries.begin() + static_cast<long>(victim));
+        if(!sameRoutes(table, entries, probes)) return fail("nested removal mismatch.");
+    }
+    if(table.remove(Prefix{ 0x0a000000U, 8 })) return fail("removed a missing prefix.");
+    if(table.size() != 0 || !noChunks(table)) return fail("chunks left after the removals.");
+
+    // Adjacent /24s on one hop are a single run: removing every other one splits it in 256,
+    // the chunk outgrows its segment.
+    entries.push_back(Entry{ { 0x0a010000U, 16 }, 0 });
+    static_cast<void>(table.insert(entries.back().prefix, hops[0], ROUTE_STATIC));
+    for(uint32_t idx{0}; idx < 256; idx++){
+        entries.push_back(Entry{ { 0x0a010000U | (idx << 8), 24 }, 1 });
+        static_cast<void>(table.insert(entries.back().prefix, hops[1], ROUTE_STATIC));
+    }
+    probes.clear();
+    for(uint32_t idx{0}; idx < 256; idx++) probes.push_back(0x0a010000U | (idx << 8) | idx);
+    AllocTracker::arm();
+    for(uint32_t idx{0}; idx < 256; idx += 2) static_cast<void>(table.remove(Prefix{ 0x0a010000U | (idx << 8), 24 }));
+    uint64_t allocs { AllocTracker::disarm() };
+    if(allocs != 0) return fail("splitting removals allocated.");
+    std::erase_if(entries, [](const Entry& entry){ return entry.prefix.len == 24 && ((entry.prefix.addr >> 8) & 1) == 0; });
+    if(!sameRoutes(table, entries, probes)) return fail("split lookup mismatch.");
+
+    // Announced routes leave with their session, configured ones stay unbound.
+    uint32_t peerHop { table.hopForPeer(PEERS) };
+    static_cast<void>(table.insert(Prefix{ 0xc0a80000U, 24 }, peerHop, ROUTE_ANNOUNCED));
+    static_cast<void>(table.insert(Prefix{ 0xc0a80100U, 25 }, peerHop, ROUTE_ANNOUNCED));
+    if(table.resolve(0xc0a80180U) != -1 || table.resolve(0xc0a80101U) != PEERS) return fail("announced lookup mismatch.");
+    AllocTracker::arm();
+    table.dropPeer(PEERS);
+    table.dropPeer(1);
+    allocs = AllocTracker::disarm();
+    if(allocs != 0) return fail("dropPeer allocated.");
+    if(table.resolve(0xc0a80101U) != -1 || table.resolve(0xc0a80000U) != -1) return fail("announced routes survived the session.");
+    if(table.size() != entries.size() || table.resolve(0x0a010101U) != -1) return fail("configured routes lost.");
+    static_cast<void>(table.bind(hops[1], 1));
+    if(!sameRoutes(table, entries, probes)) return fail("rebound lookup mismatch.");
+    for(const Entry& entry : entries) static_cast<void>(table.remove(entry.prefix));
+    entries.clear();
+    if(!noChunks(table)) return fail("chunks left after the split removals.");
+
+    // Random prefixes in a narrow range, so they nest and share chunks.
+    mt19937           rng     { 12345 };
+    probes.clear();
+    for(int idx{0}; idx < 512; idx++) probes.push_back(0x0a000000U | static_cast<uint32_t>(rng() & 0x0003ffffU));
+    for(int round{0}; round < FUZZ_ROUNDS; round++){
+        if(entries.empty() || rng() % 3 != 0){
+            uint8_t   len    { static_cast<uint8_t>(12 + rng() % 21) };
+            Prefix    prefix { (0x0a000000U | static_cast<uint32_t>(rng() & 0x0003ffffU)) & prefixMask(len), len };
+            int       fd     { static_cast<int>(rng() % PEERS) };
+            bool      known  { any_of(entries.begin(), entries.end(), 
+                                           [prefix](const Entry& entry){ return entry.prefix.addr == prefix.addr && entry.prefix.len == prefix.len; }) };
+            if(table.insert(prefix, hops[static_cast<size_t>(fd)], ROUTE_STATIC) == known) return fail("insert result mismatch.");
+            if(!known) entries.push_back(Entry{ prefix, fd });
+        }else{
+            size_t    victim { rng() % entries.size() };
+            AllocTracker::arm();
+            bool      removed { table.remove(entries[victim].prefix) };
+            allocs = AllocTracker::disarm();
+            if(!removed || allocs != 0) return fail("random removal failed or allocated.");
+            entries.erase(entries.begin() + static_cast<long>(victim));
+        }
+        if(round % 64 == 0 && !sameRoutes(table, entries, probes)) return fail("random lookup mismatch.");
+    }
+    if(!sameRoutes(table, entries, probes)) return fail("random lookup mismatch.");
+    for(const Entry& entry : entries) static_cast<void>(table.remove(entry.prefix));
+    if(table.size() != 0 || !noChunks(table)) return fail("chunks left after the random removals.");
+
+    return 0;
+}
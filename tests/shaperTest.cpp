@@ -0,0 +1,106 @@
+// -----------------------------------------------------------------
+// Inet - networking library
+// Copyright (C) 2023  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+// Token buckets and the two level shaper: the wait before a debt is paid back, refills 
+// that can't overflow whatever the idle time, and a group bucket in debt stopping every 
+// session in it.
+
+#include <cstdint>
+#include <iostream>
+
+#include <shaper.hpp>
+#include <timeUtils.hpp>
+
+namespace {
+
+    using std::cerr,
+          inetlib::TokenBucket,
+          inetlib::RateLimit,
+          inetlib::Shaper,
+          inetlib::SHAPE_NONE,
+          inetlib::SHAPE_INGRESS,
+          inetlib::SHAPE_EGRESS,
+          inetlib::SHAPE_MAX_RATE_KBIT,
+          inetlib::SHAPE_MAX_BURST_KB,
+          timeutils::USEC_PER_SEC;
+
+    constexpr uint64_t T0 { 1000000 };
+
+    int fail(const char* msg){
+        cerr << "shaperTest : " << msg << '\n';
+        return 1;
+    }
+}
+
+int main(void){
+    // 1000 bytes per second, 500 bytes of burst: 600 bytes leave a 100ms debt.
+    {
+        TokenBucket bucket { RateLimit{ 1000, 500 } };
+        if(!bucket.conforms(T0) || bucket.available() != 500) return fail("new bucket not full.");
+        bucket.consume(600);
+        if(bucket.waitUs() != 100000 || bucket.available() != 0) return fail("wrong debt wait.");
+        if(bucket.conforms(T0 + 99999)) return fail("conforming before the debt is paid.");
+        if(bucket.waitUs() != 1) return fail("wait not counted from the last refill.");
+        if(!bucket.conforms(T0 + 100000) || bucket.waitUs() != 0) return fail("debt paid, still not conforming.");
+        if(!bucket.conforms(T0 + 100000 + 250000) || bucket.available() != 250) return fail("partial refill wrong.");
+        if(!bucket.conforms(T0 + 10 * USEC_PER_SEC) || bucket.available() != 500) return fail("refill past the burst.");
+        TokenBucket open {};
+        open.consume(1000000);
+        if(!open.conforms(T0) || open.waitUs() != 0) return fail("unlimited bucket limited.");
+    }
+
+    // The largest rate and burst after the longest idle time: rate * elapsed would wrap.
+    {
+        constexpr uint64_t RATE  { SHAPE_MAX_RATE_KBIT * 1000 / 8 },
+                           BURST { SHAPE_MAX_BURST_KB * 1024 };
+        TokenBucket bucket { RateLimit{ RATE, BURST } };
+        static_cast<void>(bucket.conforms(1));
+        bucket.consume(2 * BURST);
+        if(bucket.conforms(2)) return fail("huge debt paid at once.");
+        if(!bucket.conforms(UINT64_MAX / 2) || bucket.available() != BURST) return fail("long idle refill overflowed.");
+        bucket.consume(BURST / 2);
+        if(!bucket.conforms(UINT64_MAX / 2 + 1) || bucket.available() != BURST / 2 + RATE / USEC_PER_SEC) 
+            return fail("refill after a long idle wrong.");
+    }
+
+    // Sessions with 10KB of burst each in a group with 1KB: one session's traffic 
+    // stops the other, the group's debt sets the wait of both.
+    {
+        Shaper   shaper   { Shaper::parse("slow 0 0 800 1", "10.0.0.0/8 0 0 8000 10 slow, 192.168.0.0/16 0 0 8000 10") };
+        uint32_t first    { shaper.open(0x0a000001U) },
+                 second   { shaper.open(0x0a000002U) },
+                 alone    { shaper.open(0xc0a80001U) };
+        if(shaper.open(0xac100001U) != SHAPE_NONE) return fail("unmatched source shaped.");
+        if(!shaper.admit(first, SHAPE_EGRESS, T0)) return fail("first frame refused.");
+        shaper.charge(first, SHAPE_EGRESS, 1124);
+        if(shaper.admit(second, SHAPE_EGRESS, T0)) return fail("group debt didn't stop the other session.");
+        // 800 kbit/s: 100 bytes of debt are 1ms.
+        if(shaper.waitUs(second, SHAPE_EGRESS) != 1000 || shaper.waitUs(first, SHAPE_EGRESS) != 1000) 
+            return fail("group wait not applied.");
+        if(shaper.available(second, SHAPE_EGRESS, T0) != 0) return fail("group debt not in the available bytes.");
+        if(!shaper.admit(alone, SHAPE_EGRESS, T0)) return fail("session outside the group stopped.");
+        if(!shaper.admit(second, SHAPE_INGRESS, T0)) return fail("unlimited direction stopped.");
+        if(shaper.admit(second, SHAPE_EGRESS, T0 + 999)) return fail("group debt paid early.");
+        if(!shaper.admit(second, SHAPE_EGRESS, T0 + 1000)) return fail("group debt paid, session still stopped.");
+        if(shaper.available(first, SHAPE_EGRESS, T0 + 1000 + 5000) != 500) return fail("group doesn't cap the available bytes.");
+        shaper.close(first);
+        shaper.close(second);
+        shaper.close(alone);
+    }
+
+    return 0;
+}